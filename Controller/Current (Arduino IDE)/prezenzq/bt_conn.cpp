@@ -20,6 +20,24 @@
 static SoftwareSerial HC05(BT_RX, BT_TX);
 static int debug_enabled;
 
+static char controller_id;
+
+/**
+   speaks_v2 is set once the videoq has shown it understands v2, from then on
+   everything is sent as v2. v2_only is set once a valid v2 message has been
+   received, after which bare v1 bytes are no longer looked for, unless the
+   videoq restarts (see bt_conn_receive()).
+*/
+static int speaks_v2;
+static int v2_only;
+static byte send_sequence;
+
+static byte receive_buffer[BT_PACKET_ENCODED_LIMIT];
+static int receive_length;
+static int in_packet;
+static int discarding;
+static int ping_pending;
+
 int bt_conn_init() {
   pinMode(BT_DEBUG_ENABLED, INPUT);
   debug_enabled = digitalRead(BT_DEBUG_ENABLED);
@@ -50,10 +68,267 @@ int bt_conn_read() {
   return HC05.read();
 }
 
+void bt_conn_set_id(char _id) {
+  controller_id = _id;
+}
+
+/**
+   CRC-16/CCITT-FALSE, the same as the videoq's packetCrc().
+*/
+static unsigned int bt_conn_crc(const byte* _data, int _len) {
+  unsigned int crc = 0xFFFF;
+
+  for (int i = 0; i < _len; i++)
+  {
+    crc ^= ((unsigned int)_data[i]) << 8;
+
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+  }
+
+  return crc & 0xFFFF;
+}
+
+/**
+   Builds the packet, COBS encodes it and sends it with a 0x00 on either side.
+*/
+static void bt_conn_send_packet(byte _type, const byte* _payload, int _len) {
+  byte raw[BT_PACKET_HEADER_LENGTH + BT_PACKET_PAYLOAD_LIMIT + BT_PACKET_CRC_LENGTH];
+  byte encoded[BT_PACKET_ENCODED_LIMIT];
+  int raw_len = 0;
+  int encoded_len = 0;
+
+  raw[raw_len++] = _len;
+  raw[raw_len++] = _type;
+  raw[raw_len++] = send_sequence++;
+  raw[raw_len++] = controller_id;
+
+  for (int i = 0; i < _len; i++)
+  {
+    raw[raw_len++] = _payload[i];
+  }
+
+  unsigned int crc = bt_conn_crc(raw, raw_len);
+  raw[raw_len++] = crc >> 8;
+  raw[raw_len++] = crc & 0xFF;
+
+  encoded[encoded_len++] = 0x00;
+  int code_index = encoded_len++;
+  byte code = 1;
+
+  for (int i = 0; i < raw_len; i++)
+  {
+    if (raw[i] == 0)
+    {
+      encoded[code_index] = code;
+      code_index = encoded_len++;
+      code = 1;
+    }
+    else
+    {
+      encoded[encoded_len++] = raw[i];
+      code++;
+    }
+  }
+
+  encoded[code_index] = code;
+  encoded[encoded_len++] = 0x00;
+
+  bt_conn_send(encoded, encoded_len);
+}
+
+static void bt_conn_send_pong(byte _sequence) {
+  if (speaks_v2)
+  {
+    bt_conn_send_packet(BT_PACKET_PONG, &_sequence, 1);
+  }
+  else
+  {
+    byte pong[5] = { '[', (byte)controller_id, BT_PING, _sequence, ']' };
+    bt_conn_send(pong, 5);
+  }
+}
+
+/**
+   Undoes the COBS encoding of a received packet and checks its length and CRC.
+   Returns the LED command it carries, or -1. Anything that doesn't check out is
+   dropped.
+*/
+static int bt_conn_handle_packet() {
+  byte decoded[BT_PACKET_ENCODED_LIMIT];
+  int decoded_len = 0;
+  int i = 0;
+
+  while (i < receive_length)
+  {
+    byte code = receive_buffer[i++];
+
+    for (byte j = 1; j < code; j++)
+    {
+      if (i >= receive_length)
+      {
+        return -1;
+      }
+      decoded[decoded_len++] = receive_buffer[i++];
+    }
+
+    if ((code < 0xFF) && (i < receive_length))
+    {
+      decoded[decoded_len++] = 0;
+    }
+  }
+
+  if ((decoded_len < BT_PACKET_HEADER_LENGTH + BT_PACKET_CRC_LENGTH)
+      || (decoded[0] != decoded_len - BT_PACKET_HEADER_LENGTH - BT_PACKET_CRC_LENGTH))
+  {
+    return -1;
+  }
+
+  int crc_at = decoded_len - BT_PACKET_CRC_LENGTH;
+  unsigned int crc = (((unsigned int)decoded[crc_at]) << 8) | decoded[crc_at + 1];
+
+  if (crc != bt_conn_crc(decoded, crc_at))
+  {
+    return -1;
+  }
+
+  speaks_v2 = 1;
+  v2_only = 1;
+
+  //  Messages for other controllers sharing the link are ignored. ID 0 is for any.
+  if ((decoded[3] != 0) && (decoded[3] != (byte)controller_id))
+  {
+    return -1;
+  }
+
+  if (decoded[0] < 1)
+  {
+    return -1;
+  }
+
+  switch (decoded[1])
+  {
+    case BT_PACKET_LED:
+      return decoded[BT_PACKET_HEADER_LENGTH];
+    case BT_PACKET_PING:
+      bt_conn_send_pong(decoded[BT_PACKET_HEADER_LENGTH]);
+      break;
+  }
+
+  return -1;
+}
+
+/**
+   Runs one received byte through the receiver and returns the LED command it
+   completes, or -1.
+
+   A 0x00 opens a packet and the next one closes it. Until v2 has been heard,
+   bytes outside of a packet are v1: single byte LED commands, and 'P' followed
+   by a ping's sequence number. A v1 ping is answered in v2, which is how the
+   videoq finds out this controller speaks it.
+
+   Once only v2 is listened for, a byte that can't start a packet where one
+   should start means the videoq has restarted and speaks v1 again. Everything
+   starts over as at power up, and the byte is taken as v1.
+*/
+static int bt_conn_receive(byte _byte) {
+  if (_byte == 0x00)
+  {
+    int command = -1;
+
+    if (in_packet && (receive_length > 0))
+    {
+      command = bt_conn_handle_packet();
+      in_packet = v2_only;
+    }
+    else if (in_packet && discarding)
+    {
+      in_packet = v2_only;
+    }
+    else
+    {
+      in_packet = 1;
+    }
+
+    receive_length = 0;
+    discarding = 0;
+    return command;
+  }
+
+  if (v2_only && in_packet && (receive_length == 0) && !discarding && (_byte > BT_PACKET_CODE_LIMIT))
+  {
+    speaks_v2 = 0;
+    v2_only = 0;
+    in_packet = 0;
+  }
+
+  if (in_packet)
+  {
+    if (receive_length >= BT_PACKET_ENCODED_LIMIT)
+    {
+      receive_length = 0;
+      discarding = 1;
+    }
+    else if (!discarding)
+    {
+      receive_buffer[receive_length++] = _byte;
+    }
+    return -1;
+  }
+
+  if (ping_pending)
+  {
+    ping_pending = 0;
+    speaks_v2 = 1;
+    bt_conn_send_pong(_byte);
+    return -1;
+  }
+
+  if (_byte == BT_PING)
+  {
+    ping_pending = 1;
+    return -1;
+  }
+
+  return _byte;
+}
+
 int bt_conn_get_command() {
-  if (bt_conn_available())
+  while (bt_conn_available())
+  {
+    int command = bt_conn_receive(bt_conn_read());
+
+    if (command >= 0)
+    {
+      return command;
+    }
+  }
+
+  return -1;
+}
+
+void bt_conn_send_state(byte _state) {
+  if (speaks_v2)
+  {
+    bt_conn_send_packet(BT_PACKET_STATE, &_state, 1);
+  }
+  else
+  {
+    byte frame[4] = { '[', (byte)controller_id, _state, ']' };
+    bt_conn_send(frame, 4);
+  }
+}
+
+void bt_conn_send_error(byte _code) {
+  if (speaks_v2)
+  {
+    bt_conn_send_packet(BT_PACKET_SENSOR_ERROR, &_code, 1);
+  }
+  else
   {
-    return bt_conn_read();
+    bt_conn_send(_code);
   }
 }
 
@@ -49,6 +49,37 @@
 */
 #define BT_DEBUG_ENABLED A0
 
+/**
+   The videoq on PC pings each controller with a 'P' followed by a sequence
+   number, and expects the frame [{ID CHARACTER}P{SEQUENCE}] back.
+*/
+#define BT_PING 'P'
+
+/**
+   Protocol v2, see Packet.h in the videoq for the details. Each message is
+
+   [LENGTH][TYPE][SEQUENCE][ID][PAYLOAD...][CRC-16 HIGH][CRC-16 LOW]
+
+   COBS encoded and sent with a 0x00 on either side, so a corrupted byte only
+   costs the one message it landed in. The controller starts out speaking v1,
+   and answers the videoq's first ping in v2 to let it know it can. Once a
+   valid v2 message has come back, only v2 is listened for, until a byte
+   above BT_PACKET_CODE_LIMIT arrives where a packet should start. That can
+   only be v1 from a videoq that has restarted, so the controller starts
+   over on v1.
+*/
+#define BT_PACKET_HEADER_LENGTH 4
+#define BT_PACKET_CRC_LENGTH 2
+#define BT_PACKET_PAYLOAD_LIMIT 8
+#define BT_PACKET_ENCODED_LIMIT (BT_PACKET_HEADER_LENGTH + BT_PACKET_PAYLOAD_LIMIT + BT_PACKET_CRC_LENGTH + 3)
+#define BT_PACKET_CODE_LIMIT (BT_PACKET_HEADER_LENGTH + BT_PACKET_PAYLOAD_LIMIT + BT_PACKET_CRC_LENGTH + 1)
+
+#define BT_PACKET_STATE 0x01
+#define BT_PACKET_LED 0x02
+#define BT_PACKET_PING 0x03
+#define BT_PACKET_PONG 0x04
+#define BT_PACKET_SENSOR_ERROR 0x05
+
 /**
    Currently this function only initializes whether the bluetooth module
    is to start in debug mode or not. This function should always be called
@@ -66,4 +97,26 @@ void bt_conn_send(int _data);
 void bt_conn_send(byte* _data, int _len);
 int bt_conn_available();
 int bt_conn_read();
+
+/**
+   Sets the ID character this controller puts in every message it sends, and
+   answers v2 messages to.
+*/
+void bt_conn_set_id(char _id);
+
+/**
+   Reads whatever the videoq has sent and returns the next LED command, 'F', 'W'
+   or 'N', or -1 if there isn't one. Heartbeat pings are answered along the way.
+*/
 int bt_conn_get_command();
+
+/**
+   Sends the controller's state, 0x01 for 'queue video' and 0x00 for 'dequeue',
+   in whichever protocol the videoq speaks.
+*/
+void bt_conn_send_state(byte _state);
+
+/**
+   Sends one of the sensor's error codes.
+*/
+void bt_conn_send_error(byte _code);
@@ -120,15 +120,15 @@ void manual_control_state()
        This is initialized as the 'dequeue command' given the 0x00 payload. A
        payload of 0x01 will indicate the 'queue video' command.
     */
-    byte cmd[4] = { '[', SENSOR_ID, 0x00, ']' };
+    byte state = 0x00;
 
     if (switch_state == 1) {
-      cmd[2] = 0x01; // update the payload to the 'queue' command.
+      state = 0x01; // update the payload to the 'queue' command.
     } else if (switch_state == 2) {
       switch_state = 0; // keep the initial 0x00 payload and reset the switch state.
     }
 
-    bt_conn_send(cmd, 4);
+    bt_conn_send_state(state);
   }
 }
 
@@ -137,7 +137,8 @@ void manual_control_state()
    prezenzq video player running on the connected PC.
 
    Currently this only serves to manipulate the LED strip based
-   on three different ascii values recieved, F, W, and N.
+   on three different ascii values recieved, F, W, and N. The
+   videoq's heartbeat pings are answered inside bt_conn_get_command().
 */
 void handle_video_q_update() {
   static char command;
@@ -192,12 +193,6 @@ void sensor_control_state()
   // See tof_sensor.cpp for status values.
   int sensor_status = tof_sensor_update();
 
-  /**
-     This is initialized as the 'dequeue command' given the 0x00 payload. A
-     payload of 0x01 will indicate the 'queue video' command.
-  */
-  byte cmd[4] = { '[', SENSOR_ID, 0x00, ']' };
-
   /**
      This check ensures we only respond when the success state of of the
      sensor has changed, since this function runs continuously in loop.
@@ -205,14 +200,13 @@ void sensor_control_state()
   if (sensor_status != previous_sensor_status) {
     switch (sensor_status) {
       case -1:
-        bt_conn_send(SENSOR_ERROR_TIMEOUT);
+        bt_conn_send_error(SENSOR_ERROR_TIMEOUT);
         break;
       case 0:
-        cmd[2] = 0x01; // update the payload to the 'queue' command.
-        bt_conn_send(cmd, 4);
+        bt_conn_send_state(0x01); // the 'queue video' command.
         break;
       case 1:
-        bt_conn_send(cmd, 4); // keep the initial 0x00 payload
+        bt_conn_send_state(0x00); // the 'dequeue' command.
         break;
     }
     
@@ -265,6 +259,7 @@ void setup()
     execute_control_state = &sensor_control_state;
   }
 
+  bt_conn_set_id(SENSOR_ID);
   bt_conn_start();
 
 }
@@ -20,14 +20,38 @@
 #define BT_DEBUG_ENABLED A0
 #define CONTROLLER_BUFFER_LIMIT 64
 
-#define OUT_OF_COMMAND 0
-#define START_COMMAND 1
-#define IN_COMMAND 2
-#define END_COMMAND 3
-
 #define R_BRACKET '['
 #define L_BRACKET ']'
 
+/*  The videoq pings the controller with a 'P' followed by a sequence number, and
+ *  expects [{ID}P{SEQUENCE}] back.
+ */
+#define BT_PING 'P'
+#define BT_CONTROLLER_ID 0x41
+
+/*  Protocol v2, see Packet.h in the videoq. Each message is
+ *
+ *  [LENGTH][TYPE][SEQUENCE][ID][PAYLOAD...][CRC-16 HIGH][CRC-16 LOW]
+ *
+ *  COBS encoded and sent with a 0x00 on either side. The controller starts out
+ *  speaking v1 (bare 'F', 'W' and 'N' in, [{ID}{STATE}] out), and answers the
+ *  videoq's first ping in v2 to let it know it can.
+ */
+#define PACKET_HEADER_LENGTH 4
+#define PACKET_CRC_LENGTH 2
+#define PACKET_PAYLOAD_LIMIT 8
+#define PACKET_ENCODED_LIMIT (PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH + 3)
+
+//  Largest byte a packet can start with. Anything bigger where a packet should start
+//  is v1 from a videoq that has restarted.
+#define PACKET_CODE_LIMIT (PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH + 1)
+
+#define PACKET_STATE 0x01
+#define PACKET_LED 0x02
+#define PACKET_PING 0x03
+#define PACKET_PONG 0x04
+#define PACKET_SENSOR_ERROR 0x05
+
 namespace HoltEnvironments {
 
 namespace PrezenzQ {
@@ -40,14 +64,23 @@ public:
   static void update();
   static void debugUpdate();
   static void sendByteData(byte cmd[4], int len);
+  static void sendState(byte _state);
 
 private:
 
   // static SoftwareSerial HC05;
 
+  static bool speaks_v2;
+  static bool v2_only;
+  static byte send_sequence;
+
   static void evaluateCharacter(unsigned char _byte_read);
-  static void handleCommand(unsigned char _response[]);
+  static void handleCommand(unsigned char _command);
+  static void handlePacket(const byte _encoded[], int _len);
+  static void sendPacket(byte _type, const byte _payload[], int _len);
+  static unsigned int crc(const byte _data[], int _len);
   static void emptyBuffer();
+  static void answerPing(unsigned char _sequence);
 };
 
 } //  HoltEnvironments
@@ -17,6 +17,10 @@ using HoltEnvironments::PrezenzQ::HC05Driver;
 
 SoftwareSerial HC05(BT_RX, BT_TX);
 
+bool HC05Driver::speaks_v2 = false;
+bool HC05Driver::v2_only = false;
+byte HC05Driver::send_sequence = 0;
+
 /**
  * @brief Initializes the bluetooth module, and returns whether the state of
  * the module is in normal mode, or debugging mode.
@@ -63,111 +67,250 @@ void HC05Driver::debugUpdate()
   }
 }
 
-void HC05Driver::handleCommand(unsigned char _response[])
+void HC05Driver::handleCommand(unsigned char _command)
 {
-  static unsigned char command;
-  static unsigned char device_id;
+  if(_command == 70)           // F
+  {
+    LedDriver::setState(LedDriver::State::OFF);
+  }
+  else if(_command == 78)      // N
+  {
+    LedDriver::setState(LedDriver::State::ON);
+  }
+  else if(_command == 87)      // W
+  {
+    LedDriver::setState(LedDriver::State::WAITING);
+  }
+}
 
-  device_id = _response[0];
-  command = _response[1];
+/**
+ * @brief CRC-16/CCITT-FALSE, the same as the videoq's packetCrc().
+ */
+unsigned int HC05Driver::crc(const byte _data[], int _len)
+{
+  unsigned int crc = 0xFFFF;
 
-  for(int i = 0; i < 16; i++)
+  for(int i = 0; i < _len; i++)
   {
-    Serial.print((char)_response[i]);
-  }
-  Serial.println();
+    crc ^= ((unsigned int)_data[i]) << 8;
 
-  if(!isUpperCase(device_id)){
-    Serial.println("Device ID must be an uppercase letter.");
-    return;
+    for(int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
   }
 
-  if(command == 70)           // F
+  return crc & 0xFFFF;
+}
+
+/**
+ * @brief Builds a v2 packet, COBS encodes it and sends it with a 0x00 on either side.
+ */
+void HC05Driver::sendPacket(byte _type, const byte _payload[], int _len)
+{
+  byte raw[PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH];
+  byte encoded[PACKET_ENCODED_LIMIT];
+  int raw_len = 0;
+  int encoded_len = 0;
+
+  raw[raw_len++] = _len;
+  raw[raw_len++] = _type;
+  raw[raw_len++] = send_sequence++;
+  raw[raw_len++] = BT_CONTROLLER_ID;
+
+  for(int i = 0; i < _len; i++)
   {
-    LedDriver::setState(LedDriver::State::OFF);
+    raw[raw_len++] = _payload[i];
   }
-  else if(command == 78)      // N
+
+  unsigned int packet_crc = crc(raw, raw_len);
+  raw[raw_len++] = packet_crc >> 8;
+  raw[raw_len++] = packet_crc & 0xFF;
+
+  encoded[encoded_len++] = 0x00;
+  int code_index = encoded_len++;
+  byte code = 1;
+
+  for(int i = 0; i < raw_len; i++)
   {
-    LedDriver::setState(LedDriver::State::ON);
+    if(raw[i] == 0)
+    {
+      encoded[code_index] = code;
+      code_index = encoded_len++;
+      code = 1;
+    }
+    else
+    {
+      encoded[encoded_len++] = raw[i];
+      code++;
+    }
   }
-  else if(command == 87)      // W
+
+  encoded[code_index] = code;
+  encoded[encoded_len++] = 0x00;
+
+  HC05.write(encoded, encoded_len);
+}
+
+/**
+ * @brief Sends the controller's state, 0x01 when something is detected and 0x00
+ * when not, in whichever protocol the videoq speaks.
+ */
+void HC05Driver::sendState(byte _state)
+{
+  if(speaks_v2)
   {
-    LedDriver::setState(LedDriver::State::WAITING);
+    sendPacket(PACKET_STATE, &_state, 1);
+  } else {
+    byte frame[4] = { R_BRACKET, BT_CONTROLLER_ID, _state, L_BRACKET };
+    HC05.write(frame, 4);
   }
-
-  // switch(command){
-  //   case 0:
-  //     Serial.println("Null command.");
-  //     break;
-  //   case 10:
-  //     Serial.println("command 10 handled");
-  //     break;
-  //   default:
-  //     Serial.println("recieved command that cant be handled");
-  // }
 }
 
-void HC05Driver::evaluateCharacter(unsigned char _byte_read) 
+/**
+ * @brief Echoes a heartbeat ping's sequence number back to the videoq, so that it
+ * can time the round trip and tell a dropped link from an idle controller.
+ * 
+ * @param _sequence The ping's sequence number
+ */
+void HC05Driver::answerPing(unsigned char _sequence)
 {
-  static int current_state;
-  static unsigned char response[16];
-  static unsigned char response_index;
+  if(speaks_v2)
+  {
+    sendPacket(PACKET_PONG, &_sequence, 1);
+  } else {
+    byte pong[5] = { R_BRACKET, BT_CONTROLLER_ID, BT_PING, _sequence, L_BRACKET };
+    HC05.write(pong, 5);
+  }
+}
 
-  Serial.print("char: ");
-  Serial.println((char)_byte_read);
+/**
+ * @brief Undoes the COBS encoding of a received packet and checks its length and
+ * CRC. Anything that doesn't check out is dropped, so a corrupted byte costs one
+ * message rather than a wrong LED state.
+ */
+void HC05Driver::handlePacket(const byte _encoded[], int _len)
+{
+  byte decoded[PACKET_ENCODED_LIMIT];
+  int decoded_len = 0;
+  int i = 0;
 
-  switch(current_state)
+  while(i < _len)
   {
-    case OUT_OF_COMMAND:
-      if(_byte_read == R_BRACKET){
-        current_state = START_COMMAND;
-      }
-      break;
+    byte code = _encoded[i++];
 
-    case START_COMMAND:
-      if(_byte_read == L_BRACKET){
-        current_state = END_COMMAND;
-      }
-      else if(_byte_read == R_BRACKET)
+    for(byte j = 1; j < code; j++)
+    {
+      if(i >= _len)
       {
-        response_index = 0;
+        return;
       }
-      else if(_byte_read != R_BRACKET){
-        response[response_index] = _byte_read;
-        response_index++;
-        current_state = IN_COMMAND;
-      }
-      break;
+      decoded[decoded_len++] = _encoded[i++];
+    }
 
-    case IN_COMMAND:
-      if(_byte_read == R_BRACKET){
-        response_index = 0;
-        current_state = START_COMMAND;
-      } else if (_byte_read == L_BRACKET) {
+    if((code < 0xFF) && (i < _len))
+    {
+      decoded[decoded_len++] = 0;
+    }
+  }
 
-        /*  Fills the rest of the command space with 0
-         */
-        for(int i = response_index; i < 16; i++)
-        {
-          response[i] = 0;
-        }
+  if((decoded_len < PACKET_HEADER_LENGTH + PACKET_CRC_LENGTH)
+    || (decoded[0] != decoded_len - PACKET_HEADER_LENGTH - PACKET_CRC_LENGTH))
+  {
+    Serial.println("Dropped a malformed packet.");
+    return;
+  }
 
-        Serial.println("found something!");
+  int crc_at = decoded_len - PACKET_CRC_LENGTH;
+  unsigned int packet_crc = (((unsigned int)decoded[crc_at]) << 8) | decoded[crc_at + 1];
 
-        handleCommand(response);        
+  if(packet_crc != crc(decoded, crc_at))
+  {
+    Serial.println("Dropped a packet that failed its CRC.");
+    return;
+  }
 
-        response_index = 0;
-        current_state = OUT_OF_COMMAND;
+  speaks_v2 = true;
+  v2_only = true;
 
-      } else if (response_index > 15)
-      {
-        response_index = 0;
-        current_state = OUT_OF_COMMAND;
-      } else {
-        response[response_index] = _byte_read;
-        response_index++;
-      }
-      break;
+  //  ID 0 is for any controller on the link.
+  if(((decoded[3] != 0) && (decoded[3] != BT_CONTROLLER_ID)) || (decoded[0] < 1))
+  {
+    return;
+  }
+
+  if(decoded[1] == PACKET_LED)
+  {
+    handleCommand(decoded[PACKET_HEADER_LENGTH]);
+  }
+  else if(decoded[1] == PACKET_PING)
+  {
+    answerPing(decoded[PACKET_HEADER_LENGTH]);
+  }
+}
+
+/**
+ * @brief Runs one received byte through the receiver. A 0x00 opens a v2 packet and
+ * the next one closes it. Until v2 has been heard, bytes outside of a packet are v1:
+ * a bare LED command, or 'P' followed by a ping's sequence number. A v1 ping is
+ * answered in v2, which is how the videoq finds out this controller speaks it.
+ * Once only v2 is listened for, a byte that can't start a packet where one should
+ * start means the videoq has restarted and speaks v1 again, so everything starts
+ * over as at power up and the byte is taken as v1.
+ */
+void HC05Driver::evaluateCharacter(unsigned char _byte_read) 
+{
+  static byte packet[PACKET_ENCODED_LIMIT];
+  static int packet_len;
+  static bool in_packet;
+  static bool discarding;
+  static bool ping_pending;
+
+  if(_byte_read == 0x00)
+  {
+    if(in_packet && (packet_len > 0))
+    {
+      handlePacket(packet, packet_len);
+      in_packet = v2_only;
+    } else if(in_packet && discarding) {
+      in_packet = v2_only;
+    } else {
+      in_packet = true;
+    }
+
+    packet_len = 0;
+    discarding = false;
+    return;
+  }
+
+  if(v2_only && in_packet && (packet_len == 0) && !discarding && (_byte_read > PACKET_CODE_LIMIT))
+  {
+    speaks_v2 = false;
+    v2_only = false;
+    in_packet = false;
+  }
+
+  if(in_packet)
+  {
+    if(packet_len >= PACKET_ENCODED_LIMIT)
+    {
+      packet_len = 0;
+      discarding = true;
+    } else if(!discarding) {
+      packet[packet_len++] = _byte_read;
+    }
+    return;
+  }
+
+  if(ping_pending)
+  {
+    ping_pending = false;
+    speaks_v2 = true;
+    answerPing(_byte_read);
+  } else if(_byte_read == BT_PING) {
+    ping_pending = true;
+  } else {
+    handleCommand(_byte_read);
   }
 }
 
@@ -12,14 +12,12 @@ using HoltEnvironments::PrezenzQ::HC05Driver;
 
 void onDetected() {
   Serial.println("detected!");
-  byte cmd[4] = { '[', 0x41, 0x01, ']' };
-  HC05Driver::sendByteData(cmd, 4);
+  HC05Driver::sendState(0x01);
 }
 
 void onNotDetected() {
   Serial.println("not detected!");
-  byte cmd[4] = { '[', 0x41, 0x00, ']' };
-  HC05Driver::sendByteData(cmd, 4);
+  HC05Driver::sendState(0x00);
 }
 
 void testLedTransition() {
@@ -0,0 +1,98 @@
+
+//	Measures the CPU compositor on a 1920x1120 frame, the size of the installation's
+//	output, for every blend kernel this machine supports. Use it to size a player PC
+//	before running the show with "renderer": "cpu".
+//
+//	Usage: CompositorBench [frames] [channels]
+//		frames		Frames blended per kernel, default 300.
+//		channels	Bytes per pixel, 3 for RGB (default) or 4 for RGBA.
+
+#include "../src/CpuCompositor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1120
+
+int main(int argc, char* argv[])
+{
+	int frames = (argc > 1) ? atoi(argv[1]) : 300;
+	int channels = (argc > 2) ? atoi(argv[2]) : 3;
+
+	if ((frames <= 0) || (channels <= 0))
+	{
+		std::cout << "Usage: CompositorBench [frames] [channels]" << std::endl;
+		return 1;
+	}
+
+	size_t length = (size_t)BENCH_WIDTH * BENCH_HEIGHT * channels;
+	std::vector<uint8_t> background(length);
+	std::vector<uint8_t> overlay(length);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		background[i] = (uint8_t)(i * 7);
+		overlay[i] = (uint8_t)(255 - i * 13);
+	}
+
+	//	Every kernel has to produce exactly what the scalar one does.
+	CpuCompositor reference;
+	reference.setup(BENCH_WIDTH, BENCH_HEIGHT, channels);
+	reference.setKernel(CompositorKernel::Scalar);
+
+	std::cout << "Compositing " << BENCH_WIDTH << "x" << BENCH_HEIGHT << " frames, " << channels << " bytes per pixel, " << frames << " frames per kernel." << std::endl;
+	std::cout << "Fastest kernel on this machine: " << compositorKernelName(detectCompositorKernel()) << std::endl;
+
+	const CompositorKernel kernels[] = { CompositorKernel::Scalar, CompositorKernel::SSE2, CompositorKernel::AVX2, CompositorKernel::NEON };
+	int failures = 0;
+
+	for (auto kernel : kernels)
+	{
+		if (!isCompositorKernelSupported(kernel))
+		{
+			continue;
+		}
+
+		CpuCompositor compositor;
+		compositor.setup(BENCH_WIDTH, BENCH_HEIGHT, channels);
+		compositor.setKernel(kernel);
+
+		//	Opacity sweeps through a fade so the copy-only ends are not what gets timed.
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++)
+		{
+			float opacity = (float)((i % 254) + 1) / 256.0f;
+			compositor.compose(background.data(), overlay.data(), opacity);
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+		double frame_ms = total_ms / frames;
+
+		bool matches = true;
+		const float check_opacities[] = { 0.0f, 0.1f, 0.5f, 0.9f, 1.0f };
+		for (float opacity : check_opacities)
+		{
+			compositor.compose(background.data(), overlay.data(), opacity);
+			reference.compose(background.data(), overlay.data(), opacity);
+			matches = matches && std::equal(compositor.getFrame(), compositor.getFrame() + length, reference.getFrame());
+		}
+
+		if (!matches)
+		{
+			failures++;
+		}
+
+		std::cout << std::left << std::setw(8) << compositorKernelName(kernel)
+			<< std::right << std::fixed << std::setprecision(3) << std::setw(9) << frame_ms << " ms/frame"
+			<< std::setprecision(1) << std::setw(9) << (1000.0 / frame_ms) << " fps"
+			<< (matches ? "" : "  MISMATCH against scalar") << std::endl;
+	}
+
+	return (failures == 0) ? 0 : 1;
+}
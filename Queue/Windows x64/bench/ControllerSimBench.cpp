@@ -0,0 +1,284 @@
+
+//	Simulates a room of v2 controllers on the network, so a whole installation can be run
+//	on one machine over loopback, with no hardware. Point the app's sensors at a
+//	"transport" address, start the app, then this. Each controller triggers in turn,
+//	answers the app's heartbeat pings, and times how long the app takes to send it an
+//	LED command after it triggers.
+//
+//	Usage: ControllerSimBench <address> <ids> [seconds] [trigger_ms]
+//		address		The app's "transport", e.g. udp://127.0.0.1:9000. Give 127.0.0.1
+//					rather than the 0.0.0.0 the app may listen on.
+//		ids			The controllers' SENSOR_IDs, the sensors' keys, e.g. ABCD.
+//		seconds		How long to run, default 30.
+//		trigger_ms	How long each controller waits between triggers, default 2000.
+//
+//	Over UDP each controller has a socket of its own, as separate boards would. Over TCP
+//	they all share one connection, as behind a bridge. Exits non-zero if a controller
+//	never heard from the app.
+
+#include "../src/Packet.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+#define closeSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct SimController
+{
+	unsigned char id = 0;
+	socket_t socket = INVALID_SOCKET;
+	uint8_t sequence = 0;
+	uint64_t next_trigger_us = 0;
+	uint64_t release_us = 0;
+	uint64_t triggered_us = 0;
+	unsigned long triggers = 0;
+	unsigned long leds = 0;
+	unsigned long pongs = 0;
+};
+
+static uint64_t nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage()
+{
+	std::cout << "Usage: ControllerSimBench <address> <ids> [seconds] [trigger_ms]" << std::endl;
+}
+
+static socket_t openSocket(bool _tcp, const sockaddr_in& _app)
+{
+	socket_t s = socket(AF_INET, _tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+	if (s == INVALID_SOCKET)
+	{
+		return INVALID_SOCKET;
+	}
+
+	//	A connected UDP socket only hears from the app, and can use send() like TCP.
+	if (connect(s, (const sockaddr*)&_app, sizeof(_app)) != 0)
+	{
+		closeSocket(s);
+		return INVALID_SOCKET;
+	}
+
+	if (_tcp)
+	{
+		int no_delay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+	}
+
+#ifdef _WIN32
+	u_long non_blocking = 1;
+	ioctlsocket(s, FIONBIO, &non_blocking);
+#else
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	return s;
+}
+
+static void sendPacket(SimController& _controller, socket_t _socket, uint8_t _type, unsigned char _value)
+{
+	Packet packet;
+	packet.type = _type;
+	packet.sequence = _controller.sequence++;
+	packet.id = _controller.id;
+	packet.payload = &_value;
+	packet.length = 1;
+
+	unsigned char out[PACKET_ENCODED_LIMIT];
+	size_t length = encodePacket(packet, out);
+	send(_socket, (const char*)out, (int)length, 0);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		usage();
+		return 1;
+	}
+
+	std::string address = argv[1];
+	std::string ids = argv[2];
+	double seconds = (argc > 3) ? atof(argv[3]) : 30.0;
+	int trigger_ms = (argc > 4) ? atoi(argv[4]) : 2000;
+
+	bool tcp = (address.compare(0, 6, "tcp://") == 0);
+	size_t colon = address.rfind(':');
+
+	if ((!tcp && (address.compare(0, 6, "udp://") != 0)) || (colon == std::string::npos) || (colon < 6) || ids.empty() || (seconds <= 0) || (trigger_ms <= 0))
+	{
+		usage();
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+	WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+	sockaddr_in app;
+	memset(&app, 0, sizeof(app));
+	app.sin_family = AF_INET;
+	app.sin_port = htons((unsigned short)atoi(address.substr(colon + 1).c_str()));
+
+	if (inet_pton(AF_INET, address.substr(6, colon - 6).c_str(), &app.sin_addr) != 1)
+	{
+		usage();
+		return 1;
+	}
+
+	std::vector<SimController> controllers(ids.size());
+	std::vector<PacketParser> parsers(tcp ? 1 : ids.size());
+	uint64_t start_us = nowMicros();
+
+	for (size_t i = 0; i < controllers.size(); i++)
+	{
+		controllers[i].id = (unsigned char)ids[i];
+		controllers[i].socket = (tcp && (i > 0)) ? controllers[0].socket : openSocket(tcp, app);
+
+		//	Spread out, so the app sees the queue fill one station at a time.
+		controllers[i].next_trigger_us = start_us + 500000 + (uint64_t)i * trigger_ms * 1000 / controllers.size();
+
+		if (controllers[i].socket == INVALID_SOCKET)
+		{
+			std::cout << "Could not reach " << address << "." << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<uint32_t> latencies;
+	uint64_t end_us = start_us + (uint64_t)(seconds * 1000000.0);
+	unsigned char buffer[1024];
+
+	while (nowMicros() < end_us)
+	{
+		uint64_t now = nowMicros();
+
+		//	A trigger is held for 100 ms, as a visitor passing the sensor would.
+		for (auto& controller : controllers)
+		{
+			if (now >= controller.next_trigger_us)
+			{
+				sendPacket(controller, controller.socket, PACKET_STATE, 0x01);
+				controller.triggered_us = now;
+				controller.release_us = now + 100000;
+				controller.next_trigger_us = now + (uint64_t)trigger_ms * 1000;
+				controller.triggers++;
+			}
+
+			if ((controller.release_us != 0) && (now >= controller.release_us))
+			{
+				sendPacket(controller, controller.socket, PACKET_STATE, 0x00);
+				controller.release_us = 0;
+			}
+		}
+
+		fd_set readable;
+		FD_ZERO(&readable);
+		socket_t highest = 0;
+
+		for (size_t i = 0; i < parsers.size(); i++)
+		{
+			FD_SET(controllers[i].socket, &readable);
+			highest = std::max(highest, controllers[i].socket);
+		}
+
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 1000;
+		select((int)highest + 1, &readable, NULL, NULL, &timeout);
+
+		for (size_t i = 0; i < parsers.size(); i++)
+		{
+			socket_t s = controllers[i].socket;
+			int received;
+
+			while ((received = (int)recv(s, (char*)buffer, sizeof(buffer), 0)) > 0)
+			{
+				parsers[i].feed(buffer, (size_t)received, [&](const Packet& _packet) {
+					for (auto& controller : controllers)
+					{
+						if ((controller.id != _packet.id) || (controller.socket != s) || (_packet.length < 1))
+						{
+							continue;
+						}
+
+						if (_packet.type == PACKET_PING)
+						{
+							sendPacket(controller, s, PACKET_PONG, _packet.payload[0]);
+							controller.pongs++;
+						}
+						else if (_packet.type == PACKET_LED)
+						{
+							controller.leds++;
+
+							//	Only the first LED command after a trigger is the app's answer to it.
+							if (controller.triggered_us != 0)
+							{
+								latencies.push_back((uint32_t)(nowMicros() - controller.triggered_us));
+								controller.triggered_us = 0;
+							}
+						}
+					}
+				});
+			}
+		}
+	}
+
+	unsigned long silent = 0;
+	for (auto& controller : controllers)
+	{
+		std::cout << controller.id << ": " << controller.triggers << " triggers, " << controller.leds << " LED commands, "
+			<< controller.pongs << " pings answered" << std::endl;
+
+		if ((controller.leds == 0) && (controller.pongs == 0))
+		{
+			silent++;
+		}
+	}
+
+	for (size_t i = 0; i < parsers.size(); i++)
+	{
+		closeSocket(controllers[i].socket);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	if (!latencies.empty())
+	{
+		std::cout << std::fixed << std::setprecision(2);
+		std::cout << "Trigger to LED command over " << latencies.size() << " triggers: median "
+			<< latencies[latencies.size() / 2] / 1000.0 << " ms, 99th percentile "
+			<< latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)] / 1000.0 << " ms, worst "
+			<< latencies.back() / 1000.0 << " ms" << std::endl;
+	}
+
+	return (silent == 0) ? 0 : 1;
+}
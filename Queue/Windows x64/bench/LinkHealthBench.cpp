@@ -0,0 +1,136 @@
+
+//	Drives a gateway's heartbeat round by round in simulated time, with no port, and
+//	checks when it declares the shared port dead as its controllers stop answering. Each
+//	scenario gives the round each controller answers its last ping on, -1 for one that
+//	never stops. Exits non-zero if any scenario is declared dead too late, too early, or
+//	not at all.
+//
+//	Usage: LinkHealthBench [misses]
+//		misses		Pings in a row a controller may miss, default 3.
+
+#include "../src/InteractiveDevice.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct LinkScenario
+{
+	const char* name;
+	std::vector<int> last_answer;
+	bool never_answers_last;
+};
+
+//	Returns the round the gateway returned 0 on, or -1 if it never did.
+static int runScenario(const LinkScenario& _scenario, int _misses, int _rounds)
+{
+	InteractiveDevice gateway;
+	gateway.setHeartbeat(100, _misses);
+	gateway.setup("bench", 9600, "", false);
+
+	size_t count = _scenario.last_answer.size() + (_scenario.never_answers_last ? 1 : 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		InteractiveDevice* station = new InteractiveDevice();
+		station->id = (unsigned char)('A' + i);
+		station->setHeartbeat(100, _misses);
+		station->setup("bench", 9600, "bench", false);
+		gateway.addStation(station);
+	}
+
+	gateway.setConnected(true);
+
+	std::vector<unsigned char> out(gateway.getMessageLimit());
+	uint8_t sequence = 0;
+
+	for (int round = 0; round < _rounds; round++)
+	{
+		size_t length = gateway.nextHeartbeat(out.data());
+		if (length == 0)
+		{
+			return round;
+		}
+
+		//	Each controller still alive answers its ping straight away.
+		PacketParser pings;
+		pings.feed(out.data(), length, [&](const Packet& _packet) {
+			size_t i = (size_t)(_packet.id - 'A');
+
+			if ((_packet.type != PACKET_PING) || (i >= _scenario.last_answer.size()) || (_packet.length < 1))
+			{
+				return;
+			}
+
+			if ((_scenario.last_answer[i] >= 0) && (round > _scenario.last_answer[i]))
+			{
+				return;
+			}
+
+			unsigned char payload = _packet.payload[0];
+			Packet pong = { PACKET_PONG, sequence++, _packet.id, &payload, 1 };
+			unsigned char encoded[PACKET_ENCODED_LIMIT];
+			gateway.receiveBytes(encoded, encodePacket(pong, encoded));
+		});
+	}
+
+	return -1;
+}
+
+int main(int argc, char* argv[])
+{
+	int misses = (argc > 1) ? atoi(argv[1]) : 3;
+
+	if (misses < 1)
+	{
+		std::cout << "Usage: LinkHealthBench [misses]" << std::endl;
+		return 1;
+	}
+
+	std::vector<LinkScenario> scenarios = {
+		{ "all answering", { -1, -1, -1 }, false },
+		{ "one of three silent", { 2, -1, -1 }, false },
+		{ "all silent together", { 2, 2, 2 }, false },
+		{ "silent one round apart", { 2, 3 }, false },
+		{ "silent two rounds apart", { 2, 4 }, false },
+		{ "silent out of phase, three stations", { 2, 3, 6 }, false },
+		{ "silent apart, with one that never answered", { 2, 3 }, true }
+	};
+
+	int rounds = 20 * (misses + 1);
+	unsigned long failed = 0;
+
+	for (auto& scenario : scenarios)
+	{
+		//	The port is dead the round after the last controller to stop answering has
+		//	missed its last allowed ping, and never while any controller still answers.
+		int expected = 0;
+		bool survivor = false;
+
+		for (int last : scenario.last_answer)
+		{
+			survivor = survivor || (last < 0);
+			expected = std::max(expected, last + misses + 1);
+		}
+
+		if (survivor)
+		{
+			expected = -1;
+		}
+
+		int dead = runScenario(scenario, misses, rounds);
+		bool ok = (dead == expected);
+
+		std::cout << scenario.name << ": " << ((dead < 0) ? std::string("never declared dead") : "declared dead on round " + std::to_string(dead))
+			<< (ok ? "" : " - expected " + ((expected < 0) ? std::string("never") : std::to_string(expected))) << std::endl;
+
+		if (!ok)
+		{
+			failed++;
+		}
+	}
+
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,280 @@
+
+//	Runs QueueCore against hundreds of virtual controllers in simulated time, with no
+//	hardware, openFrameworks or video decoding involved. Reports how many queue
+//	operations per second the core sustains, the latency from a controller being
+//	triggered to its LED command being sent, and whether every fade and LED command was
+//	correct. Exits non-zero if any check failed, so it can gate CI.
+//
+//	Usage: QueueSimBench [stations] [toggles_per_minute] [seconds] [clip_seconds] [fade_seconds] [fps] [transition]
+//		stations			Virtual controllers, default 200.
+//		toggles_per_minute	How often each controller is triggered or released, default 2.
+//		seconds				Simulated time, default 600.
+//		clip_seconds		Length of every station's clip, default 8.
+//		fade_seconds		Fade in and fade out length, default 0.25.
+//		fps					Ticks per simulated second, default 60.
+//		transition			"fade" through the background, the default, or "crossfade".
+
+#include "SimQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Toggle
+{
+	uint64_t at_us;
+	SimStation* station;
+	bool operator>(const Toggle& _other) const { return at_us > _other.at_us; }
+};
+
+static double percentileMs(const std::vector<uint32_t>& _sorted, double _percentile)
+{
+	if (_sorted.empty())
+	{
+		return 0;
+	}
+
+	size_t index = std::min(_sorted.size() - 1, (size_t)(_percentile / 100.0 * _sorted.size()));
+	return _sorted[index] / 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+	int station_count = (argc > 1) ? atoi(argv[1]) : 200;
+	double toggles_per_minute = (argc > 2) ? atof(argv[2]) : 2;
+	double seconds = (argc > 3) ? atof(argv[3]) : 600;
+	float clip_seconds = (argc > 4) ? (float)atof(argv[4]) : 8.0f;
+	float fade_seconds = (argc > 5) ? (float)atof(argv[5]) : 0.25f;
+	int fps = (argc > 6) ? atoi(argv[6]) : 60;
+	std::string transition = (argc > 7) ? argv[7] : "fade";
+
+	if ((station_count <= 0) || (toggles_per_minute <= 0) || (seconds <= 0) || (clip_seconds <= 0) || (fade_seconds < 0) || (fps <= 0)
+		|| ((transition != "fade") && (transition != "crossfade")))
+	{
+		std::cout << "Usage: QueueSimBench [stations] [toggles_per_minute] [seconds] [clip_seconds] [fade_seconds] [fps] [transition]" << std::endl;
+		return 1;
+	}
+
+	SimClock clock;
+	SimPlayer player;
+	player.clock = &clock;
+	player.clip_seconds = clip_seconds;
+
+	QueueCore core;
+	core.setup(&player, &clock);
+	core.setFadeSeconds(fade_seconds);
+	core.setTransition((transition == "crossfade") ? OverlayTransition::Crossfade : OverlayTransition::Fade);
+
+	std::vector<uint32_t> latencies;
+	std::vector<SimStation> stations(station_count);
+
+	std::mt19937 random(12345);
+	std::exponential_distribution<double> next_toggle_s(toggles_per_minute / 60.0);
+	std::priority_queue<Toggle, std::vector<Toggle>, std::greater<Toggle>> toggles;
+
+	for (auto& station : stations)
+	{
+		station.clock = &clock;
+		station.latencies = &latencies;
+		toggles.push({ (uint64_t)(next_toggle_s(random) * 1000000.0), &station });
+	}
+
+	uint64_t tick_us = 1000000 / fps;
+	uint64_t end_us = (uint64_t)(seconds * 1000000.0);
+	double tick_s = 1.0 / fps;
+
+	unsigned long state_changes = 0;
+	unsigned long ticks = 0;
+	double core_seconds = 0;
+
+	unsigned long overlays_started = 0;
+	unsigned long overlays_finished = 0;
+	unsigned long crossfades = 0;
+	unsigned long background_ticks = 0;
+	unsigned long suspended_ticks = 0;
+	unsigned long fade_checks = 0;
+	unsigned long fade_violations = 0;
+	unsigned long led_violations = 0;
+
+	QueueStation* last_overlay = NULL;
+	OverlayPhase last_phase = OverlayPhase::Idle;
+	float last_opacity = 0;
+	uint64_t fade_out_began_us = 0;
+
+	std::vector<SimStation*> due;
+
+	while (clock.now_us < end_us)
+	{
+		clock.now_us += tick_us;
+
+		//	Toggles that happened since the last tick are delivered together, as the app
+		//	drains device events once per frame.
+		due.clear();
+		while (!toggles.empty() && (toggles.top().at_us <= clock.now_us))
+		{
+			Toggle toggle = toggles.top();
+			toggles.pop();
+
+			toggle.station->triggered = !toggle.station->triggered;
+			toggle.station->toggled_us = toggle.at_us;
+			due.push_back(toggle.station);
+
+			toggles.push({ toggle.at_us + (uint64_t)(next_toggle_s(random) * 1000000.0), toggle.station });
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (auto station : due)
+		{
+			bool queued = core.getQueue().contains(station);
+			station->awaiting_command = (queued != station->triggered);
+			core.setStationState(station, station->triggered);
+		}
+
+		//	LED commands go out at the end of update(), one per station whose LED changed.
+		const OverlaySnapshot& snapshot = core.update();
+
+		for (auto station : due)
+		{
+			station->awaiting_command = false;
+		}
+
+		core_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		state_changes += due.size();
+		ticks++;
+
+		//	Fade checks: opacity stays in range, follows media time during the fade in,
+		//	is fully opaque while playing, only falls during the fade out, and each fade
+		//	lasts the configured time to within a tick. With no fade, the fade out begins and
+		//	ends in the same tick as the phase before it. A crossfade only starts from an
+		//	overlay that has finished fading in, at the latest in the same tick, and that
+		//	overlay stays on screen until the fade in over it is done.
+		QueueStation* overlay = core.getOverlayStation();
+		bool fade_ok = (snapshot.opacity >= 0) && (snapshot.opacity <= 1);
+
+		if ((overlay != NULL) && (overlay != last_overlay))
+		{
+			overlays_started++;
+			fade_ok = fade_ok && (overlay == core.getQueue().head()) && (snapshot.phase == OverlayPhase::FadingIn);
+
+			if (snapshot.crossfading)
+			{
+				crossfades++;
+				fade_ok = fade_ok && ((last_phase == OverlayPhase::Playing) || (last_phase == OverlayPhase::FadingIn)) && (core.getOutgoingStation() == last_overlay);
+			}
+		}
+
+		fade_ok = fade_ok && (snapshot.crossfading == (core.getOutgoingStation() != NULL));
+		fade_ok = fade_ok && (!snapshot.crossfading || (snapshot.phase == OverlayPhase::FadingIn));
+
+		//	Ticks in which some of the background shows while a station waits its turn.
+		if (!core.getQueue().empty() && !snapshot.covers_background())
+		{
+			background_ticks++;
+		}
+
+		//	Ticks in which the app would have the background suspended.
+		if (snapshot.covers_background() && !snapshot.background_due)
+		{
+			suspended_ticks++;
+		}
+
+		switch (snapshot.phase)
+		{
+		case OverlayPhase::FadingIn:
+			fade_ok = fade_ok && (std::fabs(snapshot.opacity - ((fade_seconds > 0) ? std::min(1.0f, snapshot.media_time / fade_seconds) : 1.0f)) < 0.001f);
+			break;
+
+		case OverlayPhase::Playing:
+			fade_ok = fade_ok && (snapshot.opacity == 1.0f);
+
+			if (last_phase == OverlayPhase::FadingIn)
+			{
+				fade_ok = fade_ok && (snapshot.media_time >= fade_seconds) && (snapshot.media_time < fade_seconds + 2 * tick_s);
+			}
+			break;
+
+		case OverlayPhase::FadingOut:
+			if (last_phase != OverlayPhase::FadingOut)
+			{
+				fade_out_began_us = clock.now_us;
+			}
+			else
+			{
+				fade_ok = fade_ok && (snapshot.opacity <= last_opacity);
+			}
+			break;
+
+		case OverlayPhase::Idle:
+			break;
+		}
+
+		if (snapshot.finished)
+		{
+			overlays_finished++;
+			bool cut = (fade_seconds == 0) && (last_phase != OverlayPhase::FadingOut);
+			double fade_out_s = cut ? 0 : (clock.now_us - fade_out_began_us) / 1000000.0;
+			fade_ok = fade_ok && ((last_phase == OverlayPhase::FadingOut) || cut) && (fade_out_s <= fade_seconds + 2 * tick_s);
+		}
+
+		fade_checks++;
+		if (!fade_ok)
+		{
+			fade_violations++;
+		}
+
+		last_overlay = overlay;
+		last_phase = snapshot.phase;
+		last_opacity = snapshot.opacity;
+
+		//	LED checks: the head of the queue shows 'N', the rest of the queue 'W', and a
+		//	station that has left the queue 'F'.
+		for (auto& station : stations)
+		{
+			char expected = 'F';
+
+			if (core.getQueue().contains(&station))
+			{
+				expected = (core.getQueue().head() == &station) ? 'N' : 'W';
+			}
+
+			if ((station.last_command != 0) && (station.last_command != expected))
+			{
+				led_violations++;
+			}
+		}
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	double latency_sum_ms = 0;
+	for (auto latency : latencies)
+	{
+		latency_sum_ms += latency / 1000.0;
+	}
+
+	unsigned long operations = state_changes + ticks;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Simulated " << station_count << " stations for " << seconds << " s at " << fps << " ticks/s, "
+		<< toggles_per_minute << " toggles per station per minute, " << clip_seconds << " s clips, " << fade_seconds << " s fades, " << transition << " transitions." << std::endl;
+	std::cout << "Queue operations: " << state_changes << " state changes + " << ticks << " ticks in " << (core_seconds * 1000.0)
+		<< " ms = " << std::setprecision(0) << (operations / std::max(core_seconds, 1e-9)) << " ops/s" << std::setprecision(2) << std::endl;
+	std::cout << "Event to LED command latency (simulated): mean " << (latencies.empty() ? 0 : latency_sum_ms / latencies.size())
+		<< " ms, p50 " << percentileMs(latencies, 50) << " ms, p99 " << percentileMs(latencies, 99)
+		<< " ms, max " << percentileMs(latencies, 100) << " ms over " << latencies.size() << " commands" << std::endl;
+	std::cout << "Overlays: " << overlays_started << " started, " << overlays_finished << " finished, " << crossfades << " crossfaded into, " << core.getQueue().size() << " stations still queued" << std::endl;
+	std::cout << "Throughput: " << std::setprecision(0) << (overlays_started * 3600.0 / seconds) << " clips per hour, background showing with stations queued for "
+		<< std::setprecision(2) << (background_ticks * tick_s) << " s" << std::endl;
+	std::cout << "Background suspended for " << (suspended_ticks * 100.0 / std::max(ticks, 1UL)) << "% of ticks" << std::endl;
+	std::cout << "Fade checks: " << fade_violations << " violations in " << fade_checks << " ticks" << std::endl;
+	std::cout << "LED checks: " << led_violations << " violations" << std::endl;
+
+	return ((fade_violations == 0) && (led_violations == 0)) ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+//	Simulated stand-ins for the app's clock, controllers and video players, shared by
+//	the benchmarks that run QueueCore without hardware.
+
+#include "../src/QueueCore.h"
+
+#include <algorithm>
+#include <vector>
+
+//	How long the simulated decoder takes to open a clip once its station is queued.
+#define SIM_OPEN_DELAY_US 50000
+
+class SimClock : public QueueClock
+{
+public:
+	uint64_t now_us = 0;
+	uint64_t nowMicros() override { return now_us; }
+};
+
+class SimStation : public QueueStation, public QueueTransport
+{
+public:
+	SimClock* clock = NULL;
+	bool triggered = false;
+	char last_command = 0;
+	uint64_t opened_us = 0;
+
+	//	Set when a toggle is delivered that should produce an LED command, so the
+	//	latency can be taken when it is sent.
+	bool awaiting_command = false;
+	uint64_t toggled_us = 0;
+	std::vector<uint32_t>* latencies = NULL;
+
+	SimStation() { transport = this; }
+
+	void sendCommand(char _command) override
+	{
+		last_command = _command;
+
+		if (awaiting_command)
+		{
+			latencies->push_back((uint32_t)(clock->now_us - toggled_us));
+			awaiting_command = false;
+		}
+	}
+};
+
+class SimPlayer : public QueuePlayer
+{
+public:
+	SimClock* clock = NULL;
+	float clip_seconds = 8;
+	uint64_t started_us = 0;
+
+	void onQueued(QueueStation* _station) override
+	{
+		static_cast<SimStation*>(_station)->opened_us = clock->now_us + SIM_OPEN_DELAY_US;
+	}
+
+	bool isReady(QueueStation* _station) override
+	{
+		return clock->now_us >= static_cast<SimStation*>(_station)->opened_us;
+	}
+
+	void start(QueueStation*) override { started_us = clock->now_us; }
+	void stop(QueueStation*) override {}
+
+	float getPosition() override
+	{
+		double elapsed = (clock->now_us - started_us) / 1000000.0;
+		return (float)std::min(1.0, elapsed / clip_seconds);
+	}
+
+	float getDuration() override { return clip_seconds; }
+};
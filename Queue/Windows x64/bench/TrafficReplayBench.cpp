@@ -0,0 +1,193 @@
+
+//	Replays a traffic log recorded with --record through the frame parser and the queue
+//	core as fast as the CPU allows, in simulated time, with no hardware, openFrameworks
+//	or video decoding involved. Reports how much faster than real time the session
+//	replays, and compares the LED commands the queue sends for each controller against
+//	the ones recorded on site. Exits non-zero if they differ.
+//
+//	Usage: TrafficReplayBench <log> [clip_seconds] [fade_seconds] [fps]
+//		log				File written by ofVideoQueue --record.
+//		clip_seconds	Length of every station's clip, default 8.
+//		fade_seconds	Fade in and fade out length, default 0.25.
+//		fps				Ticks per simulated second, default 60.
+//
+//	Clip lengths only come from the recording's timing indirectly, so with the default
+//	clip length a mismatch usually means the site's clips were a different length
+//	rather than a queue bug. Pass the real clip length when comparing.
+
+#include "SimQueue.h"
+#include "../src/FrameParser.h"
+#include "../src/Packet.h"
+#include "../src/TrafficLog.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct ReplayStation : public SimStation
+{
+	FrameParser parser;
+	PacketParser packet_parser;
+	LedCommandScanner scanner;
+	bool speaks_v2 = false;
+	unsigned char id = 0;
+	std::vector<char> sent;
+	std::vector<char> recorded;
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: TrafficReplayBench <log> [clip_seconds] [fade_seconds] [fps]" << std::endl;
+		return 1;
+	}
+
+	float clip_seconds = (argc > 2) ? (float)atof(argv[2]) : 8.0f;
+	float fade_seconds = (argc > 3) ? (float)atof(argv[3]) : 0.25f;
+	int fps = (argc > 4) ? atoi(argv[4]) : 60;
+
+	TrafficLogReader reader;
+	if (!reader.open(argv[1]))
+	{
+		std::cout << argv[1] << " is not a traffic log." << std::endl;
+		return 1;
+	}
+
+	if ((clip_seconds <= 0) || (fade_seconds < 0) || (fps <= 0))
+	{
+		std::cout << "Usage: TrafficReplayBench <log> [clip_seconds] [fade_seconds] [fps]" << std::endl;
+		return 1;
+	}
+
+	SimClock clock;
+	SimPlayer player;
+	player.clock = &clock;
+	player.clip_seconds = clip_seconds;
+
+	QueueCore core;
+	core.setup(&player, &clock);
+	core.setFadeSeconds(fade_seconds);
+
+	std::vector<uint32_t> latencies;
+	std::vector<ReplayStation> stations(reader.getDevices().size());
+
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		stations[i].clock = &clock;
+		stations[i].latencies = &latencies;
+		stations[i].id = reader.getDevices()[i].id;
+	}
+
+	//	SimStation only keeps the last command, so they are collected after every call
+	//	into the core.
+	auto collect = [&stations]() {
+		for (auto& station : stations)
+		{
+			if (station.last_command != 0)
+			{
+				station.sent.push_back(station.last_command);
+				station.last_command = 0;
+			}
+		}
+	};
+
+	uint64_t tick_us = 1000000 / fps;
+	unsigned long records = 0;
+	unsigned long ticks = 0;
+
+	auto start = std::chrono::steady_clock::now();
+
+	TrafficRecord record;
+	while (reader.next(record))
+	{
+		if (record.device >= stations.size())
+		{
+			continue;
+		}
+
+		ReplayStation& station = stations[record.device];
+		records++;
+
+		if (record.direction == TRAFFIC_OUTBOUND)
+		{
+			station.scanner.feed(record.data.data(), record.data.size(), [&](char _command) {
+				station.recorded.push_back(_command);
+			});
+			continue;
+		}
+
+		//	Frames are applied on the first tick at or after they arrived, as the app
+		//	drains device events once per frame.
+		while (clock.now_us < record.time_us)
+		{
+			clock.now_us += tick_us;
+			core.update();
+			collect();
+			ticks++;
+		}
+
+		//	Parsed as InteractiveDevice::receiveBytes() does, v1 until the first v2 packet.
+		if (!station.speaks_v2)
+		{
+			station.parser.feed(record.data.data(), record.data.size(), [&](const Frame& _frame) {
+				if (((station.id == 0) || (_frame.id == station.id)) && (_frame.length > 0) && !isPongFrame(_frame))
+				{
+					core.setStationState(&station, _frame.payload[0] != 0);
+				}
+			});
+		}
+
+		station.packet_parser.feed(record.data.data(), record.data.size(), [&](const Packet& _packet) {
+			if ((station.id == 0) || (_packet.id == station.id))
+			{
+				station.speaks_v2 = true;
+
+				if ((_packet.type == PACKET_STATE) && (_packet.length > 0))
+				{
+					core.setStationState(&station, _packet.payload[0] != 0);
+				}
+			}
+		});
+
+		collect();
+	}
+
+	//	Let the last overlay play out.
+	uint64_t end_us = clock.now_us + (uint64_t)((clip_seconds + fade_seconds) * 1000000.0);
+	while (clock.now_us < end_us)
+	{
+		clock.now_us += tick_us;
+		core.update();
+		collect();
+		ticks++;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	double recorded_seconds = clock.now_us / 1000000.0;
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Replayed " << records << " records and " << ticks << " ticks covering " << recorded_seconds << " s in "
+		<< (seconds * 1000.0) << " ms (" << std::setprecision(0) << (recorded_seconds / std::max(seconds, 1e-9)) << "x real time)" << std::endl;
+
+	unsigned long mismatched = 0;
+	for (size_t i = 0; i < stations.size(); i++)
+	{
+		const ReplayStation& station = stations[i];
+		bool match = (station.sent == station.recorded);
+
+		std::cout << reader.getDevices()[i].port << ": " << station.parser.frameCount() << " frames, "
+			<< station.sent.size() << " LED commands sent, " << station.recorded.size() << " recorded"
+			<< (match ? "" : " - MISMATCH") << std::endl;
+
+		if (!match)
+		{
+			mismatched++;
+		}
+	}
+
+	return (mismatched == 0) ? 0 : 1;
+}
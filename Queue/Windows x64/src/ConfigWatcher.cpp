@@ -0,0 +1,206 @@
+
+#include "ConfigWatcher.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+ConfigWatcher::ConfigWatcher()
+	: running(false), inotify_fd(-1), changed(false), last_modified(0)
+{
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+	stop();
+}
+
+bool ConfigWatcher::start(const std::string& _path)
+{
+	if (running)
+	{
+		return true;
+	}
+
+	path = _path;
+
+	if (!readFile(last_contents))
+	{
+		return false;
+	}
+
+	last_modified = modifiedTime();
+
+#ifdef __linux__
+	//	The directory is watched rather than the file, as an editor that saves by renaming
+	//	a new file over the old one would leave a watch on the file itself pointing at the
+	//	old one.
+	size_t slash = path.find_last_of('/');
+	std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ((inotify_fd < 0) || (inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0))
+	{
+		if (inotify_fd >= 0)
+		{
+			close(inotify_fd);
+			inotify_fd = -1;
+		}
+		return false;
+	}
+#endif
+
+	running = true;
+	thread = std::thread(&ConfigWatcher::watchLoop, this);
+	return true;
+}
+
+void ConfigWatcher::stop()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	running = false;
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+#ifdef __linux__
+	close(inotify_fd);
+	inotify_fd = -1;
+#endif
+}
+
+bool ConfigWatcher::takeChange(std::string& _contents)
+{
+	std::unique_lock<std::mutex> lock(changed_mutex, std::try_to_lock);
+
+	if (!lock.owns_lock() || !changed)
+	{
+		return false;
+	}
+
+	_contents.swap(changed_contents);
+	changed_contents.clear();
+	changed = false;
+	return true;
+}
+
+bool ConfigWatcher::readFile(std::string& _contents) const
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::stringstream contents;
+	contents << file.rdbuf();
+	_contents = contents.str();
+	return true;
+}
+
+/**
+ * The modification time only has a resolution of a second on some file systems, so the
+ * size is folded in too.
+ */
+int64_t ConfigWatcher::modifiedTime() const
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return 0;
+	}
+
+	return (int64_t)info.st_mtime * 1000000000 + (int64_t)info.st_size;
+}
+
+/**
+ * Returns true if anything happened to the file within _timeout_ms. The modification
+ * time is checked on every platform, since it also covers a file system that inotify
+ * can't see changes on, such as a network share.
+ */
+bool ConfigWatcher::waitForChange(int _timeout_ms)
+{
+	bool seen = false;
+
+#ifdef __linux__
+	struct pollfd watch;
+	watch.fd = inotify_fd;
+	watch.events = POLLIN;
+
+	if (poll(&watch, 1, _timeout_ms) > 0)
+	{
+		alignas(struct inotify_event) char buffer[4096];
+		size_t slash = path.find_last_of('/');
+		std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+		ssize_t length;
+
+		while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* at = buffer; at < buffer + length; at += sizeof(struct inotify_event) + ((struct inotify_event*)at)->len)
+			{
+				struct inotify_event* event = (struct inotify_event*)at;
+				if ((event->len > 0) && (name == event->name))
+				{
+					seen = true;
+				}
+			}
+		}
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::milliseconds(_timeout_ms));
+#endif
+
+	int64_t modified = modifiedTime();
+	if (modified != last_modified)
+	{
+		last_modified = modified;
+		seen = true;
+	}
+
+	return seen;
+}
+
+/**
+ * Once the file has changed, waits for it to stay unchanged for CONFIG_WATCHER_SETTLE_MS
+ * before reading it. A save that leaves the contents as they were isn't reported.
+ */
+void ConfigWatcher::watchLoop()
+{
+	while (running)
+	{
+		if (!waitForChange(CONFIG_WATCHER_POLL_MS))
+		{
+			continue;
+		}
+
+		while (running && waitForChange(CONFIG_WATCHER_SETTLE_MS))
+		{
+		}
+
+		std::string contents;
+		if (!running || !readFile(contents) || (contents == last_contents))
+		{
+			continue;
+		}
+
+		last_contents = contents;
+
+		std::lock_guard<std::mutex> lock(changed_mutex);
+		changed_contents.swap(contents);
+		changed = true;
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//	How long the watcher's thread waits for a change before checking whether it has been
+//	stopped. Without inotify, also how often the file's modification time is checked.
+#define CONFIG_WATCHER_POLL_MS 250
+
+//	How long the file has to stay unchanged before it is read. Editors often write a file
+//	in several steps, or save it next to the original and rename it over.
+#define CONFIG_WATCHER_SETTLE_MS 300
+
+//	Watches a file on its own thread and hands its contents to the render thread each
+//	time they change, so the render thread never blocks on the disk. On Linux the file's
+//	directory is watched with inotify, which also sees a file renamed into place. The
+//	file's modification time is checked every CONFIG_WATCHER_POLL_MS as well, which is
+//	all other platforms have.
+class ConfigWatcher
+{
+public:
+	ConfigWatcher();
+	~ConfigWatcher();
+
+	//	Starts watching _path. The contents as of now are taken to be the ones already
+	//	loaded, so only later changes are reported. Returns false if the file can't be
+	//	watched.
+	bool start(const std::string& _path);
+	void stop();
+
+	//	Render thread only. Returns true once for each change, with the file's new
+	//	contents. Never waits on the watcher's thread.
+	bool takeChange(std::string& _contents);
+
+private:
+	std::string path;
+	std::thread thread;
+	std::atomic<bool> running;
+	int inotify_fd;
+
+	std::mutex changed_mutex;
+	std::string changed_contents;
+	bool changed;
+
+	//	Watcher's thread only.
+	std::string last_contents;
+	int64_t last_modified;
+
+	void watchLoop();
+	bool waitForChange(int _timeout_ms);
+	bool readFile(std::string& _contents) const;
+	int64_t modifiedTime() const;
+};
@@ -0,0 +1,74 @@
+
+#include "ControllerTransport.h"
+#include "NetworkTransport.h"
+
+#include <chrono>
+#include <thread>
+
+SerialTransport::SerialTransport(const std::string& _port, int _baud)
+	: port(_port), baud(_baud)
+{
+}
+
+/**
+ * ofSerial's first setup() after a close is known to sometimes fail on a Bluetooth COM
+ * port that is actually fine, which is left to the caller's retries.
+ */
+bool SerialTransport::open()
+{
+	close();
+	return serial.setup(port, baud);
+}
+
+void SerialTransport::close()
+{
+	if (serial.isInitialized())
+	{
+		serial.close();
+	}
+}
+
+long SerialTransport::read(unsigned char* _data, size_t _length)
+{
+	long bytes_read = serial.readBytes(_data, _length);
+
+	if (bytes_read == OF_SERIAL_ERROR)
+	{
+		return -1;
+	}
+
+	return (bytes_read > 0) ? bytes_read : 0;
+}
+
+long SerialTransport::write(const unsigned char* _data, size_t _length)
+{
+	return serial.writeBytes(_data, _length);
+}
+
+/**
+ * ofSerial has nothing to wait on, so the port is simply polled again after _timeout_ms.
+ */
+void SerialTransport::wait(int _timeout_ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(_timeout_ms));
+}
+
+std::string controllerPortName(const std::string& _port)
+{
+	if (NetworkTransport::isAddress(_port))
+	{
+		return _port;
+	}
+
+	return SERIAL_PREFIX + _port;
+}
+
+ControllerTransport* createControllerTransport(const std::string& _port, int _baud)
+{
+	if (NetworkTransport::isAddress(_port))
+	{
+		return new NetworkTransport(_port);
+	}
+
+	return new SerialTransport(_port, _baud);
+}
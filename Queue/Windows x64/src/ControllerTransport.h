@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <cstddef>
+#include <string>
+
+//	On Windows, if a COM port number exceeds 9, then it needs
+//	to be prefaced with the "\\\\.\\" below. To take care of this,
+//	the serial prefix will be added to all COM ports from the config file.
+#define SERIAL_PREFIX ""
+#ifdef _WIN32
+#undef SERIAL_PREFIX
+#define SERIAL_PREFIX "\\\\.\\"
+#endif
+
+//	The bytes to and from a controller's port, whatever carries them. Used only by the
+//	thread servicing the port, which polls it: read() and write() never wait, and wait()
+//	is where the thread sleeps until there may be something to read.
+class ControllerTransport
+{
+public:
+	virtual ~ControllerTransport() {}
+
+	//	Returns false if the port couldn't be opened, in which case it is tried again
+	//	later. Opening a port that is already open reopens it.
+	virtual bool open() = 0;
+	virtual void close() = 0;
+
+	//	Returns the number of bytes read, 0 if none were waiting, or -1 once the port has
+	//	failed and should be reopened. A read shorter than _length is taken to mean the
+	//	port is empty for now; anything still waiting is read after the next wait().
+	virtual long read(unsigned char* _data, size_t _length) = 0;
+
+	//	Returns _length once everything has been written, or anything else if the port
+	//	has failed and should be reopened.
+	virtual long write(const unsigned char* _data, size_t _length) = 0;
+
+	//	Returns once there may be bytes to read, or after _timeout_ms.
+	virtual void wait(int _timeout_ms) = 0;
+
+	//	True once each time a controller turns up behind a port that stayed open, so its
+	//	LED state can be written again as after a reconnect.
+	virtual bool takeArrival() { return false; }
+};
+
+//	A serial port, through ofSerial.
+class SerialTransport : public ControllerTransport
+{
+public:
+	SerialTransport(const std::string& _port, int _baud);
+
+	bool open() override;
+	void close() override;
+	long read(unsigned char* _data, size_t _length) override;
+	long write(const unsigned char* _data, size_t _length) override;
+	void wait(int _timeout_ms) override;
+
+private:
+	ofSerial serial;
+	std::string port;
+	int baud;
+};
+
+//	The name a port from config.json is known by: the serial port with SERIAL_PREFIX in
+//	front, or a network address as it is.
+std::string controllerPortName(const std::string& _port);
+
+//	A transport for a port named by controllerPortName(): a NetworkTransport for a
+//	network address, otherwise a SerialTransport.
+ControllerTransport* createControllerTransport(const std::string& _port, int _baud);
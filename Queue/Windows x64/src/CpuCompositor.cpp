@@ -0,0 +1,268 @@
+
+#include "CpuCompositor.h"
+
+#include <cstring>
+
+#ifdef CPU_COMPOSITOR_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef CPU_COMPOSITOR_NEON
+#include <arm_neon.h>
+#endif
+
+//	GCC and Clang only emit AVX2 instructions in functions marked for it, which keeps the
+//	rest of the build runnable on CPUs without AVX2. MSVC allows the intrinsics anywhere.
+#if defined(CPU_COMPOSITOR_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_COMPOSITOR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_COMPOSITOR_TARGET_AVX2
+#endif
+
+/**
+ * Every kernel computes (background * (256 - weight) + overlay * weight) >> 8 in 16-bit
+ * lanes, where weight is 1 to 255. The largest sum is 255 * 256, so nothing overflows,
+ * and each kernel finishes the bytes left over from its vector width with blendScalar().
+ */
+static void blendScalar(const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, unsigned _weight)
+{
+	unsigned inverse = 256 - _weight;
+
+	for (size_t i = 0; i < _length; i++)
+	{
+		_out[i] = (uint8_t)((_background[i] * inverse + _overlay[i] * _weight) >> 8);
+	}
+}
+
+#ifdef CPU_COMPOSITOR_X86
+
+static void blendSse2(const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, unsigned _weight)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight = _mm_set1_epi16((short)_weight);
+	const __m128i inverse = _mm_set1_epi16((short)(256 - _weight));
+
+	size_t i = 0;
+	for (; i + 16 <= _length; i += 16)
+	{
+		__m128i background = _mm_loadu_si128((const __m128i*)(_background + i));
+		__m128i overlay = _mm_loadu_si128((const __m128i*)(_overlay + i));
+
+		__m128i low = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(background, zero), inverse),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(overlay, zero), weight));
+		__m128i high = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(background, zero), inverse),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(overlay, zero), weight));
+
+		_mm_storeu_si128((__m128i*)(_out + i), _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8)));
+	}
+
+	blendScalar(_background + i, _overlay + i, _out + i, _length - i, _weight);
+}
+
+//	The unpacks and the pack both work within each 128-bit lane, so bytes come back out
+//	in the order they went in.
+CPU_COMPOSITOR_TARGET_AVX2
+static void blendAvx2(const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, unsigned _weight)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i weight = _mm256_set1_epi16((short)_weight);
+	const __m256i inverse = _mm256_set1_epi16((short)(256 - _weight));
+
+	size_t i = 0;
+	for (; i + 32 <= _length; i += 32)
+	{
+		__m256i background = _mm256_loadu_si256((const __m256i*)(_background + i));
+		__m256i overlay = _mm256_loadu_si256((const __m256i*)(_overlay + i));
+
+		__m256i low = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(background, zero), inverse),
+			_mm256_mullo_epi16(_mm256_unpacklo_epi8(overlay, zero), weight));
+		__m256i high = _mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(background, zero), inverse),
+			_mm256_mullo_epi16(_mm256_unpackhi_epi8(overlay, zero), weight));
+
+		_mm256_storeu_si256((__m256i*)(_out + i), _mm256_packus_epi16(_mm256_srli_epi16(low, 8), _mm256_srli_epi16(high, 8)));
+	}
+
+	blendScalar(_background + i, _overlay + i, _out + i, _length - i, _weight);
+}
+
+static bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	//	AVX2 also needs the OS to save the YMM registers on a context switch.
+	__cpuid(info, 1);
+	bool os_saves_ymm = ((info[2] & (1 << 27)) != 0) && ((_xgetbv(0) & 0x6) == 0x6);
+
+	__cpuidex(info, 7, 0);
+	return os_saves_ymm && ((info[1] & (1 << 5)) != 0);
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+#ifdef CPU_COMPOSITOR_NEON
+
+static void blendNeon(const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, unsigned _weight)
+{
+	const uint8x8_t weight = vdup_n_u8((uint8_t)_weight);
+	const uint8x8_t inverse = vdup_n_u8((uint8_t)(256 - _weight));
+
+	size_t i = 0;
+	for (; i + 16 <= _length; i += 16)
+	{
+		uint8x16_t background = vld1q_u8(_background + i);
+		uint8x16_t overlay = vld1q_u8(_overlay + i);
+
+		uint16x8_t low = vmlal_u8(vmull_u8(vget_low_u8(background), inverse), vget_low_u8(overlay), weight);
+		uint16x8_t high = vmlal_u8(vmull_u8(vget_high_u8(background), inverse), vget_high_u8(overlay), weight);
+
+		vst1q_u8(_out + i, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+	}
+
+	blendScalar(_background + i, _overlay + i, _out + i, _length - i, _weight);
+}
+
+#endif
+
+const char* compositorKernelName(CompositorKernel _kernel)
+{
+	switch (_kernel)
+	{
+	case CompositorKernel::SSE2: return "SSE2";
+	case CompositorKernel::AVX2: return "AVX2";
+	case CompositorKernel::NEON: return "NEON";
+	default: return "scalar";
+	}
+}
+
+bool isCompositorKernelSupported(CompositorKernel _kernel)
+{
+	switch (_kernel)
+	{
+	case CompositorKernel::Scalar:
+		return true;
+
+#ifdef CPU_COMPOSITOR_X86
+	case CompositorKernel::SSE2:
+		return true;
+
+	case CompositorKernel::AVX2:
+	{
+		static const bool has_avx2 = cpuHasAvx2();
+		return has_avx2;
+	}
+#endif
+
+#ifdef CPU_COMPOSITOR_NEON
+	case CompositorKernel::NEON:
+		return true;
+#endif
+
+	default:
+		return false;
+	}
+}
+
+CompositorKernel detectCompositorKernel()
+{
+	const CompositorKernel fastest_first[] = { CompositorKernel::AVX2, CompositorKernel::NEON, CompositorKernel::SSE2 };
+
+	for (auto kernel : fastest_first)
+	{
+		if (isCompositorKernelSupported(kernel))
+		{
+			return kernel;
+		}
+	}
+
+	return CompositorKernel::Scalar;
+}
+
+/**
+ * The ends of a fade are plain copies, which is also what the whole of a fully opaque
+ * or fully transparent overlay costs.
+ */
+void compositorBlend(CompositorKernel _kernel, const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, float _opacity)
+{
+	unsigned weight = (_opacity <= 0) ? 0 : (_opacity >= 1) ? 256 : (unsigned)(_opacity * 256.0f + 0.5f);
+
+	if (weight == 0)
+	{
+		std::memcpy(_out, _background, _length);
+		return;
+	}
+
+	if (weight >= 256)
+	{
+		std::memcpy(_out, _overlay, _length);
+		return;
+	}
+
+	switch (_kernel)
+	{
+#ifdef CPU_COMPOSITOR_X86
+	case CompositorKernel::SSE2:
+		blendSse2(_background, _overlay, _out, _length, weight);
+		return;
+
+	case CompositorKernel::AVX2:
+		blendAvx2(_background, _overlay, _out, _length, weight);
+		return;
+#endif
+
+#ifdef CPU_COMPOSITOR_NEON
+	case CompositorKernel::NEON:
+		blendNeon(_background, _overlay, _out, _length, weight);
+		return;
+#endif
+
+	default:
+		blendScalar(_background, _overlay, _out, _length, weight);
+		return;
+	}
+}
+
+CpuCompositor::CpuCompositor()
+	: width(0), height(0), channels(0), kernel(detectCompositorKernel())
+{
+}
+
+void CpuCompositor::setup(size_t _width, size_t _height, size_t _channels)
+{
+	width = _width;
+	height = _height;
+	channels = _channels;
+	frame.assign(width * height * channels, 0);
+}
+
+void CpuCompositor::setKernel(CompositorKernel _kernel)
+{
+	kernel = isCompositorKernelSupported(_kernel) ? _kernel : CompositorKernel::Scalar;
+}
+
+void CpuCompositor::compose(const uint8_t* _background, const uint8_t* _overlay, float _opacity)
+{
+	if (frame.empty())
+	{
+		return;
+	}
+
+	compositorBlend(kernel, _background, (_overlay != NULL) ? _overlay : _background, frame.data(), frame.size(), (_overlay != NULL) ? _opacity : 0.0f);
+}
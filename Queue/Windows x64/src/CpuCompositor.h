@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//	This file deliberately doesn't depend on openFrameworks, so the compositor benchmark
+//	can be built and run without it.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_COMPOSITOR_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define CPU_COMPOSITOR_NEON
+#endif
+
+//	The alpha-blend kernels, from slowest to fastest. Only the ones the build and the
+//	CPU support can be selected.
+enum class CompositorKernel
+{
+	Scalar,
+	SSE2,
+	AVX2,
+	NEON
+};
+
+const char* compositorKernelName(CompositorKernel _kernel);
+bool isCompositorKernelSupported(CompositorKernel _kernel);
+
+//	The fastest kernel supported on this machine.
+CompositorKernel detectCompositorKernel();
+
+//	out = background + (overlay - background) * opacity, byte for byte, using 8-bit
+//	fixed-point weights. The blend is the same for every channel, so any interleaved
+//	8-bit pixel format works as long as both inputs and the output share it.
+void compositorBlend(CompositorKernel _kernel, const uint8_t* _background, const uint8_t* _overlay, uint8_t* _out, size_t _length, float _opacity);
+
+//	Does the background/overlay crossfade that ofApp::draw() otherwise leaves to GL alpha
+//	blending, into a frame buffer in main memory. That frame can be uploaded as a single
+//	opaque texture, which is far cheaper than two textured quads with blending on weak
+//	GPUs, or used with no GPU at all in headless mode.
+class CpuCompositor
+{
+public:
+	CpuCompositor();
+
+	//	(Re)allocates the frame buffer. Both inputs to compose() must be this size.
+	void setup(size_t _width, size_t _height, size_t _channels);
+
+	void setKernel(CompositorKernel _kernel);
+	CompositorKernel getKernel() const { return kernel; }
+
+	//	Blends _overlay over _background at _opacity (0 to 1) into the frame buffer. A NULL
+	//	overlay or zero opacity copies the background.
+	void compose(const uint8_t* _background, const uint8_t* _overlay, float _opacity);
+
+	const uint8_t* getFrame() const { return frame.data(); }
+	size_t getWidth() const { return width; }
+	size_t getHeight() const { return height; }
+	size_t getChannels() const { return channels; }
+	size_t getFrameBytes() const { return frame.size(); }
+
+private:
+	std::vector<uint8_t> frame;
+	size_t width;
+	size_t height;
+	size_t channels;
+	CompositorKernel kernel;
+};
@@ -0,0 +1,17 @@
+
+#include "FrameParser.h"
+
+FrameParser::FrameParser()
+	: state(OUT_OF_FRAME), length(0), frames(0), resyncs(0), oversize_frames(0), stray_bytes(0)
+{
+}
+
+/**
+ * Drops any partially received frame. Counters are left alone so that they keep
+ * covering the lifetime of the device rather than a single connection.
+ */
+void FrameParser::reset()
+{
+	state = OUT_OF_FRAME;
+	length = 0;
+}
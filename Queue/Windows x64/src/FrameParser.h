@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+//	Controller frames follow the format [{ID CHARACTER}{PAYLOAD BYTES}], see the
+//	description in the controller's bt_conn.cpp.
+#define FRAME_START '['
+#define FRAME_END ']'
+
+//	Longest frame body (ID plus payload) the parser will hold. Anything longer is
+//	counted as oversize and skipped up to the next frame boundary.
+#define FRAME_PARSER_BUFFER_LIMIT 64
+
+//	A complete frame. payload points into the parser's own buffer and is only valid
+//	for the duration of the handler call it is passed to.
+struct Frame
+{
+	unsigned char id;
+	const unsigned char* payload;
+	size_t length;
+};
+
+//	Heartbeat. The app writes HEARTBEAT_PING followed by a sequence number from 1 up to
+//	HEARTBEAT_SEQUENCE_LIMIT, and the controller answers with the frame
+//	[{ID} HEARTBEAT_PING {sequence}]. The sequence numbers stay clear of the frame
+//	brackets and the LED command characters, so neither stream can be misread, and of
+//	zero, which v2 firmware takes as the start of a packet (see Packet.h).
+#define HEARTBEAT_PING 'P'
+#define HEARTBEAT_PING_LENGTH 2
+#define HEARTBEAT_SEQUENCE_LIMIT 64
+
+//	A state frame's first payload byte is 0x00 or 0x01, so a pong can't be mistaken for one.
+inline bool isPongFrame(const Frame& _frame)
+{
+	return (_frame.length >= 2) && (_frame.payload[0] == HEARTBEAT_PING);
+}
+
+//	Whether a byte written to a controller belongs to a ping rather than an LED command.
+//	Needs no state, so it also works on a ping that was split across two writes.
+inline bool isHeartbeatByte(unsigned char _byte)
+{
+	return (_byte == HEARTBEAT_PING) || (_byte < HEARTBEAT_SEQUENCE_LIMIT);
+}
+
+//	Resumable state machine for the [id payload] protocol. Bytes can be fed in chunks
+//	of any size, split anywhere, and complete frames are handed to a callback without
+//	any allocation. The counters are atomics so they can be read from any thread while
+//	the I/O thread is feeding the parser.
+class FrameParser
+{
+public:
+	FrameParser();
+
+	void reset();
+
+	//	Feeds _length bytes through the state machine, calling _on_frame(const Frame&)
+	//	for every complete frame found.
+	template <typename Handler>
+	void feed(const unsigned char* _data, size_t _length, Handler&& _on_frame)
+	{
+		for (size_t i = 0; i < _length; i++)
+		{
+			unsigned char byte = _data[i];
+
+			switch (state)
+			{
+			case OUT_OF_FRAME:
+				if (byte == FRAME_START)
+				{
+					state = IN_FRAME;
+					length = 0;
+				}
+				else
+				{
+					stray_bytes.fetch_add(1, std::memory_order_relaxed);
+				}
+				break;
+
+			case IN_FRAME:
+				if (byte == FRAME_START)
+				{
+					//	A new frame began before the previous one was closed, so the
+					//	previous one was cut short somewhere. Start over on this one.
+					resyncs.fetch_add(1, std::memory_order_relaxed);
+					length = 0;
+				}
+				else if (byte == FRAME_END)
+				{
+					state = OUT_OF_FRAME;
+
+					if (length == 0)
+					{
+						resyncs.fetch_add(1, std::memory_order_relaxed);
+						break;
+					}
+
+					Frame frame;
+					frame.id = buffer[0];
+					frame.payload = buffer + 1;
+					frame.length = length - 1;
+
+					frames.fetch_add(1, std::memory_order_relaxed);
+					_on_frame(frame);
+				}
+				else if (length >= FRAME_PARSER_BUFFER_LIMIT)
+				{
+					oversize_frames.fetch_add(1, std::memory_order_relaxed);
+					state = DISCARDING;
+				}
+				else
+				{
+					buffer[length++] = byte;
+				}
+				break;
+
+			case DISCARDING:
+				if (byte == FRAME_END)
+				{
+					state = OUT_OF_FRAME;
+				}
+				else if (byte == FRAME_START)
+				{
+					resyncs.fetch_add(1, std::memory_order_relaxed);
+					state = IN_FRAME;
+					length = 0;
+				}
+				break;
+			}
+		}
+	}
+
+	unsigned long frameCount() const { return frames.load(std::memory_order_relaxed); }
+	unsigned long resyncCount() const { return resyncs.load(std::memory_order_relaxed); }
+	unsigned long oversizeCount() const { return oversize_frames.load(std::memory_order_relaxed); }
+	unsigned long strayByteCount() const { return stray_bytes.load(std::memory_order_relaxed); }
+
+private:
+	enum State
+	{
+		OUT_OF_FRAME,
+		IN_FRAME,
+		DISCARDING
+	};
+
+	State state;
+	unsigned char buffer[FRAME_PARSER_BUFFER_LIMIT];
+	size_t length;
+
+	std::atomic<unsigned long> frames;
+	std::atomic<unsigned long> resyncs;
+	std::atomic<unsigned long> oversize_frames;
+	std::atomic<unsigned long> stray_bytes;
+};
@@ -0,0 +1,840 @@
+
+#include "InteractiveDevice.h"
+#include "Logger.h"
+#include "NetworkTransport.h"
+#include "Tracer.h"
+#include <chrono>
+#include <stdexcept>
+
+static uint64_t nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t nowMillis()
+{
+	return nowMicros() / 1000;
+}
+
+InteractiveDevice::InteractiveDevice()
+	: video(NULL), baud(0), id(0), clip_missing(false), retired(false), io_running(false), recorder(NULL), recorder_index(0), connected(false), reconnect_requested(false), led_state(0),
+	heartbeat_ms(HEARTBEAT_DEFAULT_INTERVAL_MS), heartbeat_misses(HEARTBEAT_DEFAULT_MISSES), ping_sequence(0), ping_outstanding(false), ping_sent_us(0), led_encoded_us(0),
+	protocol_version(1), send_sequence(0), foreign_frames(0), reported_oversize_frames(0), reported_foreign_id(false), gateway(NULL)
+{
+	transport = this;
+	reconnect_timer.callback = [this]() { tryReconnect(); };
+	heartbeat_timer.callback = [this]() { sendHeartbeat(); };
+}
+
+/**
+ * A gateway owns its stations, which can't go while it might still route frames to them.
+ */
+InteractiveDevice::~InteractiveDevice()
+{
+	stopIoThread();
+
+	for (auto station : stations)
+	{
+		delete station;
+	}
+}
+
+void InteractiveDevice::setup(const char* _port, int _baud, const char* _video_path, bool _open_serial)
+{
+	port = controllerPortName(_port);
+	baud = _baud;
+	port_io.reset(createControllerTransport(port, baud));
+
+	if (_open_serial)
+	{
+		if (!port_io->open())
+		{
+			throw std::runtime_error("\nFATAL ERROR! Error occured when trying to set up serial. Check config file and ensure serial ports are correct and available on the machine.");
+		}
+
+		connected = true;
+		link.opened = true;
+	}
+
+	//	The clip itself is only opened by the VideoPool once the device is queued, so
+	//	here it is just checked that it's there. A gateway has none.
+	video_path = _video_path;
+	clip_missing = !video_path.empty() && !ofFile::doesFileExist(video_path);
+
+	name = port;
+	state = false;
+}
+
+bool InteractiveDevice::isNetworked() const
+{
+	return NetworkTransport::isAddress(port);
+}
+
+void InteractiveDevice::setHeartbeat(int _interval_ms, int _misses)
+{
+	heartbeat_ms = _interval_ms;
+	heartbeat_misses = _misses;
+}
+
+void InteractiveDevice::addStation(InteractiveDevice* _station)
+{
+	if (routes.empty())
+	{
+		routes.resize(256, NULL);
+	}
+
+	_station->gateway = this;
+	stations.push_back(_station);
+	routes[_station->id] = _station;
+}
+
+/**
+ * A station on a shared port is serviced by its gateway's I/O thread.
+ */
+void InteractiveDevice::startIoThread()
+{
+	if (io_running || (gateway != NULL))
+	{
+		return;
+	}
+
+	write_buffer.resize(2 * getMessageLimit());
+	io_running = true;
+	io_thread = std::thread(&InteractiveDevice::ioThreadLoop, this);
+}
+
+void InteractiveDevice::stopIoThread()
+{
+	io_running = false;
+
+	if (io_thread.joinable())
+	{
+		io_thread.join();
+	}
+}
+
+bool InteractiveDevice::pollEvent(DeviceEvent& _event)
+{
+	return events.pop(_event);
+}
+
+void InteractiveDevice::sendCommand(char _command)
+{
+	led_state = _command;
+
+	if (!commands.push(_command))
+	{
+		LOG_WARNING("LED command '{}' for {} was dropped, the I/O thread is not keeping up.", _command, port);
+		return;
+	}
+
+	if (command_listener)
+	{
+		command_listener();
+	}
+}
+
+void InteractiveDevice::requestReconnect()
+{
+	reconnect_requested = true;
+
+	if (command_listener)
+	{
+		command_listener();
+	}
+}
+
+bool InteractiveDevice::takeReconnectRequest()
+{
+	bool requested = reconnect_requested.exchange(false);
+
+	for (auto station : stations)
+	{
+		requested = station->takeReconnectRequest() || requested;
+	}
+
+	return requested;
+}
+
+void InteractiveDevice::countOpenFailure()
+{
+	link.open_failures.fetch_add(1, std::memory_order_relaxed);
+
+	for (auto station : stations)
+	{
+		station->countOpenFailure();
+	}
+}
+
+void InteractiveDevice::setConnected(bool _connected)
+{
+	for (auto station : stations)
+	{
+		station->setConnected(_connected);
+	}
+
+	if (_connected)
+	{
+		char stale;
+		takeLatestCommand(stale);
+
+		ping_outstanding = false;
+		link.consecutive_misses = 0;
+		link.opened = true;
+	}
+
+	connected = _connected;
+}
+
+bool InteractiveDevice::takeCommand(char& _command)
+{
+	return commands.pop(_command);
+}
+
+/**
+ * QueueCore already sends each controller at most one command per tick, so there is
+ * only more than one here when the port has fallen behind the render thread.
+ */
+bool InteractiveDevice::takeLatestCommand(char& _command)
+{
+	bool taken = false;
+	char command;
+
+	while (commands.pop(command))
+	{
+		_command = command;
+		taken = true;
+	}
+
+	return taken;
+}
+
+/**
+ * The controller may have restarted while the port was down, in which case it speaks
+ * v1 again, so the protocol is worked out over again as for a port just opened.
+ */
+void InteractiveDevice::resetParser()
+{
+	parser.reset();
+	packet_parser.reset();
+	protocol_version = 1;
+
+	for (auto station : stations)
+	{
+		station->resetParser();
+	}
+}
+
+void InteractiveDevice::setCommandListener(std::function<void()> _listener)
+{
+	command_listener = _listener;
+
+	for (auto station : stations)
+	{
+		station->setCommandListener(_listener);
+	}
+}
+
+void InteractiveDevice::setRecorder(TrafficRecorder* _recorder, uint8_t _index)
+{
+	recorder = _recorder;
+	recorder_index = _index;
+}
+
+void InteractiveDevice::recordSent(const unsigned char* _data, size_t _length)
+{
+	if (recorder != NULL)
+	{
+		recorder->record(recorder_index, TRAFFIC_OUTBOUND, _data, _length);
+	}
+
+	Tracer::instant("serial", "command written", port.c_str());
+	recordLedLatency();
+
+	for (auto station : stations)
+	{
+		station->recordLedLatency();
+	}
+}
+
+/**
+ * Only a device whose command was encoded into the write has anything to record, so a
+ * gateway's stations whose commands are still queued keep waiting for theirs.
+ */
+void InteractiveDevice::recordLedLatency()
+{
+	if (led_encoded_us != 0)
+	{
+		latency.led.record(nowMicros() - led_encoded_us);
+		led_encoded_us = 0;
+	}
+}
+
+/**
+ * Body of the device's I/O thread. Outgoing commands are flushed before reading so
+ * that an LED update queued by the render thread goes out within one poll interval.
+ * While the port is open, the thread waits on it between polls, which for a network
+ * port means it wakes as soon as a frame arrives.
+ */
+void InteractiveDevice::ioThreadLoop()
+{
+	Tracer::setThreadName("io " + port);
+	timers.reset(nowMillis());
+
+	if (connected && (heartbeat_ms > 0))
+	{
+		timers.schedule(heartbeat_timer, heartbeat_ms);
+	}
+
+	//	A port that wasn't opened by setup(), such as that of a station added by a config
+	//	reload, is opened here rather than on the render thread.
+	if (!connected)
+	{
+		timers.schedule(reconnect_timer, 0);
+	}
+
+	while (io_running)
+	{
+		timers.advance(nowMillis());
+
+		if (takeReconnectRequest())
+		{
+			markDisconnected("reconnect requested", true);
+		}
+
+		if (connected)
+		{
+			writePendingCommands();
+		}
+
+		if (connected)
+		{
+			getStateFromSerial();
+		}
+
+		if (connected && port_io->takeArrival())
+		{
+			writeLedState();
+		}
+
+		if (connected)
+		{
+			port_io->wait(INTERACTIVE_DEVICE_IO_POLL_MS);
+		}
+		else
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(INTERACTIVE_DEVICE_IO_POLL_MS));
+		}
+	}
+}
+
+/**
+ * Closes the port and schedules the next attempt to reopen it. A reconnect that was
+ * asked for (the 'R' key) is tried straight away, one caused by a failure waits out
+ * the backoff first.
+ */
+void InteractiveDevice::markDisconnected(const char* _reason, bool _retry_now)
+{
+	if (connected)
+	{
+		LOG_WARNING("Port {} disconnected: {}", port, _reason);
+		Tracer::instant("serial", "disconnected", port.c_str());
+	}
+
+	port_io->close();
+
+	resetParser();
+	setConnected(false);
+	heartbeat_timer.cancel();
+
+	if (_retry_now)
+	{
+		backoff.reset();
+		timers.schedule(reconnect_timer, 0);
+	}
+	else
+	{
+		timers.schedule(reconnect_timer, backoff.nextDelayMs());
+	}
+}
+
+/**
+ * ofSerial's first setup() after a close is known to sometimes fail on a Bluetooth COM
+ * port that is actually fine (the old restartSerial() called it twice for this reason).
+ * Here a failed attempt just waits out the backoff and tries again, as does a network
+ * address that can't be bound yet.
+ */
+void InteractiveDevice::tryReconnect()
+{
+	bool first_open = !link.opened.load(std::memory_order_relaxed);
+
+	if (!port_io->open())
+	{
+		countOpenFailure();
+
+		uint64_t delay = backoff.nextDelayMs();
+		timers.schedule(reconnect_timer, delay);
+		LOG_WARNING("{} {} failed (attempt {}), retrying in {} ms.", first_open ? "Opening" : "Reconnecting", port, backoff.attempts(), delay);
+		return;
+	}
+
+	LOG_INFO("Port {} {}.", port, first_open ? "opened" : "reconnected");
+	Tracer::instant("serial", first_open ? "opened" : "reconnected", port.c_str());
+	backoff.reset();
+	setConnected(true);
+	writeLedState();
+
+	if (heartbeat_ms > 0)
+	{
+		timers.schedule(heartbeat_timer, heartbeat_ms);
+	}
+}
+
+void InteractiveDevice::writeLedState()
+{
+	size_t length = encodeLedState(write_buffer.data());
+	if ((length > 0) && (port_io->write(write_buffer.data(), length) == (long)length))
+	{
+		recordSent(write_buffer.data(), length);
+	}
+}
+
+void InteractiveDevice::sendHeartbeat()
+{
+	writePendingCommands(true);
+
+	if (connected)
+	{
+		timers.schedule(heartbeat_timer, heartbeat_ms);
+	}
+}
+
+/**
+ * A gateway counts a station as dead from its miss count rather than from whether it
+ * returned 0 this round. A dead station that isn't reconnected pings again, and only
+ * returns 0 every other round from then on, so stations that died on rounds of opposite
+ * parity would otherwise never all return 0 together.
+ */
+size_t InteractiveDevice::nextHeartbeat(unsigned char* _out)
+{
+	if (!stations.empty())
+	{
+		size_t length = 0;
+		size_t answering = 0;
+		size_t dead = 0;
+
+		for (auto station : stations)
+		{
+			length += station->nextHeartbeat(_out + length);
+
+			bool station_answering = station->link.answering.load(std::memory_order_relaxed);
+			answering += station_answering ? 1 : 0;
+			dead += (station_answering && (station->link.consecutive_misses.load(std::memory_order_relaxed) >= (unsigned long)station->heartbeat_misses)) ? 1 : 0;
+		}
+
+		if ((dead > 0) && (dead == answering))
+		{
+			Tracer::instant("serial", "link dead", port.c_str());
+			link.links_dropped.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+
+		return length;
+	}
+
+	if (ping_outstanding)
+	{
+		link.pings_missed.fetch_add(1, std::memory_order_relaxed);
+		unsigned long misses = link.consecutive_misses.fetch_add(1, std::memory_order_relaxed) + 1;
+
+		if (link.answering && (misses >= (unsigned long)heartbeat_misses))
+		{
+			Tracer::instant("serial", "link dead", port.c_str());
+			link.links_dropped.fetch_add(1, std::memory_order_relaxed);
+			ping_outstanding = false;
+			return 0;
+		}
+	}
+
+	ping_sequence = (unsigned char)((ping_sequence % (HEARTBEAT_SEQUENCE_LIMIT - 1)) + 1);
+	ping_outstanding = true;
+	ping_sent_us = nowMicros();
+	link.pings_sent.fetch_add(1, std::memory_order_relaxed);
+
+	if (sendsPackets())
+	{
+		return encodeMessage(PACKET_PING, ping_sequence, _out);
+	}
+
+	_out[0] = HEARTBEAT_PING;
+	_out[1] = ping_sequence;
+	return HEARTBEAT_PING_LENGTH;
+}
+
+size_t InteractiveDevice::encodeCommand(char _command, unsigned char* _out)
+{
+	if (sendsPackets())
+	{
+		return encodeMessage(PACKET_LED, (unsigned char)_command, _out);
+	}
+
+	_out[0] = (unsigned char)_command;
+	return 1;
+}
+
+/**
+ * Each station is given the room the ones before it left, so on a port that has fallen
+ * behind, the stations late in the list wait for the next write.
+ */
+size_t InteractiveDevice::encodeCommands(unsigned char* _out, size_t _room)
+{
+	if (!stations.empty())
+	{
+		size_t length = 0;
+
+		for (auto station : stations)
+		{
+			length += station->encodeCommands(_out + length, _room - length);
+		}
+
+		return length;
+	}
+
+	char command;
+	if ((_room < PACKET_ENCODED_LIMIT) || !takeLatestCommand(command))
+	{
+		return 0;
+	}
+
+	led_encoded_us = latency.led_pending_us.exchange(0, std::memory_order_relaxed);
+	return encodeCommand(command, _out);
+}
+
+size_t InteractiveDevice::encodeLedState(unsigned char* _out)
+{
+	if (!stations.empty())
+	{
+		size_t length = 0;
+
+		for (auto station : stations)
+		{
+			length += station->encodeLedState(_out + length);
+		}
+
+		return length;
+	}
+
+	char state = led_state;
+	if (state == 0)
+	{
+		return 0;
+	}
+
+	led_encoded_us = latency.led_pending_us.exchange(0, std::memory_order_relaxed);
+	return encodeCommand(state, _out);
+}
+
+/**
+ * Controllers on a shared port are always sent v2, the only protocol whose messages say
+ * which controller they are for. The firmware listens for v2 from the start.
+ */
+bool InteractiveDevice::sendsPackets() const
+{
+	return (protocol_version == 2) || (gateway != NULL);
+}
+
+/**
+ * Every message the app sends carries a single payload byte. Packets are addressed to
+ * the device's ID, or to 0 (any controller) when it has none.
+ */
+size_t InteractiveDevice::encodeMessage(uint8_t _type, unsigned char _payload, unsigned char* _out)
+{
+	Packet packet;
+	packet.type = _type;
+	packet.sequence = send_sequence++;
+	packet.id = id;
+	packet.payload = &_payload;
+	packet.length = 1;
+
+	return encodePacket(packet, _out);
+}
+
+/**
+ * A pong for an older ping arrived after that ping was counted as missed. It still
+ * shows the link is up, but its round trip is left out of the RTT histogram.
+ */
+void InteractiveDevice::handlePong(unsigned char _sequence)
+{
+	link.answering = true;
+	link.consecutive_misses = 0;
+
+	if (ping_outstanding && (_sequence == ping_sequence))
+	{
+		ping_outstanding = false;
+		link.pongs_received.fetch_add(1, std::memory_order_relaxed);
+		link.rtt.record(nowMicros() - ping_sent_us);
+	}
+}
+
+/**
+ * Writes the latest queued LED command, followed by a heartbeat ping when one is due,
+ * in a single writeBytes() call. The command goes first so that the LED latency is
+ * recorded against it rather than the ping.
+ */
+void InteractiveDevice::writePendingCommands(bool _with_ping)
+{
+	unsigned char* out = write_buffer.data();
+	size_t length = encodeCommands(out, getMessageLimit());
+
+	if (_with_ping)
+	{
+		size_t ping_length = nextHeartbeat(out + length);
+
+		if (ping_length == 0)
+		{
+			markDisconnected("missed heartbeats", true);
+			return;
+		}
+
+		length += ping_length;
+	}
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	TraceScope scope("serial", "write", port.c_str());
+
+	if (port_io->write(out, length) != (long)length)
+	{
+		markDisconnected("write failed", false);
+		return;
+	}
+
+	recordSent(out, length);
+}
+
+/**
+ * Drains everything waiting on the port, INTERACTIVE_DEVICE_READ_CHUNK bytes per
+ * readBytes() call, and runs it through the frame parser. A short read means the
+ * port is empty, so there is no separate available() call per chunk.
+ */
+void InteractiveDevice::getStateFromSerial()
+{
+	long bytes_read;
+
+	do {
+		bytes_read = port_io->read(read_buffer, INTERACTIVE_DEVICE_READ_CHUNK);
+
+		if (bytes_read < 0)
+		{
+			markDisconnected("read failed", false);
+			return;
+		}
+
+		if (bytes_read <= 0)
+		{
+			return;
+		}
+
+		receiveBytes(read_buffer, (size_t)bytes_read);
+	} while (bytes_read == INTERACTIVE_DEVICE_READ_CHUNK);
+}
+
+void InteractiveDevice::receiveBytes(const unsigned char* _data, size_t _length)
+{
+	if (gateway != NULL)
+	{
+		gateway->receiveBytes(_data, _length);
+		return;
+	}
+
+	if (recorder != NULL)
+	{
+		recorder->record(recorder_index, TRAFFIC_INBOUND, _data, _length);
+	}
+
+	//	Until the controller turns out to speak v2, its bytes go through both parsers.
+	//	v1 goes first, so that a v1 frame ahead of the first v2 packet in the same read
+	//	isn't lost when the device switches over. After that, the v1 parser only gets
+	//	the bytes the packet parser finds can't be packets.
+	bool fed_v1 = (protocol_version == 1);
+
+	if (fed_v1)
+	{
+		parser.feed(_data, _length, [this](const Frame& _frame) {
+			handleFrame(_frame);
+		});
+	}
+
+	packet_parser.feed(_data, _length,
+		[this](const Packet& _packet) {
+			handlePacket(_packet);
+		},
+		[this, fed_v1](unsigned char _byte) {
+			if (!fed_v1)
+			{
+				parser.feed(&_byte, 1, [this](const Frame& _frame) {
+					handleRestartedFrame(_frame);
+				});
+			}
+		});
+
+	if (parser.oversizeCount() != reported_oversize_frames)
+	{
+		reported_oversize_frames = parser.oversizeCount();
+		LOG_WARNING("Frame received from {} was longer than {} bytes and was ignored. Check that device is sending data in proper format.", port, FRAME_PARSER_BUFFER_LIMIT);
+	}
+}
+
+/**
+ * The first payload byte is the controller's state, 0x01 when something is in front
+ * of the sensor (or the button was switched on) and 0x00 otherwise, or
+ * HEARTBEAT_PING for the answer to a ping.
+ */
+void InteractiveDevice::handleFrame(const Frame& _frame)
+{
+	if (!stations.empty())
+	{
+		InteractiveDevice* station = routes[_frame.id];
+
+		if (station == NULL)
+		{
+			foreign_frames.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		station->handleFrame(_frame);
+		return;
+	}
+
+	if ((id != 0) && (_frame.id != id))
+	{
+		countForeignFrame(_frame.id);
+		return;
+	}
+
+	if (_frame.length < 1)
+	{
+		return;
+	}
+
+	//	Whatever the controller sends shows its link is alive.
+	link.consecutive_misses = 0;
+
+	if (isPongFrame(_frame))
+	{
+		handlePong(_frame.payload[1]);
+		return;
+	}
+
+	pushEvent(_frame.payload[0] != 0);
+}
+
+/**
+ * A station that only ever hears another ID is most likely keyed differently from its
+ * controller's SENSOR_ID, so the first such frame is logged, once per device.
+ */
+void InteractiveDevice::countForeignFrame(unsigned char _id)
+{
+	foreign_frames.fetch_add(1, std::memory_order_relaxed);
+
+	if (!reported_foreign_id)
+	{
+		reported_foreign_id = true;
+		LOG_WARNING("Controller on {} sent ID '{}' where '{}' was expected, and its frames are ignored. Check the station's key against the firmware's SENSOR_ID (BT_CONTROLLER_ID in the PlatformIO firmware).", port, (char)_id, (char)id);
+	}
+}
+
+/**
+ * Only packets that passed the CRC get here, so the first one is proof enough that the
+ * controller speaks v2. On a shared port, the first packet from any controller is taken
+ * as proof that they all do, as the firmware switches to v2 on the first packet it
+ * hears, whoever it is for.
+ */
+void InteractiveDevice::handlePacket(const Packet& _packet)
+{
+	if ((id != 0) && (_packet.id != id))
+	{
+		countForeignFrame(_packet.id);
+		return;
+	}
+
+	if (protocol_version != 2)
+	{
+		protocol_version = 2;
+		parser.reset();
+		LOG_INFO("Controller on {} speaks protocol v2.", port);
+	}
+
+	if (!stations.empty())
+	{
+		InteractiveDevice* station = routes[_packet.id];
+
+		if (station == NULL)
+		{
+			foreign_frames.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		station->handlePacket(_packet);
+		return;
+	}
+
+	link.consecutive_misses = 0;
+
+	switch (_packet.type)
+	{
+	case PACKET_STATE:
+		if (_packet.length >= 1)
+		{
+			pushEvent(_packet.payload[0] != 0);
+		}
+		break;
+
+	case PACKET_PONG:
+		if (_packet.length >= 1)
+		{
+			handlePong(_packet.payload[0]);
+		}
+		break;
+
+	case PACKET_SENSOR_ERROR:
+		LOG_WARNING("Controller on {} reported sensor error {}.", port, (_packet.length >= 1) ? (int)_packet.payload[0] : 0);
+		break;
+	}
+}
+
+/**
+ * A v1 frame on a link that had switched to v2, which means the controller has
+ * restarted and is waiting to hear v2 from the app again. The frame is handled as
+ * usual, and the device goes back to v1 so that the controller is pinged in v1 and
+ * switches over as it did at startup. A gateway stays on v2, as its controllers are
+ * always sent v2, which restarted firmware switches over on straight away.
+ */
+void InteractiveDevice::handleRestartedFrame(const Frame& _frame)
+{
+	if (stations.empty() && ((id == 0) || (_frame.id == id)) && (protocol_version == 2))
+	{
+		protocol_version = 1;
+		LOG_INFO("Controller on {} is speaking protocol v1 again, it has probably restarted.", port);
+	}
+
+	handleFrame(_frame);
+}
+
+void InteractiveDevice::pushEvent(bool _state)
+{
+	Tracer::instant("serial", "frame", port.c_str());
+
+	DeviceEvent event;
+	event.device_state = _state;
+	event.received_us = nowMicros();
+
+	if (!events.push(event))
+	{
+		LOG_WARNING("State change from {} was dropped, the render thread is not keeping up.", port);
+	}
+}
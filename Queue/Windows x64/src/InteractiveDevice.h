@@ -0,0 +1,324 @@
+#pragma once
+
+#include "ofMain.h"
+#include "ControllerTransport.h"
+#include "FrameParser.h"
+#include "LatencyHistogram.h"
+#include "Packet.h"
+#include "QueueInterfaces.h"
+#include "ReconnectBackoff.h"
+#include "SpscRing.h"
+#include "TimerWheel.h"
+#include "TrafficLog.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//	Size of the inline buffer each I/O thread reads into. All bytes waiting on the port
+//	are drained in chunks of this size, one readBytes() call per chunk.
+#define INTERACTIVE_DEVICE_READ_CHUNK 256
+
+//	Number of decoded state changes / outgoing LED commands that can be in flight
+//	between a device's I/O thread and the render thread. Must be a power of two.
+#define INTERACTIVE_DEVICE_RING_SIZE 64
+
+//	How long a device's I/O thread waits between polls of its port.
+#define INTERACTIVE_DEVICE_IO_POLL_MS 1
+
+//	How often each controller is pinged, and how many pings in a row may go unanswered
+//	before its link is taken to be dead and the port reconnected. Overridden by
+//	"heartbeat_ms" and "heartbeat_misses" in config.json.
+#define HEARTBEAT_DEFAULT_INTERVAL_MS 1000
+#define HEARTBEAT_DEFAULT_MISSES 3
+
+//	A state change decoded from a controller frame on the I/O thread. The receipt
+//	time is taken when the frame's closing bracket is read, so it reflects when the
+//	controller was triggered rather than when the render thread got around to it.
+struct DeviceEvent
+{
+	bool device_state;
+	uint64_t received_us;
+};
+
+//	Health of a device's Bluetooth link, measured by the heartbeat on whichever thread
+//	services the port and read by the metrics endpoint.
+struct LinkHealth
+{
+	LatencyHistogram rtt;
+	std::atomic<unsigned long> pings_sent{ 0 };
+	std::atomic<unsigned long> pongs_received{ 0 };
+	std::atomic<unsigned long> pings_missed{ 0 };
+	std::atomic<unsigned long> consecutive_misses{ 0 };
+
+	//	Times the link was declared dead and its port reconnected.
+	std::atomic<unsigned long> links_dropped{ 0 };
+
+	//	Set once the port has been opened for the first time, and attempts to open it
+	//	that failed, so a station whose port never opened can be told from one that is
+	//	only slow to.
+	std::atomic<bool> opened{ false };
+	std::atomic<unsigned long> open_failures{ 0 };
+
+	//	Set once the controller has answered a ping. Firmware that predates the heartbeat
+	//	never does, and is never declared dead for it.
+	std::atomic<bool> answering{ false };
+};
+
+//	Each InteractiveDevice owns a port, serial or network (see ControllerTransport), that
+//	is only ever touched by the device's own I/O thread once startIoThread() has been
+//	called. The render thread talks to it through two bounded single-producer/
+//	single-consumer rings:
+//
+//		I/O thread    --(events)-->   render thread		decoded controller state
+//		render thread --(commands)--> I/O thread		'N', 'W' and 'F' LED commands
+//
+//	so a slow or stalled port can never hold up update() or draw().
+//
+//	The I/O thread is also the port's reconnect supervisor. When a read or write fails,
+//	or the render thread calls requestReconnect(), the port is closed and reopened with
+//	exponential backoff, and the last LED state is written again once it is back.
+//
+//	A device can also be a gateway: the owner of a port that carries frames from several
+//	controllers, such as a hub that relays for dozens of them over RF or USB. The
+//	gateway's port is serviced like any other, and each frame read from it is routed by
+//	its ID to the station on the port with that ID. The stations have no port of their
+//	own, and their LED commands and pings go out through the gateway as v2 packets
+//	addressed to their ID, as a v1 command carries none. A gateway is never a station.
+//
+//	To the QueueCore a device is a QueueStation, and its own transport.
+class InteractiveDevice : public QueueStation, public QueueTransport
+{
+public:
+	//	The port as used by the device's own I/O thread. The SerialReactor opens serial
+	//	ports itself instead.
+	std::unique_ptr<ControllerTransport> port_io;
+
+	//	The clip for this station lives in the VideoPool. video is NULL while the clip is
+	//	cold and points at the pooled player while it is open.
+	std::string video_path;
+	ofVideoPlayer* video;
+
+	std::string port;
+	int baud;
+
+	//	ID character the controller puts at the start of each frame. Set from the
+	//	sensor's key in config.json when that key is a single character, otherwise 0
+	//	and frames with any ID are accepted.
+	unsigned char id;
+
+	//	Trigger latency through each stage, for the metrics endpoint. The render thread
+	//	records the queue and overlay stages, and recordSent() the LED stage.
+	StationLatency latency;
+
+	LinkHealth link;
+
+	//	Set when video_path isn't there. The station is degraded: it is never queued, but
+	//	its port is still serviced, so its controller and link can still be checked.
+	std::atomic<bool> clip_missing;
+
+	//	Set by the app once the station has been taken out of config.json. Its events are
+	//	ignored from then on, and it is let go of once its queue entry has played out.
+	bool retired;
+
+	InteractiveDevice();
+	~InteractiveDevice();
+
+	//	_port is a serial port, or a network address such as udp://0.0.0.0:9000 (see
+	//	NetworkTransport). When _open_serial is false the port name is only recorded, and
+	//	opening and servicing the port is left to the SerialReactor, or to the device's
+	//	own I/O thread once it is started. Otherwise throws if the port can't be opened. A
+	//	clip that isn't there only sets clip_missing.
+	void setup(const char* _port, int _baud, const char* _video_path, bool _open_serial = true);
+
+	//	Pings the controller every _interval_ms, 0 to not ping at all, and declares the
+	//	link dead after _misses unanswered pings in a row. Must be set before the port
+	//	starts being serviced.
+	void setHeartbeat(int _interval_ms, int _misses);
+	int getHeartbeatMillis() const { return heartbeat_ms; }
+
+	//	Makes this device the gateway for _station, whose port must be the same and whose
+	//	ID must be set. Frames carrying the station's ID are routed to it from then on.
+	//	Must be called before the port starts being serviced.
+	void addStation(InteractiveDevice* _station);
+
+	bool isGateway() const { return !stations.empty(); }
+	const std::vector<InteractiveDevice*>& getStations() const { return stations; }
+
+	//	The gateway whose port this station shares, or NULL if it has a port of its own.
+	InteractiveDevice* getGateway() const { return gateway; }
+
+	//	Most bytes one round of LED commands, or of pings, can take: one packet, or one
+	//	for each of a gateway's stations.
+	size_t getMessageLimit() const { return PACKET_ENCODED_LIMIT * (stations.empty() ? 1 : stations.size()); }
+
+	//	A station on a shared port reports its gateway's parsers, which every frame on the
+	//	port goes through.
+	const FrameParser& getParser() const { return (gateway != NULL) ? gateway->parser : parser; }
+	const PacketParser& getPacketParser() const { return (gateway != NULL) ? gateway->packet_parser : packet_parser; }
+
+	//	1 until the controller has sent a valid v2 packet, 2 from then on, and 1 again once
+	//	the port is closed or the controller is heard speaking v1 after having restarted.
+	int getProtocolVersion() const { return protocol_version.load(std::memory_order_relaxed); }
+	unsigned long getForeignFrameCount() const { return foreign_frames.load(std::memory_order_relaxed); }
+	size_t getDroppedEventCount() const { return events.droppedCount(); }
+	size_t getDroppedCommandCount() const { return commands.droppedCount(); }
+
+	void startIoThread();
+	void stopIoThread();
+
+	//	Render thread only. Returns false once there are no more pending events.
+	bool pollEvent(DeviceEvent& _event);
+	bool hasPendingEvents() const { return !events.empty(); }
+
+	//	Render thread only. Queues a single byte LED command for the I/O thread to write.
+	//	The last command sent is remembered so it can be restored after a reconnect.
+	void sendCommand(char _command) override;
+
+	//	Render thread only. Asks whichever thread services the port to close and reopen
+	//	it. Returns immediately; the reconnect happens in the background.
+	void requestReconnect();
+
+	bool isConnected() const { return connected.load(std::memory_order_relaxed); }
+
+	//	Whether the port is a network address. Those are always serviced by the device's
+	//	own I/O thread, as the SerialReactor only takes ttys.
+	bool isNetworked() const;
+	char getLedState() const { return led_state.load(std::memory_order_relaxed); }
+
+	//	I/O side only, for whichever thread services the port (the device's own I/O
+	//	thread, or the SerialReactor). Runs received bytes through the frame parser. A
+	//	station on a shared port hands them to its gateway.
+	void receiveBytes(const unsigned char* _data, size_t _length);
+
+	//	I/O side only. Returns false once there are no more queued LED commands.
+	bool takeCommand(char& _command);
+
+	//	I/O side only. Takes every queued LED command and returns the last of them, or
+	//	false if there were none. Only the latest state matters to the controller, so a
+	//	port that fell behind skips straight to it rather than flashing through the rest.
+	bool takeLatestCommand(char& _command);
+
+	//	I/O side only. Starts the next heartbeat, counting the last ping as missed if it
+	//	went unanswered, and writes the ping to _out, which must have room for
+	//	getMessageLimit() bytes. Returns the ping's length, or 0 instead once too many
+	//	pings in a row have been missed, in which case the link is dead and the port
+	//	should be reconnected. A gateway pings each of its stations, and its port is only
+	//	dead once every station that has answered before has stopped answering.
+	size_t nextHeartbeat(unsigned char* _out);
+
+	//	I/O side only. Writes an LED command to _out in the protocol the controller
+	//	speaks, and returns its length. _out must have room for PACKET_ENCODED_LIMIT bytes.
+	size_t encodeCommand(char _command, unsigned char* _out);
+
+	//	I/O side only. Takes the latest queued LED command (see takeLatestCommand()), or
+	//	that of each of a gateway's stations, and writes as many as fit in _room bytes to
+	//	_out. Returns their length. A command that doesn't fit stays queued.
+	size_t encodeCommands(unsigned char* _out, size_t _room);
+
+	//	I/O side only. Writes the last LED command sent, or that of each of a gateway's
+	//	stations, to restore it once the port is back. _out must have room for
+	//	getMessageLimit() bytes.
+	size_t encodeLedState(unsigned char* _out);
+
+	//	I/O side only. Counts an attempt to open the port that failed, for a gateway's
+	//	stations too.
+	void countOpenFailure();
+
+	//	I/O side only. Drops any partially received frame, e.g. after the port was closed,
+	//	and goes back to v1 until the controller shows it speaks v2 again.
+	void resetParser();
+
+	//	I/O side only. Clears and returns the flag set by requestReconnect(), or by that of
+	//	any of a gateway's stations.
+	bool takeReconnectRequest();
+
+	//	I/O side only. Records whether the port is currently open. Marking the device
+	//	connected again also throws away LED commands queued while it was down, since
+	//	only the latest state (getLedState()) matters to the controller now, and starts
+	//	the heartbeat count over. A gateway's stations are marked along with it.
+	void setConnected(bool _connected);
+
+	//	Called on the render thread after each sendCommand(), so that an I/O thread which
+	//	sleeps until there is work can be woken up. A gateway passes it on to its stations.
+	void setCommandListener(std::function<void()> _listener);
+
+	//	Every byte received and sent is also appended to _recorder as device _index.
+	//	Must be set before the port starts being serviced. A gateway's traffic is recorded
+	//	as that of one of its stations, which replays it through the gateway again.
+	void setRecorder(TrafficRecorder* _recorder, uint8_t _index);
+
+	//	I/O side only. Records bytes that were written to the port, and the LED latency of
+	//	each command encoded into them, for a gateway's stations too.
+	void recordSent(const unsigned char* _data, size_t _length);
+
+private:
+	SpscRing<DeviceEvent, INTERACTIVE_DEVICE_RING_SIZE> events;
+	SpscRing<char, INTERACTIVE_DEVICE_RING_SIZE> commands;
+	std::thread io_thread;
+	std::atomic<bool> io_running;
+	std::function<void()> command_listener;
+	TrafficRecorder* recorder;
+	uint8_t recorder_index;
+
+	std::atomic<bool> connected;
+	std::atomic<bool> reconnect_requested;
+	std::atomic<char> led_state;
+	ReconnectBackoff backoff;
+
+	//	Timed work on the I/O thread, such as the next reconnect attempt. Only used by
+	//	the device's own I/O thread; the SerialReactor keeps its own wheel.
+	TimerWheel timers;
+	Timer reconnect_timer;
+	Timer heartbeat_timer;
+
+	//	Heartbeat state, I/O side only.
+	int heartbeat_ms;
+	int heartbeat_misses;
+	unsigned char ping_sequence;
+	bool ping_outstanding;
+	uint64_t ping_sent_us;
+
+	//	I/O side only. led_pending_us as it was when this device's LED command was last
+	//	encoded for writing, or 0, so that a write only times the commands it carries.
+	uint64_t led_encoded_us;
+
+	FrameParser parser;
+	PacketParser packet_parser;
+	std::atomic<int> protocol_version;
+	uint8_t send_sequence;
+	unsigned char read_buffer[INTERACTIVE_DEVICE_READ_CHUNK];
+	std::atomic<unsigned long> foreign_frames;
+	unsigned long reported_oversize_frames;
+	bool reported_foreign_id;
+
+	//	Fixed once the port starts being serviced. routes has an entry for each ID, NULL
+	//	unless a station has it, and is only allocated for a gateway.
+	InteractiveDevice* gateway;
+	std::vector<InteractiveDevice*> stations;
+	std::vector<InteractiveDevice*> routes;
+
+	//	The device's own I/O thread writes from here, with room for a round of LED
+	//	commands and a round of pings.
+	std::vector<unsigned char> write_buffer;
+
+	void ioThreadLoop();
+	void markDisconnected(const char* _reason, bool _retry_now);
+	void tryReconnect();
+	void writeLedState();
+	void sendHeartbeat();
+	void handlePong(unsigned char _sequence);
+	void getStateFromSerial();
+	void handleFrame(const Frame& _frame);
+	void handleRestartedFrame(const Frame& _frame);
+	void handlePacket(const Packet& _packet);
+	void countForeignFrame(unsigned char _id);
+	void pushEvent(bool _state);
+	bool sendsPackets() const;
+	void recordLedLatency();
+	size_t encodeMessage(uint8_t _type, unsigned char _payload, unsigned char* _out);
+	void writePendingCommands(bool _with_ping = false);
+};
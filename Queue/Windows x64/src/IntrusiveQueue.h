@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+//	Links an object into an IntrusiveQueue. An object that can be queued carries one of
+//	these as a public member named queue_hook, so membership, insertion and removal
+//	never have to search or allocate.
+template <typename T>
+struct QueueHook
+{
+	T* prev = NULL;
+	T* next = NULL;
+	bool linked = false;
+};
+
+//	Doubly linked FIFO threaded through the queued objects themselves. Every operation
+//	is O(1): contains(), push(), pop(), remove() of any entry, and head().
+//
+//	Whenever the head of the queue changes, the head-changed listener is called with the
+//	old and new head (either may be NULL), so callers react to the change directly
+//	instead of comparing the head before and after every mutation.
+template <typename T>
+class IntrusiveQueue
+{
+public:
+	typedef std::function<void(T* _previous_head, T* _new_head)> HeadChangedListener;
+
+	IntrusiveQueue() : first(NULL), last(NULL), count(0) {}
+
+	void setHeadChangedListener(HeadChangedListener _listener)
+	{
+		head_changed = _listener;
+	}
+
+	bool contains(const T* _item) const
+	{
+		return _item->queue_hook.linked;
+	}
+
+	T* head() const { return first; }
+	T* next(const T* _item) const { return _item->queue_hook.next; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//	Returns false if the item was already queued.
+	bool push(T* _item)
+	{
+		if (contains(_item))
+		{
+			return false;
+		}
+
+		_item->queue_hook.prev = last;
+		_item->queue_hook.next = NULL;
+		_item->queue_hook.linked = true;
+
+		if (last != NULL)
+		{
+			last->queue_hook.next = _item;
+		}
+		last = _item;
+		count++;
+
+		if (first == NULL)
+		{
+			first = _item;
+			notifyHeadChanged(NULL, first);
+		}
+
+		return true;
+	}
+
+	T* pop()
+	{
+		T* item = first;
+		if (item != NULL)
+		{
+			remove(item);
+		}
+		return item;
+	}
+
+	//	Returns false if the item wasn't queued.
+	bool remove(T* _item)
+	{
+		if (!contains(_item))
+		{
+			return false;
+		}
+
+		QueueHook<T>& hook = _item->queue_hook;
+		bool was_head = (_item == first);
+
+		if (hook.prev != NULL)
+		{
+			hook.prev->queue_hook.next = hook.next;
+		}
+		else
+		{
+			first = hook.next;
+		}
+
+		if (hook.next != NULL)
+		{
+			hook.next->queue_hook.prev = hook.prev;
+		}
+		else
+		{
+			last = hook.prev;
+		}
+
+		hook.prev = NULL;
+		hook.next = NULL;
+		hook.linked = false;
+		count--;
+
+		if (was_head)
+		{
+			notifyHeadChanged(_item, first);
+		}
+
+		return true;
+	}
+
+	//	Unlinks everything without firing the listener, e.g. on shutdown.
+	void clear()
+	{
+		while (first != NULL)
+		{
+			T* item = first;
+			first = item->queue_hook.next;
+			item->queue_hook = QueueHook<T>();
+		}
+
+		last = NULL;
+		count = 0;
+	}
+
+private:
+	T* first;
+	T* last;
+	size_t count;
+	HeadChangedListener head_changed;
+
+	void notifyHeadChanged(T* _previous_head, T* _new_head)
+	{
+		if (head_changed)
+		{
+			head_changed(_previous_head, _new_head);
+		}
+	}
+};
@@ -0,0 +1,112 @@
+
+#include "LatencyHistogram.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int highestBit(uint64_t _value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, _value);
+	return (int)index;
+#else
+	return 63 - __builtin_clzll(_value);
+#endif
+}
+
+LatencyHistogram::LatencyHistogram()
+	: total_count(0), total_us(0), max_us(0)
+{
+	for (auto& count : counts)
+	{
+		count.store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Values below LATENCY_HISTOGRAM_SUB_BUCKETS get a bucket each. Above that, the value's
+ * highest bit picks the power of two range and the next SUB_BUCKET_BITS - 1 bits pick
+ * the bucket within it.
+ */
+size_t LatencyHistogram::bucketOf(uint64_t _latency_us)
+{
+	const uint64_t limit = ((uint64_t)1 << LATENCY_HISTOGRAM_MAX_BITS) - 1;
+	uint64_t value = (_latency_us < limit) ? _latency_us : limit;
+
+	int range = highestBit(value | (LATENCY_HISTOGRAM_SUB_BUCKETS - 1)) + 1 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	return (size_t)range * LATENCY_HISTOGRAM_HALF_BUCKETS + (size_t)(value >> range);
+}
+
+uint64_t LatencyHistogram::bucketTop(size_t _bucket)
+{
+	if (_bucket < LATENCY_HISTOGRAM_SUB_BUCKETS)
+	{
+		return _bucket;
+	}
+
+	int range = (int)(_bucket / LATENCY_HISTOGRAM_HALF_BUCKETS) - 1;
+	uint64_t sub_bucket = (_bucket % LATENCY_HISTOGRAM_HALF_BUCKETS) + LATENCY_HISTOGRAM_HALF_BUCKETS;
+	return ((sub_bucket + 1) << range) - 1;
+}
+
+void LatencyHistogram::record(uint64_t _latency_us)
+{
+	counts[bucketOf(_latency_us)].fetch_add(1, std::memory_order_relaxed);
+	total_count.fetch_add(1, std::memory_order_relaxed);
+	total_us.fetch_add(_latency_us, std::memory_order_relaxed);
+
+	uint64_t previous_max = max_us.load(std::memory_order_relaxed);
+	while ((_latency_us > previous_max) && !max_us.compare_exchange_weak(previous_max, _latency_us, std::memory_order_relaxed))
+	{
+	}
+}
+
+LatencySummary LatencyHistogram::summarize() const
+{
+	LatencySummary summary = {};
+	uint32_t snapshot[LATENCY_HISTOGRAM_BUCKETS];
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		snapshot[i] = counts[i].load(std::memory_order_relaxed);
+		count += snapshot[i];
+	}
+
+	if (count == 0)
+	{
+		return summary;
+	}
+
+	uint64_t max = max_us.load(std::memory_order_relaxed);
+	const double percentiles[] = { 50, 90, 99, 99.9 };
+	double* results[] = { &summary.p50_ms, &summary.p90_ms, &summary.p99_ms, &summary.p999_ms };
+
+	size_t bucket = 0;
+	uint64_t seen = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		uint64_t wanted = (uint64_t)(percentiles[i] / 100.0 * count + 0.5);
+		if (wanted < 1)
+		{
+			wanted = 1;
+		}
+
+		while ((seen + snapshot[bucket] < wanted) && (bucket + 1 < LATENCY_HISTOGRAM_BUCKETS))
+		{
+			seen += snapshot[bucket];
+			bucket++;
+		}
+
+		uint64_t top = bucketTop(bucket);
+		*results[i] = ((top < max) ? top : max) / 1000.0;
+	}
+
+	summary.count = count;
+	summary.mean_ms = (total_us.load(std::memory_order_relaxed) / 1000.0) / count;
+	summary.max_ms = max / 1000.0;
+	return summary;
+}
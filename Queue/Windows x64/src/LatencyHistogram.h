@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//	Each power of two range of values is split into 2^(SUB_BUCKET_BITS - 1) linear
+//	buckets, so any value is recorded to within 1 / 2^(SUB_BUCKET_BITS - 1) of itself
+//	(about 3%). Values from 2^MAX_BITS microseconds (about two minutes) up are counted in
+//	the last bucket.
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 6
+#define LATENCY_HISTOGRAM_MAX_BITS 27
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define LATENCY_HISTOGRAM_HALF_BUCKETS (LATENCY_HISTOGRAM_SUB_BUCKETS / 2)
+#define LATENCY_HISTOGRAM_BUCKETS \
+	((LATENCY_HISTOGRAM_MAX_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 2) * LATENCY_HISTOGRAM_HALF_BUCKETS)
+
+//	Percentiles of a LatencyHistogram in milliseconds, each the top of the bucket it
+//	falls in.
+struct LatencySummary
+{
+	uint64_t count;
+	double mean_ms;
+	double p50_ms;
+	double p90_ms;
+	double p99_ms;
+	double p999_ms;
+	double max_ms;
+};
+
+//	Log-linear (HDR style) histogram of latencies in microseconds. Its memory is fixed
+//	when it is created; record() is a handful of relaxed atomic adds with no locks or
+//	allocation, so it can be called on the render or I/O threads while another thread
+//	summarizes it.
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void record(uint64_t _latency_us);
+
+	//	Approximate while record() is being called, exact otherwise.
+	LatencySummary summarize() const;
+
+private:
+	std::atomic<uint32_t> counts[LATENCY_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> total_count;
+	std::atomic<uint64_t> total_us;
+	std::atomic<uint64_t> max_us;
+
+	static size_t bucketOf(uint64_t _latency_us);
+	static uint64_t bucketTop(size_t _bucket);
+};
+
+//	The stages one trigger of a controller goes through, each timed from when its frame
+//	was read from the port.
+struct StationLatency
+{
+	LatencyHistogram enqueue;		//	The render thread queued the station.
+	LatencyHistogram overlay_start;	//	Its clip was started as the overlay.
+	LatencyHistogram opaque;		//	The overlay finished fading in.
+	LatencyHistogram led;			//	An LED command it caused was written to the port.
+
+	//	Render thread only. When the frame that queued the station was read, while the
+	//	overlay stages are still to come, and 0 otherwise.
+	uint64_t trigger_us = 0;
+
+	//	When the frame behind the LED command waiting to be written was read, or 0. Set
+	//	by the render thread, taken by the I/O side as it encodes the command, and
+	//	recorded once the write carrying it is done.
+	std::atomic<uint64_t> led_pending_us{ 0 };
+};
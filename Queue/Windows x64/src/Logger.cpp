@@ -0,0 +1,397 @@
+
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//	A thread's buffer. Buffers are kept for the life of the process, as with Tracer, so
+//	a record a thread logs just as it exits is never written into freed memory.
+struct LogThread
+{
+	SpscRing<LogRecord, LOG_BUFFER_RECORDS> records;
+};
+
+std::atomic<bool> Logger::running(false);
+std::atomic<uint64_t> Logger::suppressed_total(0);
+
+static std::mutex threads_mutex;
+static std::vector<LogThread*> threads;
+static thread_local LogThread* current_thread = NULL;
+
+static std::mutex writer_mutex;
+static std::condition_variable writer_wake;
+static std::thread writer;
+static bool writer_running = false;
+static bool exit_handler_registered = false;
+
+//	Writer thread only, or under output_mutex while the writer isn't running.
+static std::mutex output_mutex;
+static std::string log_path;
+static std::ofstream file;
+static uint64_t file_bytes = 0;
+static uint64_t dropped_reported = 0;
+
+uint64_t Logger::nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static LogThread* currentThread()
+{
+	if (current_thread == NULL)
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		current_thread = new LogThread();
+		threads.push_back(current_thread);
+	}
+
+	return current_thread;
+}
+
+void Logger::setArg(LogArg& _arg, const char* _value)
+{
+	_arg.type = LogArg::Text;
+
+	if (_value == NULL)
+	{
+		_arg.text[0] = 0;
+		return;
+	}
+
+	size_t length = std::min(strlen(_value), (size_t)LOG_TEXT_ARG_LENGTH - 1);
+	memcpy(_arg.text, _value, length);
+	_arg.text[length] = 0;
+}
+
+/**
+ * Lets up to LOG_SITE_BURST records through per LOG_SITE_WINDOW_MS. Threads racing at
+ * the turn of a window may let a record or two more through, which doesn't matter.
+ */
+bool Logger::admit(LogSite& _site, uint32_t& _suppressed)
+{
+	uint64_t now_us = nowMicros();
+	uint64_t window_start_us = _site.window_start_us.load(std::memory_order_relaxed);
+
+	if ((now_us - window_start_us >= (uint64_t)LOG_SITE_WINDOW_MS * 1000)
+		&& _site.window_start_us.compare_exchange_strong(window_start_us, now_us, std::memory_order_relaxed))
+	{
+		_site.window_count.store(0, std::memory_order_relaxed);
+	}
+
+	if (_site.window_count.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_BURST)
+	{
+		_site.suppressed.fetch_add(1, std::memory_order_relaxed);
+		suppressed_total.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	_suppressed = _site.suppressed.exchange(0, std::memory_order_relaxed);
+	return true;
+}
+
+uint64_t Logger::droppedCount()
+{
+	std::lock_guard<std::mutex> lock(threads_mutex);
+	uint64_t dropped = 0;
+
+	for (auto thread : threads)
+	{
+		dropped += thread->records.droppedCount();
+	}
+
+	return dropped;
+}
+
+static const char* levelName(LogLevel _level)
+{
+	switch (_level)
+	{
+	case LogLevel::Warning:
+		return "warning";
+	case LogLevel::Error:
+		return "error";
+	default:
+		return "info";
+	}
+}
+
+/**
+ * The record's time is taken on the steady clock, which is cheap, and turned into the
+ * time of day here.
+ */
+static std::string formatRecord(const LogRecord& _record)
+{
+	std::ostringstream line;
+
+	auto age = std::chrono::microseconds(Logger::nowMicros() - std::min(_record.time_us, Logger::nowMicros()));
+	auto when = std::chrono::system_clock::now() - age;
+	std::time_t seconds = std::chrono::system_clock::to_time_t(when);
+	int millis = (int)(std::chrono::duration_cast<std::chrono::milliseconds>(when.time_since_epoch()).count() % 1000);
+
+	char stamp[32];
+	std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+	line << stamp << "." << (millis < 100 ? (millis < 10 ? "00" : "0") : "") << millis << " [" << levelName(_record.level) << "] ";
+
+	uint8_t next_arg = 0;
+
+	for (const char* c = _record.format; *c != 0; c++)
+	{
+		if ((c[0] != '{') || (c[1] != '}') || (next_arg >= _record.arg_count))
+		{
+			line << *c;
+			continue;
+		}
+
+		const LogArg& arg = _record.args[next_arg++];
+		c++;
+
+		switch (arg.type)
+		{
+		case LogArg::Signed:
+			line << arg.i;
+			break;
+		case LogArg::Unsigned:
+			line << arg.u;
+			break;
+		case LogArg::Float:
+			line << arg.f;
+			break;
+		case LogArg::Char:
+			line << arg.c;
+			break;
+		case LogArg::Text:
+			line << arg.text;
+			break;
+		}
+	}
+
+	if (_record.suppressed > 0)
+	{
+		line << " (" << _record.suppressed << " more like this were suppressed)";
+	}
+
+	return line.str();
+}
+
+/**
+ * Moves <file>.n to <file>.n+1, dropping the oldest, and the current file to <file>.1,
+ * then starts a new file.
+ */
+static void rotateFile()
+{
+	file.close();
+
+	std::remove((log_path + "." + std::to_string(LOG_FILE_KEEP)).c_str());
+
+	for (int i = LOG_FILE_KEEP - 1; i >= 1; i--)
+	{
+		std::rename((log_path + "." + std::to_string(i)).c_str(), (log_path + "." + std::to_string(i + 1)).c_str());
+	}
+
+	std::rename(log_path.c_str(), (log_path + ".1").c_str());
+
+	file.open(log_path, std::ios::trunc);
+	file_bytes = 0;
+}
+
+static void writeLine(const std::string& _line)
+{
+	std::cout << _line << "\n";
+
+	if (!file.is_open())
+	{
+		return;
+	}
+
+	if (file_bytes + _line.size() + 1 > LOG_FILE_MAX_BYTES)
+	{
+		rotateFile();
+	}
+
+	file << _line << "\n";
+	file_bytes += _line.size() + 1;
+}
+
+/**
+ * Takes every thread's records, oldest first, so lines from different threads come out
+ * in the order they were logged.
+ */
+static void drainThreads(std::vector<LogRecord>& _batch)
+{
+	_batch.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+
+		for (auto thread : threads)
+		{
+			LogRecord record;
+			while (thread->records.pop(record))
+			{
+				_batch.push_back(record);
+			}
+		}
+	}
+
+	std::stable_sort(_batch.begin(), _batch.end(), [](const LogRecord& _a, const LogRecord& _b) { return _a.time_us < _b.time_us; });
+}
+
+/**
+ * Writes a record straight away, for when the writer thread isn't running. A record
+ * pushed just as the writer stopped may have missed its last pass, so if the writer
+ * is found stopped after the push, whatever is still buffered is written from here.
+ */
+void Logger::submit(const LogRecord& _record)
+{
+	std::vector<LogRecord> batch;
+
+	if (isRunning())
+	{
+		currentThread()->records.push(_record);
+
+		//	Pairs with the fence in writerLoop(), so either the writer's last pass sees
+		//	the record or this sees the writer stopped.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (isRunning())
+		{
+			return;
+		}
+
+		drainThreads(batch);
+	}
+	else
+	{
+		batch.push_back(_record);
+	}
+
+	std::lock_guard<std::mutex> lock(output_mutex);
+
+	for (auto& record : batch)
+	{
+		writeLine(formatRecord(record));
+	}
+
+	std::cout.flush();
+	file.flush();
+}
+
+bool Logger::start(const std::string& _path)
+{
+	std::lock_guard<std::mutex> lock(writer_mutex);
+
+	if (writer_running)
+	{
+		return true;
+	}
+
+	bool opened = true;
+
+	{
+		std::lock_guard<std::mutex> output_lock(output_mutex);
+		log_path = _path;
+
+		if (!log_path.empty())
+		{
+			file.open(log_path, std::ios::app);
+			opened = file.is_open();
+			file_bytes = opened ? (uint64_t)file.tellp() : 0;
+		}
+	}
+
+	if (!exit_handler_registered)
+	{
+		std::atexit(&Logger::stop);
+		exit_handler_registered = true;
+	}
+
+	writer_running = true;
+	writer = std::thread(&Logger::writerLoop);
+	running.store(true, std::memory_order_release);
+	return opened;
+}
+
+void Logger::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+
+		if (!writer_running)
+		{
+			return;
+		}
+
+		writer_running = false;
+	}
+
+	writer_wake.notify_one();
+	writer.join();
+
+	std::lock_guard<std::mutex> output_lock(output_mutex);
+	file.close();
+}
+
+/**
+ * Drains every thread's buffer each LOG_FLUSH_MS, and reports records dropped since the
+ * last time. Once stopped, new records are written on their own threads, and whatever
+ * is still buffered is written out here.
+ */
+void Logger::writerLoop()
+{
+	std::vector<LogRecord> batch;
+	bool keep_running = true;
+
+	while (keep_running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(writer_mutex);
+			writer_wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_MS), [] { return !writer_running; });
+			keep_running = writer_running;
+		}
+
+		if (!keep_running)
+		{
+			running.store(false, std::memory_order_release);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		drainThreads(batch);
+
+		std::lock_guard<std::mutex> output_lock(output_mutex);
+
+		for (auto& record : batch)
+		{
+			writeLine(formatRecord(record));
+		}
+
+		uint64_t dropped = droppedCount();
+		if (dropped != dropped_reported)
+		{
+			LogRecord record;
+			record.format = "{} log records were dropped, a thread logged faster than they could be written.";
+			record.time_us = nowMicros();
+			record.suppressed = 0;
+			record.level = LogLevel::Warning;
+			record.arg_count = 1;
+			setArg(record.args[0], dropped - dropped_reported);
+
+			writeLine(formatRecord(record));
+			dropped_reported = dropped;
+		}
+
+		std::cout.flush();
+		file.flush();
+	}
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "SpscRing.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+//	Records each thread can have waiting for the logger's writer. A thread that gets
+//	further ahead than this has its newest records dropped, and the drops are counted.
+//	Must be a power of two.
+#define LOG_BUFFER_RECORDS 256
+
+//	How often the writer thread empties the threads' buffers.
+#define LOG_FLUSH_MS 50
+
+//	Values a record carries for its format's "{}" placeholders, and how much of a text
+//	value is kept.
+#define LOG_RECORD_ARGS 4
+#define LOG_TEXT_ARG_LENGTH 128
+
+//	Each place in the code that logs may log this many records per window. The rest are
+//	counted, and the count is written with that place's next record.
+#define LOG_SITE_BURST 50
+#define LOG_SITE_WINDOW_MS 1000
+
+//	The log file is rotated when it reaches this size, keeping this many old files
+//	beside it as <file>.1 (the newest) to <file>.<n>.
+#define LOG_FILE_MAX_BYTES (4 * 1024 * 1024)
+#define LOG_FILE_KEEP 4
+
+enum class LogLevel : uint8_t
+{
+	Info,
+	Warning,
+	Error
+};
+
+//	One place in the code that logs, declared by the LOG_ macros. Keeps the place's rate
+//	limit, shared by every thread that logs from it.
+struct LogSite
+{
+	LogSite(LogLevel _level) : level(_level), window_start_us(0), window_count(0), suppressed(0) {}
+
+	LogLevel level;
+	std::atomic<uint64_t> window_start_us;
+	std::atomic<uint32_t> window_count;
+	std::atomic<uint32_t> suppressed;
+};
+
+//	A value for one placeholder. Text is copied, cut short at LOG_TEXT_ARG_LENGTH - 1
+//	characters, so a record never points at memory its thread might free.
+struct LogArg
+{
+	enum Type : uint8_t
+	{
+		Signed,
+		Unsigned,
+		Float,
+		Char,
+		Text
+	};
+
+	Type type;
+
+	union
+	{
+		int64_t i;
+		uint64_t u;
+		double f;
+		char c;
+		char text[LOG_TEXT_ARG_LENGTH];
+	};
+};
+
+//	One log line, before formatting. format must be a string literal.
+struct LogRecord
+{
+	const char* format;
+	uint64_t time_us;
+	uint32_t suppressed;
+	LogLevel level;
+	uint8_t arg_count;
+	LogArg args[LOG_RECORD_ARGS];
+};
+
+//	Asynchronous logging to the console and a rotating file. A thread that logs only
+//	copies a fixed-size record into its own lock-free buffer, the first time it logs
+//	getting one, and the writer thread formats and writes everything, so a slow console
+//	never holds up the render thread or a device's I/O thread.
+//
+//	Until start() and after stop(), records are formatted and printed on the calling
+//	thread instead, so nothing logged around startup or shutdown is lost.
+//
+//	Process-wide, like Tracer, so every module can log without being handed a logger.
+class Logger
+{
+public:
+	//	Starts the writer thread. Lines go to the console, and to _path if it isn't empty
+	//	and can be opened for appending. Returns false if the file couldn't be opened.
+	static bool start(const std::string& _path);
+
+	//	Writes out everything still buffered and stops the writer thread. Also called at
+	//	process exit, so a fatal error logged just before exit() is still written.
+	static void stop();
+
+	static bool isRunning() { return running.load(std::memory_order_acquire); }
+
+	//	Records lost to full buffers, and records held back by their site's rate limit.
+	static uint64_t droppedCount();
+	static uint64_t suppressedCount() { return suppressed_total.load(std::memory_order_relaxed); }
+
+	//	Use the LOG_ macros rather than calling this directly. Each "{}" in _format is
+	//	replaced by the next argument: an integer, a floating point number, a char, or
+	//	text as a C string or std::string.
+	template <typename... Args>
+	static void write(LogSite& _site, const char* _format, const Args&... _args)
+	{
+		static_assert(sizeof...(Args) <= LOG_RECORD_ARGS, "Too many values for one log record, see LOG_RECORD_ARGS.");
+
+		uint32_t suppressed;
+		if (!admit(_site, suppressed))
+		{
+			return;
+		}
+
+		LogRecord record;
+		record.format = _format;
+		record.time_us = nowMicros();
+		record.suppressed = suppressed;
+		record.level = _site.level;
+		record.arg_count = 0;
+
+		int unused[] = { 0, (setArg(record.args[record.arg_count++], _args), 0)... };
+		(void)unused;
+
+		submit(record);
+	}
+
+	static uint64_t nowMicros();
+
+private:
+	static std::atomic<bool> running;
+	static std::atomic<uint64_t> suppressed_total;
+
+	static bool admit(LogSite& _site, uint32_t& _suppressed);
+	static void submit(const LogRecord& _record);
+	static void writerLoop();
+
+	static void setArg(LogArg& _arg, char _value) { _arg.type = LogArg::Char; _arg.c = _value; }
+	static void setArg(LogArg& _arg, const char* _value);
+	static void setArg(LogArg& _arg, const std::string& _value) { setArg(_arg, _value.c_str()); }
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type setArg(LogArg& _arg, T _value)
+	{
+		_arg.type = LogArg::Signed;
+		_arg.i = (int64_t)_value;
+	}
+
+	template <typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type setArg(LogArg& _arg, T _value)
+	{
+		_arg.type = LogArg::Unsigned;
+		_arg.u = (uint64_t)_value;
+	}
+
+	template <typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type setArg(LogArg& _arg, T _value)
+	{
+		_arg.type = LogArg::Float;
+		_arg.f = (double)_value;
+	}
+};
+
+//	LOG_INFO("Serial port {} opened.", port) and so on. Each use is its own LogSite, with
+//	its own rate limit.
+#define LOG_INFO(...) do { static LogSite log_site(LogLevel::Info); Logger::write(log_site, __VA_ARGS__); } while (0)
+#define LOG_WARNING(...) do { static LogSite log_site(LogLevel::Warning); Logger::write(log_site, __VA_ARGS__); } while (0)
+#define LOG_ERROR(...) do { static LogSite log_site(LogLevel::Error); Logger::write(log_site, __VA_ARGS__); } while (0)
@@ -0,0 +1,191 @@
+
+#include "MetricsServer.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#define closeSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+#include <cstring>
+
+//	A client hanging up mid-response mustn't raise SIGPIPE and end the app.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+MetricsServer::MetricsServer()
+	: running(false), listen_socket((intptr_t)INVALID_SOCKET)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+	stop();
+}
+
+bool MetricsServer::start(int _port, std::function<std::string()> _report)
+{
+	if (running)
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+	{
+		return false;
+	}
+#endif
+
+	socket_t server = socket(AF_INET, SOCK_STREAM, 0);
+	if (server == INVALID_SOCKET)
+	{
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	//	Only reachable from the player machine itself.
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((unsigned short)_port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if ((bind(server, (sockaddr*)&address, sizeof(address)) != 0) || (listen(server, 4) != 0))
+	{
+		closeSocket(server);
+		return false;
+	}
+
+	report = _report;
+	listen_socket = (intptr_t)server;
+	running = true;
+	thread = std::thread(&MetricsServer::serveLoop, this);
+	return true;
+}
+
+void MetricsServer::stop()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	running = false;
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+
+	closeSocket((socket_t)listen_socket);
+	listen_socket = (intptr_t)INVALID_SOCKET;
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void MetricsServer::serveLoop()
+{
+	socket_t server = (socket_t)listen_socket;
+
+	while (running)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(server, &readable);
+
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = METRICS_SERVER_POLL_MS * 1000;
+
+		if (select((int)server + 1, &readable, NULL, NULL, &timeout) <= 0)
+		{
+			continue;
+		}
+
+		socket_t client = accept(server, NULL, NULL);
+		if (client != INVALID_SOCKET)
+		{
+			serveClient((intptr_t)client);
+			closeSocket(client);
+		}
+	}
+}
+
+/**
+ * Reads until the end of the request headers, then answers GET with the report and
+ * anything else with 405. One request per connection.
+ */
+void MetricsServer::serveClient(intptr_t _client)
+{
+	socket_t client = (socket_t)_client;
+	std::string request;
+	char buffer[512];
+
+	//	A client that connects and sends nothing is given up on after a second, so it
+	//	can't hold the server up.
+#ifdef _WIN32
+	DWORD receive_timeout = 1000;
+#else
+	timeval receive_timeout;
+	receive_timeout.tv_sec = 1;
+	receive_timeout.tv_usec = 0;
+#endif
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&receive_timeout, sizeof(receive_timeout));
+
+	while ((request.find("\r\n\r\n") == std::string::npos) && (request.size() < METRICS_SERVER_REQUEST_LIMIT))
+	{
+		int received = (int)recv(client, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+		{
+			return;
+		}
+		request.append(buffer, received);
+	}
+
+	std::string status = "200 OK";
+	std::string body;
+
+	if (request.compare(0, 4, "GET ") == 0)
+	{
+		body = report();
+	}
+	else
+	{
+		status = "405 Method Not Allowed";
+	}
+
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"Connection: close\r\n\r\n" + body;
+
+	size_t sent = 0;
+	while (sent < response.size())
+	{
+		int written = (int)send(client, response.data() + sent, (int)(response.size() - sent), MSG_NOSIGNAL);
+		if (written <= 0)
+		{
+			return;
+		}
+		sent += written;
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+//	How long the server's thread waits for a connection before checking whether it has
+//	been stopped.
+#define METRICS_SERVER_POLL_MS 100
+
+//	Largest request the server will read before answering.
+#define METRICS_SERVER_REQUEST_LIMIT 4096
+
+//	Minimal HTTP server on 127.0.0.1 for the app's live metrics. It answers every GET
+//	with whatever the report function returns, as JSON, on its own thread, so a client
+//	polling it never touches the render thread. The report function must only read
+//	state that is safe to read from another thread.
+class MetricsServer
+{
+public:
+	MetricsServer();
+	~MetricsServer();
+
+	//	Listens on _port and starts the server's thread. Returns false if the port
+	//	can't be bound.
+	bool start(int _port, std::function<std::string()> _report);
+	void stop();
+
+	bool isRunning() const { return running.load(std::memory_order_relaxed); }
+
+private:
+	std::function<std::string()> report;
+	std::thread thread;
+	std::atomic<bool> running;
+	intptr_t listen_socket;
+
+	void serveLoop();
+	void serveClient(intptr_t _client);
+};
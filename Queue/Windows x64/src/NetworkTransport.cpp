@@ -0,0 +1,428 @@
+
+#include "NetworkTransport.h"
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET socket_t;
+typedef int socklen_t;
+#define closeSocket closesocket
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closeSocket ::close
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+//	A controller hanging up mid-write mustn't raise SIGPIPE and end the app.
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static uint64_t nowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool setNonBlocking(socket_t _socket)
+{
+#ifdef _WIN32
+	u_long non_blocking = 1;
+	return ioctlsocket(_socket, FIONBIO, &non_blocking) == 0;
+#else
+	int flags = fcntl(_socket, F_GETFL, 0);
+	return (flags >= 0) && (fcntl(_socket, F_SETFL, flags | O_NONBLOCK) == 0);
+#endif
+}
+
+/**
+ * Whether the last socket call failed only because it would have had to wait. On
+ * Windows a UDP socket also reports the ICMP "port unreachable" of an earlier send to
+ * a controller that has gone as WSAECONNRESET on the next read, which is no failure of
+ * the socket either.
+ */
+static bool wouldBlock()
+{
+#ifdef _WIN32
+	int error = WSAGetLastError();
+	return (error == WSAEWOULDBLOCK) || (error == WSAECONNRESET);
+#else
+	return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+#endif
+}
+
+NetworkTransport::NetworkTransport(const std::string& _address)
+	: address(_address), tcp(false), port(0), socket_handle((intptr_t)INVALID_SOCKET), client_handle((intptr_t)INVALID_SOCKET), started_winsock(false), arrived(false),
+	datagram_length(0), datagram_read(0)
+{
+	parseAddress(_address, tcp, host, port);
+}
+
+NetworkTransport::~NetworkTransport()
+{
+	close();
+}
+
+bool NetworkTransport::isAddress(const std::string& _port)
+{
+	return (_port.compare(0, 6, "udp://") == 0) || (_port.compare(0, 6, "tcp://") == 0);
+}
+
+bool NetworkTransport::parseAddress(const std::string& _address, bool& _tcp, std::string& _host, int& _port)
+{
+	if (!isAddress(_address))
+	{
+		return false;
+	}
+
+	size_t colon = _address.rfind(':');
+	if ((colon == std::string::npos) || (colon < 6))
+	{
+		return false;
+	}
+
+	std::string port_s = _address.substr(colon + 1);
+	if (port_s.empty() || (port_s.find_first_not_of("0123456789") != std::string::npos))
+	{
+		return false;
+	}
+
+	int port_number = atoi(port_s.c_str());
+	if ((port_number < 1) || (port_number > 65535))
+	{
+		return false;
+	}
+
+	in_addr parsed;
+	std::string host_s = _address.substr(6, colon - 6);
+	if (inet_pton(AF_INET, host_s.c_str(), &parsed) != 1)
+	{
+		return false;
+	}
+
+	_tcp = (_address.compare(0, 6, "tcp://") == 0);
+	_host = host_s;
+	_port = port_number;
+	return true;
+}
+
+bool NetworkTransport::open()
+{
+	close();
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+	{
+		return false;
+	}
+	started_winsock = true;
+#endif
+
+	socket_t server = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+	if (server == INVALID_SOCKET)
+	{
+		close();
+		return false;
+	}
+
+	socket_handle = (intptr_t)server;
+
+	int reuse = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in bound;
+	memset(&bound, 0, sizeof(bound));
+	bound.sin_family = AF_INET;
+	bound.sin_port = htons((unsigned short)port);
+	inet_pton(AF_INET, host.c_str(), &bound.sin_addr);
+
+	if ((bind(server, (sockaddr*)&bound, sizeof(bound)) != 0) || (tcp && (listen(server, 4) != 0)) || !setNonBlocking(server))
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void NetworkTransport::close()
+{
+	closeClient();
+
+	if ((socket_t)socket_handle != INVALID_SOCKET)
+	{
+		closeSocket((socket_t)socket_handle);
+		socket_handle = (intptr_t)INVALID_SOCKET;
+	}
+
+	peers.clear();
+	datagram_length = 0;
+	datagram_read = 0;
+
+#ifdef _WIN32
+	if (started_winsock)
+	{
+		WSACleanup();
+		started_winsock = false;
+	}
+#endif
+}
+
+long NetworkTransport::read(unsigned char* _data, size_t _length)
+{
+	if ((socket_t)socket_handle == INVALID_SOCKET)
+	{
+		return -1;
+	}
+
+	return tcp ? readStream(_data, _length) : readDatagram(_data, _length);
+}
+
+/**
+ * One datagram per read, or as much of it as fits, the rest going to the reads after.
+ * Its sender is remembered, so it is written to from then on.
+ */
+long NetworkTransport::readDatagram(unsigned char* _data, size_t _length)
+{
+	if (datagram_read == datagram_length)
+	{
+		sockaddr_in sender;
+		socklen_t sender_length = sizeof(sender);
+
+		int received = (int)recvfrom((socket_t)socket_handle, (char*)datagram, sizeof(datagram), 0, (sockaddr*)&sender, &sender_length);
+
+		if (received < 0)
+		{
+			return wouldBlock() ? 0 : -1;
+		}
+
+		notePeer((const unsigned char*)&sender, sender_length);
+		datagram_length = (size_t)received;
+		datagram_read = 0;
+	}
+
+	size_t length = std::min(datagram_length - datagram_read, _length);
+	memcpy(_data, datagram + datagram_read, length);
+	datagram_read += length;
+	return (long)length;
+}
+
+/**
+ * A controller that hangs up, or whose connection fails, only loses its connection. The
+ * address stays bound for the next one.
+ */
+long NetworkTransport::readStream(unsigned char* _data, size_t _length)
+{
+	acceptClient();
+
+	if (((socket_t)client_handle == INVALID_SOCKET) || !flushUnsent())
+	{
+		return 0;
+	}
+
+	int received = (int)recv((socket_t)client_handle, (char*)_data, (int)_length, 0);
+
+	if (received > 0)
+	{
+		return received;
+	}
+
+	if ((received < 0) && wouldBlock())
+	{
+		return 0;
+	}
+
+	LOG_INFO("Controller connection to {} closed.", address);
+	closeClient();
+	return 0;
+}
+
+void NetworkTransport::acceptClient()
+{
+	socket_t client = accept((socket_t)socket_handle, NULL, NULL);
+
+	if (client == INVALID_SOCKET)
+	{
+		return;
+	}
+
+	if ((socket_t)client_handle != INVALID_SOCKET)
+	{
+		LOG_INFO("New controller connection to {}, the previous one is closed.", address);
+	}
+	else
+	{
+		LOG_INFO("Controller connected to {}.", address);
+	}
+
+	closeClient();
+	setNonBlocking(client);
+
+	//	Every write is a handful of small packets that should go out straight away.
+	int no_delay = 1;
+	setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+	client_handle = (intptr_t)client;
+	arrived = true;
+}
+
+void NetworkTransport::closeClient()
+{
+	if ((socket_t)client_handle != INVALID_SOCKET)
+	{
+		closeSocket((socket_t)client_handle);
+		client_handle = (intptr_t)INVALID_SOCKET;
+	}
+
+	unsent.clear();
+}
+
+/**
+ * Sends as much of what is held as the connection takes without waiting. Returns false
+ * if the connection failed and was closed.
+ */
+bool NetworkTransport::flushUnsent()
+{
+	size_t sent = 0;
+
+	while (sent < unsent.size())
+	{
+		int written = (int)send((socket_t)client_handle, (const char*)unsent.data() + sent, (int)(unsent.size() - sent), MSG_NOSIGNAL);
+
+		if (written > 0)
+		{
+			sent += written;
+			continue;
+		}
+
+		if ((written < 0) && wouldBlock())
+		{
+			break;
+		}
+
+		LOG_WARNING("Write to the controller on {} failed, its connection is closed.", address);
+		closeClient();
+		return false;
+	}
+
+	unsent.erase(unsent.begin(), unsent.begin() + sent);
+	return true;
+}
+
+void NetworkTransport::notePeer(const unsigned char* _address, size_t _length)
+{
+	uint64_t now = nowMillis();
+
+	for (auto& peer : peers)
+	{
+		if ((peer.address.size() == _length) && (memcmp(peer.address.data(), _address, _length) == 0))
+		{
+			peer.heard_ms = now;
+			return;
+		}
+	}
+
+	if (peers.size() < NETWORK_TRANSPORT_PEER_LIMIT)
+	{
+		peers.push_back({ std::vector<unsigned char>(_address, _address + _length), now });
+		arrived = true;
+	}
+}
+
+bool NetworkTransport::takeArrival()
+{
+	bool taken = arrived;
+	arrived = false;
+	return taken;
+}
+
+/**
+ * Nothing to write to isn't a failure, the LED state is written again once a
+ * controller turns up (see takeArrival()). Over TCP, whatever a full send buffer won't
+ * take yet is held and sent on the next read or write, so a slow link only delays the
+ * LED commands. A connection that fails, or falls NETWORK_TRANSPORT_UNSENT_LIMIT bytes
+ * behind, is closed rather than the address, and the next one is sent the LED state.
+ */
+long NetworkTransport::write(const unsigned char* _data, size_t _length)
+{
+	if ((socket_t)socket_handle == INVALID_SOCKET)
+	{
+		return -1;
+	}
+
+	if (!tcp)
+	{
+		uint64_t now = nowMillis();
+
+		peers.erase(std::remove_if(peers.begin(), peers.end(),
+			[now](const Peer& _peer) { return now - _peer.heard_ms > NETWORK_TRANSPORT_PEER_TIMEOUT_MS; }), peers.end());
+
+		for (auto& peer : peers)
+		{
+			sendto((socket_t)socket_handle, (const char*)_data, (int)_length, 0, (const sockaddr*)peer.address.data(), (socklen_t)peer.address.size());
+		}
+
+		return (long)_length;
+	}
+
+	acceptClient();
+
+	if ((socket_t)client_handle == INVALID_SOCKET)
+	{
+		return (long)_length;
+	}
+
+	if (unsent.size() + _length > NETWORK_TRANSPORT_UNSENT_LIMIT)
+	{
+		LOG_WARNING("The controller on {} isn't taking what is written to it, its connection is closed.", address);
+		closeClient();
+		return (long)_length;
+	}
+
+	unsent.insert(unsent.end(), _data, _data + _length);
+	flushUnsent();
+	return (long)_length;
+}
+
+void NetworkTransport::wait(int _timeout_ms)
+{
+	if ((socket_t)socket_handle == INVALID_SOCKET)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(_timeout_ms));
+		return;
+	}
+
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET((socket_t)socket_handle, &readable);
+	socket_t highest = (socket_t)socket_handle;
+
+	if ((socket_t)client_handle != INVALID_SOCKET)
+	{
+		FD_SET((socket_t)client_handle, &readable);
+		highest = std::max(highest, (socket_t)client_handle);
+	}
+
+	timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = _timeout_ms * 1000;
+
+	select((int)highest + 1, &readable, NULL, NULL, &timeout);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "ControllerTransport.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//	Largest UDP datagram read from a controller. Anything longer is cut short. A datagram
+//	longer than a read asks for is handed out over as many reads as it takes.
+#define NETWORK_TRANSPORT_DATAGRAM_LIMIT 512
+
+//	Controllers heard from over UDP are sent to until they have been silent this long.
+//	Several heartbeat intervals, so a controller that misses a ping or two isn't lost.
+#define NETWORK_TRANSPORT_PEER_TIMEOUT_MS 10000
+
+//	Most controllers one UDP address sends to. Beyond that, new ones are only read from.
+#define NETWORK_TRANSPORT_PEER_LIMIT 128
+
+//	Most bytes held for a TCP connection whose send buffer is full. Beyond that, the
+//	connection is taken to be stuck and is closed.
+#define NETWORK_TRANSPORT_UNSENT_LIMIT 4096
+
+//	Controllers on the network, at an address given in config.json as udp://host:port or
+//	tcp://host:port, host being the local address to listen on, 0.0.0.0 for all of them
+//	or 127.0.0.1 to test over loopback. The same frames are accepted as over serial, and
+//	the controllers on one address are told apart by their ID, as on a shared serial
+//	port (see InteractiveDevice).
+//
+//	Over UDP, any number of controllers send to the address, each datagram carrying
+//	whole frames. Whatever is written goes to every controller heard from lately, which
+//	ignores the packets addressed to others, just as a serial hub would pass them on.
+//
+//	Over TCP, one connection is served at a time: a controller of its own, or a bridge
+//	relaying for several. A new connection takes over from the old one, so a bridge that
+//	restarts is back without waiting for the old connection to time out.
+//
+//	The port counts as open while the address is bound, whether or not any controller
+//	is there; heartbeats tell whether one is.
+class NetworkTransport : public ControllerTransport
+{
+public:
+	explicit NetworkTransport(const std::string& _address);
+	~NetworkTransport();
+
+	//	Whether _port names a network address rather than a serial port.
+	static bool isAddress(const std::string& _port);
+
+	//	Splits udp://host:port or tcp://host:port up. Returns false if _address isn't one.
+	static bool parseAddress(const std::string& _address, bool& _tcp, std::string& _host, int& _port);
+
+	bool open() override;
+	void close() override;
+	long read(unsigned char* _data, size_t _length) override;
+	long write(const unsigned char* _data, size_t _length) override;
+	void wait(int _timeout_ms) override;
+	bool takeArrival() override;
+
+private:
+	struct Peer
+	{
+		std::vector<unsigned char> address;
+		uint64_t heard_ms;
+	};
+
+	std::string address;
+	bool tcp;
+	std::string host;
+	int port;
+
+	//	Sockets are held as intptr_t, as in MetricsServer, so winsock stays out of the
+	//	header.
+	intptr_t socket_handle;
+	intptr_t client_handle;
+	bool started_winsock;
+	bool arrived;
+
+	std::vector<Peer> peers;
+
+	//	The datagram being read, and how much of it has been handed out so far.
+	unsigned char datagram[NETWORK_TRANSPORT_DATAGRAM_LIMIT];
+	size_t datagram_length;
+	size_t datagram_read;
+
+	//	What a TCP write couldn't send yet, sent ahead of anything written after it.
+	std::vector<unsigned char> unsent;
+
+	void acceptClient();
+	void closeClient();
+	bool flushUnsent();
+	void notePeer(const unsigned char* _address, size_t _length);
+	long readDatagram(unsigned char* _data, size_t _length);
+	long readStream(unsigned char* _data, size_t _length);
+};
@@ -0,0 +1,114 @@
+
+#include "OverlayPreroller.h"
+
+bool OverlayPreroller::isTarget(ofVideoPlayer* _player, const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current, QueueStation* _outgoing) const
+{
+	int depth = 0;
+
+	for (QueueStation* i = _queue.head(); i != NULL; i = _queue.next(i))
+	{
+		if ((i == _current) || (i == _outgoing))
+		{
+			continue;
+		}
+
+		if (depth++ >= OVERLAY_PREROLL_DEPTH)
+		{
+			return false;
+		}
+
+		if (static_cast<InteractiveDevice*>(i)->video == _player)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+OverlayPreroller::Slot* OverlayPreroller::find(ofVideoPlayer* _player)
+{
+	for (auto& slot : slots)
+	{
+		if (slot.player == _player)
+		{
+			return &slot;
+		}
+	}
+
+	return NULL;
+}
+
+void OverlayPreroller::update(const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current, QueueStation* _outgoing)
+{
+	//	Release clips that were dequeued, or pushed back past the preroll depth.
+	for (size_t i = 0; i < slots.size();)
+	{
+		if (!isTarget(slots[i].player, _queue, _current, _outgoing))
+		{
+			slots[i].player->setPaused(true);
+			slots.erase(slots.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	int depth = 0;
+
+	for (QueueStation* station = _queue.head(); (station != NULL) && (depth < OVERLAY_PREROLL_DEPTH); station = _queue.next(station))
+	{
+		if ((station == _current) || (station == _outgoing))
+		{
+			continue;
+		}
+
+		depth++;
+
+		ofVideoPlayer* player = static_cast<InteractiveDevice*>(station)->video;
+		if ((player == NULL) || !player->isLoaded())
+		{
+			continue;
+		}
+
+		Slot* slot = find(player);
+
+		if (slot == NULL)
+		{
+			//	play() then pause gets the decoder running without advancing, and
+			//	firstFrame() seeks it to frame 0 so that frame is what gets decoded.
+			player->setLoopState(OF_LOOP_NONE);
+			player->play();
+			player->setPaused(true);
+			player->firstFrame();
+
+			Slot new_slot;
+			new_slot.player = player;
+			new_slot.ready = false;
+			slots.push_back(new_slot);
+			slot = &slots.back();
+		}
+
+		if (!slot->ready)
+		{
+			player->update();
+			slot->ready = player->isFrameNew();
+		}
+	}
+}
+
+bool OverlayPreroller::take(ofVideoPlayer* _player)
+{
+	for (size_t i = 0; i < slots.size(); i++)
+	{
+		if (slots[i].player == _player)
+		{
+			bool ready = slots[i].ready;
+			slots.erase(slots.begin() + i);
+			return ready;
+		}
+	}
+
+	return false;
+}
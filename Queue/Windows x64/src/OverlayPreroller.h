@@ -0,0 +1,41 @@
+#pragma once
+
+#include "ofMain.h"
+#include "InteractiveDevice.h"
+
+#include <cstdint>
+#include <vector>
+
+//	How many clips past the one currently on screen are kept seeked and decoded.
+#define OVERLAY_PREROLL_DEPTH 2
+
+//	Keeps the next few queued overlays rewound to their first frame, paused, and
+//	decoded, so that starting one is just unpausing a player whose first frame is
+//	already in its texture instead of a cold seek and decoder start.
+class OverlayPreroller
+{
+public:
+	//	Called once per frame on the render thread. Starts prerolling the first
+	//	OVERLAY_PREROLL_DEPTH entries of _queue that aren't _current or _outgoing (a
+	//	station queued again while its clip is still being crossfaded out of), keeps
+	//	updating them until their first frame has arrived, and releases any slot whose
+	//	clip has left the queue. Clips the VideoPool is still opening are skipped until
+	//	loaded. Every station in the app's queue is an InteractiveDevice.
+	void update(const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current, QueueStation* _outgoing);
+
+	//	Hands a player over to be started. Returns true if it was prerolled and its first
+	//	frame is ready to draw, false if the caller has to rewind it itself.
+	bool take(ofVideoPlayer* _player);
+
+private:
+	struct Slot
+	{
+		ofVideoPlayer* player;
+		bool ready;
+	};
+
+	std::vector<Slot> slots;
+
+	bool isTarget(ofVideoPlayer* _player, const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current, QueueStation* _outgoing) const;
+	Slot* find(ofVideoPlayer* _player);
+};
@@ -0,0 +1,125 @@
+
+#include "OverlayStateMachine.h"
+
+#include <algorithm>
+
+OverlayStateMachine::OverlayStateMachine()
+	: player(NULL), fade_seconds(0.25f), duration(0), fade_out_begin(0), fade_out_end(0)
+{
+	clear();
+}
+
+void OverlayStateMachine::setup(float _fade_seconds)
+{
+	fade_seconds = _fade_seconds;
+}
+
+/**
+ * The duration is read once here; from then on the only thing asked of the player is
+ * its position, once per tick.
+ */
+void OverlayStateMachine::start(QueuePlayer* _player, bool _crossfade)
+{
+	player = _player;
+	duration = player->getDuration();
+
+	fade_out_end = duration;
+	fade_out_begin = duration - fade_seconds;
+
+	//	Clips shorter than two fades would start fading out before they finished fading
+	//	in, so they fade out straight after the fade in instead.
+	if (fade_out_begin < fade_seconds)
+	{
+		fade_out_begin = fade_seconds;
+		fade_out_end = fade_seconds * 2;
+	}
+
+	//	finished is left alone, since it belongs to the overlay before this one.
+	current.phase = OverlayPhase::FadingIn;
+	current.media_time = 0;
+	current.opacity = (fade_seconds > 0) ? 0.0f : 1.0f;
+	current.crossfading = _crossfade;
+	current.background_due = isBackgroundDue();
+}
+
+bool OverlayStateMachine::requestFadeOut()
+{
+	if (current.phase != OverlayPhase::Playing)
+	{
+		return false;
+	}
+
+	fade_out_begin = current.media_time;
+	fade_out_end = current.media_time + fade_seconds;
+	current.phase = OverlayPhase::FadingOut;
+	return true;
+}
+
+void OverlayStateMachine::clear()
+{
+	player = NULL;
+	current.phase = OverlayPhase::Idle;
+	current.media_time = 0;
+	current.opacity = 0;
+	current.finished = false;
+	current.crossfading = false;
+	current.background_due = false;
+}
+
+const OverlaySnapshot& OverlayStateMachine::tick()
+{
+	current.finished = false;
+
+	if ((current.phase == OverlayPhase::Idle) || (player == NULL))
+	{
+		return current;
+	}
+
+	float position = player->getPosition();
+	current.media_time = position * duration;
+
+	//	A player that has reached its end stops advancing, so a fade out that was meant
+	//	to run past the end of the clip is treated as done when the clip is.
+	bool at_end = (position >= 1.0f);
+
+	if ((current.phase == OverlayPhase::FadingIn) && (current.media_time >= fade_seconds))
+	{
+		current.phase = OverlayPhase::Playing;
+		current.crossfading = false;
+	}
+
+	if ((current.phase == OverlayPhase::Playing) && ((current.media_time >= fade_out_begin) || at_end))
+	{
+		current.phase = OverlayPhase::FadingOut;
+	}
+
+	switch (current.phase)
+	{
+	case OverlayPhase::FadingIn:
+		current.opacity = (fade_seconds > 0) ? (current.media_time / fade_seconds) : 1.0f;
+		break;
+
+	case OverlayPhase::Playing:
+		current.opacity = 1.0f;
+		break;
+
+	case OverlayPhase::FadingOut:
+		if ((current.media_time >= fade_out_end) || at_end)
+		{
+			clear();
+			current.finished = true;
+		}
+		else
+		{
+			current.opacity = 1.0f - ((current.media_time - fade_out_begin) / (fade_out_end - fade_out_begin));
+		}
+		break;
+
+	case OverlayPhase::Idle:
+		break;
+	}
+
+	current.opacity = std::min(std::max(current.opacity, 0.0f), 1.0f);
+	current.background_due = (current.phase != OverlayPhase::Idle) && isBackgroundDue();
+	return current;
+}
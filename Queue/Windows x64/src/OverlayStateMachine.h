@@ -0,0 +1,92 @@
+#pragma once
+
+#include "QueueInterfaces.h"
+
+enum class OverlayPhase
+{
+	Idle,
+	FadingIn,
+	Playing,
+	FadingOut
+};
+
+//	Everything update() and draw() need to know about the overlay for one tick. It is
+//	computed once per tick by OverlayStateMachine::tick(), and everything else reads
+//	this copy instead of asking the decoder again.
+struct OverlaySnapshot
+{
+	OverlayPhase phase;
+
+	//	Seconds into the clip, from the player's position when the tick was taken.
+	float media_time;
+
+	//	0 (transparent) to 1 (opaque).
+	float opacity;
+
+	//	True only on the tick in which a fade out completed. The phase is already back
+	//	to Idle by then, or FadingIn if the next overlay was started in the same tick.
+	bool finished;
+
+	//	True while the overlay is fading in over the one before it, which stays fully
+	//	opaque underneath until the fade in completes.
+	bool crossfading;
+
+	//	True from one fade duration before the overlay's fade out is due to begin, so
+	//	that a suspended background can be running again by the time it shows. An early
+	//	fade out can't be seen coming, so the background resumes as it starts instead.
+	bool background_due;
+
+	//	True while the background can't be seen: the overlay is fully opaque, or is
+	//	crossfading in over one that is.
+	bool covers_background() const { return (phase == OverlayPhase::Playing) || crossfading; }
+};
+
+//	Drives the overlay through Idle -> FadingIn -> Playing -> FadingOut -> Idle by media
+//	time rather than by frame number, so fades last the configured number of seconds
+//	whatever the clip's or the app's frame rate.
+//
+//	Fade sections on the clip's timeline:
+//
+//	|-- fade in --|================= video ===============|-- fade out --|
+//	0           fade                                   duration-fade   duration
+//
+//	The fade out initially sits at the end of the clip. If the overlay has to stop
+//	early (its device left the queue, or another device is now at its head), the fade
+//	out starts from the current media time instead.
+//
+//	In a crossfade the next overlay is started in place of the fade out, and its fade in
+//	is drawn over the outgoing overlay rather than over the background.
+class OverlayStateMachine
+{
+public:
+	OverlayStateMachine();
+
+	void setup(float _fade_seconds);
+	float getFadeSeconds() const { return fade_seconds; }
+
+	//	Puts the state machine into FadingIn for a player that has just been started.
+	//	With _crossfade, the overlay before it stays on screen underneath until the fade
+	//	in completes.
+	void start(QueuePlayer* _player, bool _crossfade = false);
+
+	//	Starts an early fade out. Only takes effect while Playing, so a fade in always
+	//	completes first. Returns true if a fade out was started.
+	bool requestFadeOut();
+
+	void clear();
+
+	//	Queries the player's position once and advances the state machine.
+	const OverlaySnapshot& tick();
+
+	const OverlaySnapshot& snapshot() const { return current; }
+
+private:
+	QueuePlayer* player;
+	float fade_seconds;
+	float duration;
+	float fade_out_begin;
+	float fade_out_end;
+	OverlaySnapshot current;
+
+	bool isBackgroundDue() const { return current.media_time >= fade_out_begin - fade_seconds; }
+};
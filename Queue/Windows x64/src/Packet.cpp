@@ -0,0 +1,168 @@
+
+#include "Packet.h"
+
+#include <cstring>
+
+uint16_t packetCrc(const unsigned char* _data, size_t _length)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (size_t i = 0; i < _length; i++)
+	{
+		crc ^= (uint16_t)(_data[i] << 8);
+
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * COBS: each run of non-zero bytes is preceded by a code byte of its length plus one,
+ * which stands in for the zero that followed it. A run of 254 gets code 0xFF and no
+ * zero. Packets are short enough that there is never more than one such run.
+ */
+size_t encodePacket(const Packet& _packet, unsigned char* _out)
+{
+	if (_packet.length > PACKET_PAYLOAD_LIMIT)
+	{
+		return 0;
+	}
+
+	unsigned char raw[PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH];
+	size_t raw_length = 0;
+
+	raw[raw_length++] = (unsigned char)_packet.length;
+	raw[raw_length++] = _packet.type;
+	raw[raw_length++] = _packet.sequence;
+	raw[raw_length++] = _packet.id;
+
+	for (size_t i = 0; i < _packet.length; i++)
+	{
+		raw[raw_length++] = _packet.payload[i];
+	}
+
+	uint16_t crc = packetCrc(raw, raw_length);
+	raw[raw_length++] = (unsigned char)(crc >> 8);
+	raw[raw_length++] = (unsigned char)(crc & 0xFF);
+
+	size_t out_length = 0;
+	_out[out_length++] = PACKET_DELIMITER;
+
+	size_t code_index = out_length++;
+	unsigned char code = 1;
+
+	for (size_t i = 0; i < raw_length; i++)
+	{
+		if (raw[i] == 0)
+		{
+			_out[code_index] = code;
+			code_index = out_length++;
+			code = 1;
+		}
+		else
+		{
+			_out[out_length++] = raw[i];
+			code++;
+		}
+	}
+
+	_out[code_index] = code;
+	_out[out_length++] = PACKET_DELIMITER;
+	return out_length;
+}
+
+PacketParser::PacketParser()
+	: state(IN_PACKET), framed_only(true), length(0), next_sequence(),
+	packets(0), corrupt_packets(0), oversize_packets(0), lost_packets(0)
+{
+	for (auto& lost : lost_by_id)
+	{
+		lost.store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * Drops any partially received packet, and forgets the sequence numbers, since the
+ * other end may have restarted. Counters are left alone, as with FrameParser.
+ */
+void PacketParser::reset()
+{
+	state = framed_only ? IN_PACKET : OUT_OF_PACKET;
+	length = 0;
+	memset(next_sequence, 0, sizeof(next_sequence));
+}
+
+void PacketParser::setFramedOnly(bool _framed_only)
+{
+	framed_only = _framed_only;
+	reset();
+}
+
+/**
+ * Undoes the COBS encoding of the bytes between two delimiters and checks the length
+ * and CRC. Anything that doesn't add up is counted as corrupt and dropped.
+ */
+bool PacketParser::decode(Packet& _packet)
+{
+	size_t decoded_length = 0;
+	size_t i = 0;
+
+	while (i < length)
+	{
+		unsigned char code = buffer[i++];
+
+		for (unsigned char j = 1; j < code; j++)
+		{
+			if (i >= length)
+			{
+				corrupt_packets.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			decoded[decoded_length++] = buffer[i++];
+		}
+
+		if ((code < 0xFF) && (i < length))
+		{
+			decoded[decoded_length++] = 0;
+		}
+	}
+
+	if ((decoded_length < PACKET_HEADER_LENGTH + PACKET_CRC_LENGTH)
+		|| (decoded[0] != decoded_length - PACKET_HEADER_LENGTH - PACKET_CRC_LENGTH))
+	{
+		corrupt_packets.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	size_t crc_at = decoded_length - PACKET_CRC_LENGTH;
+	uint16_t crc = (uint16_t)((decoded[crc_at] << 8) | decoded[crc_at + 1]);
+
+	if (crc != packetCrc(decoded, crc_at))
+	{
+		corrupt_packets.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	_packet.type = decoded[1];
+	_packet.sequence = decoded[2];
+	_packet.id = decoded[3];
+	_packet.payload = decoded + PACKET_HEADER_LENGTH;
+	_packet.length = decoded[0];
+
+	uint16_t& expected = next_sequence[_packet.id];
+
+	if ((expected != 0) && (_packet.sequence != (uint8_t)(expected - 1)))
+	{
+		uint8_t lost = (uint8_t)(_packet.sequence - (uint8_t)(expected - 1));
+		lost_packets.fetch_add(lost, std::memory_order_relaxed);
+		lost_by_id[_packet.id].fetch_add(lost, std::memory_order_relaxed);
+	}
+
+	expected = (uint16_t)((uint8_t)(_packet.sequence + 1)) + 1;
+	packets.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
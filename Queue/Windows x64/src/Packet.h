@@ -0,0 +1,211 @@
+#pragma once
+
+#include "FrameParser.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//	Protocol v2. Each message is a packet of
+//
+//		[length][type][sequence][id][payload: length bytes][CRC-16 high][CRC-16 low]
+//
+//	COBS encoded so that it contains no zero bytes, and sent with a zero on either side.
+//	The CRC is CRC-16/CCITT-FALSE over everything before it, and each sender numbers its
+//	packets so the receiver can count the ones that never arrived. A corrupted byte costs
+//	the one packet it landed in: the next zero always starts over, whatever came before.
+//
+//	Devices start out on v1 (see FrameParser.h). v2 firmware answers the app's first v1
+//	heartbeat ping with a v2 pong, and from then on both ends only speak v2.
+#define PACKET_DELIMITER 0x00
+#define PACKET_HEADER_LENGTH 4
+#define PACKET_CRC_LENGTH 2
+#define PACKET_PAYLOAD_LIMIT 32
+
+//	Longest a packet can be once encoded, counting COBS's one byte of overhead (enough
+//	for up to 254 bytes) and the two delimiters.
+#define PACKET_ENCODED_LIMIT (PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH + 3)
+
+//	Largest byte a packet can start with, as COBS puts the distance to the first zero
+//	there. Anything bigger right after a delimiter isn't a packet, such as the '[' of a
+//	v1 frame or an LED command character.
+#define PACKET_CODE_LIMIT (PACKET_HEADER_LENGTH + PACKET_PAYLOAD_LIMIT + PACKET_CRC_LENGTH + 1)
+
+enum PacketType
+{
+	PACKET_STATE = 0x01,		//	controller -> app: 0x01 when triggered, 0x00 when not
+	PACKET_LED = 0x02,			//	app -> controller: 'N', 'W' or 'F'
+	PACKET_PING = 0x03,			//	app -> controller: heartbeat sequence number
+	PACKET_PONG = 0x04,			//	controller -> app: the sequence number of the ping
+	PACKET_SENSOR_ERROR = 0x05	//	controller -> app: the sensor's error code
+};
+
+//	A decoded packet. payload points into the parser's own buffer and is only valid for
+//	the duration of the handler call it is passed to.
+struct Packet
+{
+	uint8_t type;
+	uint8_t sequence;
+	unsigned char id;
+	const unsigned char* payload;
+	size_t length;
+};
+
+uint16_t packetCrc(const unsigned char* _data, size_t _length);
+
+//	Writes the packet, delimiters included, to _out, which must have room for
+//	PACKET_ENCODED_LIMIT bytes. Returns the number of bytes written, or 0 if the payload
+//	is longer than PACKET_PAYLOAD_LIMIT.
+size_t encodePacket(const Packet& _packet, unsigned char* _out);
+
+//	Resumable v2 receiver, fed in chunks of any size like FrameParser.
+//
+//	By default every zero ends whatever came before it, which is all a v2 link needs.
+//	Only a byte above PACKET_CODE_LIMIT right after a zero, which can't start a packet,
+//	is taken as bare v1 from the other end having restarted. It and everything up to
+//	and including the next zero, as v1 frames carry zeros, are handed to a second
+//	callback. A parser that is setFramedOnly(false) instead expects bare v1 bytes
+//	between packets: a zero opens a packet, the next one closes it, and everything
+//	outside of a packet is handed to the second callback.
+class PacketParser
+{
+public:
+	PacketParser();
+
+	void reset();
+	void setFramedOnly(bool _framed_only);
+
+	template <typename Handler, typename StrayHandler>
+	void feed(const unsigned char* _data, size_t _length, Handler&& _on_packet, StrayHandler&& _on_stray)
+	{
+		for (size_t i = 0; i < _length; i++)
+		{
+			unsigned char byte = _data[i];
+
+			if (byte == PACKET_DELIMITER)
+			{
+				if ((state == IN_PACKET) && (length > 0))
+				{
+					Packet packet;
+					if (decode(packet))
+					{
+						_on_packet(packet);
+					}
+				}
+				else if (state == OUT_OF_PACKET)
+				{
+					if (framed_only)
+					{
+						_on_stray(byte);
+					}
+
+					state = IN_PACKET;
+					length = 0;
+					continue;
+				}
+
+				state = framed_only ? IN_PACKET : OUT_OF_PACKET;
+				length = 0;
+				continue;
+			}
+
+			switch (state)
+			{
+			case OUT_OF_PACKET:
+				_on_stray(byte);
+				break;
+
+			case IN_PACKET:
+				if (framed_only && (length == 0) && (byte > PACKET_CODE_LIMIT))
+				{
+					state = OUT_OF_PACKET;
+					_on_stray(byte);
+				}
+				else if (length >= sizeof(buffer))
+				{
+					oversize_packets.fetch_add(1, std::memory_order_relaxed);
+					state = DISCARDING;
+				}
+				else
+				{
+					buffer[length++] = byte;
+				}
+				break;
+
+			case DISCARDING:
+				break;
+			}
+		}
+	}
+
+	template <typename Handler>
+	void feed(const unsigned char* _data, size_t _length, Handler&& _on_packet)
+	{
+		feed(_data, _length, _on_packet, [](unsigned char) {});
+	}
+
+	unsigned long packetCount() const { return packets.load(std::memory_order_relaxed); }
+	unsigned long corruptCount() const { return corrupt_packets.load(std::memory_order_relaxed); }
+	unsigned long oversizeCount() const { return oversize_packets.load(std::memory_order_relaxed); }
+	unsigned long lostCount() const { return lost_packets.load(std::memory_order_relaxed); }
+
+	//	Packets lost by the one controller with _id, for a port several controllers share.
+	unsigned long lostCount(unsigned char _id) const { return lost_by_id[_id].load(std::memory_order_relaxed); }
+
+private:
+	enum State
+	{
+		OUT_OF_PACKET,
+		IN_PACKET,
+		DISCARDING
+	};
+
+	State state;
+	bool framed_only;
+	unsigned char buffer[PACKET_ENCODED_LIMIT - 2];
+	unsigned char decoded[PACKET_ENCODED_LIMIT - 2];
+	size_t length;
+
+	//	Each controller numbers its packets on its own, so on a port several of them share
+	//	the sequence is followed for each ID. 0 until a packet with the ID has been seen,
+	//	otherwise the next sequence number expected plus one.
+	uint16_t next_sequence[256];
+	std::atomic<unsigned long> lost_by_id[256];
+
+	std::atomic<unsigned long> packets;
+	std::atomic<unsigned long> corrupt_packets;
+	std::atomic<unsigned long> oversize_packets;
+	std::atomic<unsigned long> lost_packets;
+
+	bool decode(Packet& _packet);
+};
+
+//	Picks the LED commands out of what the app wrote to a controller, in whichever
+//	protocol it was written, for comparing a replay against a recording. Heartbeat pings
+//	are skipped. One per device, since a packet can be split across two writes.
+class LedCommandScanner
+{
+public:
+	LedCommandScanner() { parser.setFramedOnly(false); }
+
+	template <typename Handler>
+	void feed(const unsigned char* _data, size_t _length, Handler&& _on_command)
+	{
+		parser.feed(_data, _length,
+			[&](const Packet& _packet) {
+				if ((_packet.type == PACKET_LED) && (_packet.length > 0))
+				{
+					_on_command((char)_packet.payload[0]);
+				}
+			},
+			[&](unsigned char _byte) {
+				if (!isHeartbeatByte(_byte))
+				{
+					_on_command((char)_byte);
+				}
+			});
+	}
+
+private:
+	PacketParser parser;
+};
@@ -0,0 +1,283 @@
+
+#include "QueueCore.h"
+#include "Tracer.h"
+
+#include <chrono>
+
+uint64_t SteadyQueueClock::nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QueueCore::QueueCore()
+	: player(NULL), clock(NULL), overlay_station(NULL), outgoing_station(NULL), transition(OverlayTransition::Fade), overlay_start_us(0)
+{
+	queue.setHeadChangedListener([this](QueueStation* _previous_head, QueueStation* _new_head)
+	{
+		onHeadChanged(_previous_head, _new_head);
+	});
+}
+
+void QueueCore::setup(QueuePlayer* _player, QueueClock* _clock)
+{
+	player = _player;
+	clock = _clock;
+}
+
+static const char* overlayPhaseName(OverlayPhase _phase)
+{
+	switch (_phase)
+	{
+	case OverlayPhase::FadingIn:
+		return "overlay fading in";
+	case OverlayPhase::Playing:
+		return "overlay playing";
+	case OverlayPhase::FadingOut:
+		return "overlay fading out";
+	default:
+		return "overlay idle";
+	}
+}
+
+void QueueCore::markLedChanged(QueueStation* _station)
+{
+	if (!_station->led_changed)
+	{
+		_station->led_changed = true;
+		led_changes.push_back(_station);
+	}
+}
+
+char QueueCore::ledFor(QueueStation* _station) const
+{
+	if (!queue.contains(_station))
+	{
+		return 'F';
+	}
+
+	return (queue.head() == _station) ? 'N' : 'W';
+}
+
+/**
+ * Sends each changed station's LED command, if it differs from the last one sent.
+ */
+void QueueCore::sendLedChanges()
+{
+	for (auto station : led_changes)
+	{
+		station->led_changed = false;
+		char command = ledFor(station);
+
+		if (command != station->led_sent)
+		{
+			station->led_sent = command;
+
+			if (station->transport != NULL)
+			{
+				station->transport->sendCommand(command);
+			}
+		}
+	}
+
+	led_changes.clear();
+}
+
+/**
+ * The station leaving the front of the queue and the one reaching it both have their
+ * LEDs worked out again at the end of the tick.
+ */
+void QueueCore::onHeadChanged(QueueStation* _previous_head, QueueStation* _new_head)
+{
+	if (_previous_head != NULL)
+	{
+		markLedChanged(_previous_head);
+	}
+
+	if (_new_head != NULL)
+	{
+		markLedChanged(_new_head);
+	}
+}
+
+void QueueCore::add(QueueStation* _station)
+{
+	queue.push(_station);
+	player->onQueued(_station);
+
+	Tracer::instant("queue", "queued", _station->name.c_str());
+	Tracer::counter("queue depth", (int64_t)queue.size());
+
+	markLedChanged(_station);
+}
+
+void QueueCore::remove(QueueStation* _station)
+{
+	if (queue.remove(_station))
+	{
+		Tracer::instant("queue", "dequeued", _station->name.c_str());
+		Tracer::counter("queue depth", (int64_t)queue.size());
+
+		markLedChanged(_station);
+		player->onDequeued(_station);
+	}
+}
+
+void QueueCore::setStationState(QueueStation* _station, bool _state)
+{
+	if (_station->state != _state)
+	{
+		_station->state_changed_us = clock->nowMicros();
+	}
+
+	_station->state = _state;
+
+	bool queued = queue.contains(_station);
+
+	if (!queued && _state)
+	{
+		add(_station);
+	}
+	else if (queued && !_state)
+	{
+		remove(_station);
+	}
+}
+
+void QueueCore::clearOverlay()
+{
+	if (outgoing_station != NULL)
+	{
+		player->stop(outgoing_station);
+	}
+
+	if (overlay_station != NULL)
+	{
+		player->stop(overlay_station);
+	}
+
+	outgoing_station = NULL;
+	overlay_station = NULL;
+}
+
+/**
+ * Starts the next queued station's clip over the overlay, which becomes the outgoing
+ * overlay. Its station is dequeued if it is still queued, as the clip has played out
+ * as far as the queue is concerned. Does nothing if no other station is queued or its
+ * clip isn't ready, so the overlay fades out to the background as usual.
+ */
+void QueueCore::crossfadeToNext()
+{
+	QueueStation* next = queue.head();
+	if (next == overlay_station)
+	{
+		next = queue.next(next);
+	}
+
+	if ((next == NULL) || !player->isReady(next))
+	{
+		return;
+	}
+
+	QueueStation* leaving = overlay_station;
+	outgoing_station = leaving;
+	overlay_station = next;
+
+	if (queue.contains(leaving))
+	{
+		leaving->state = false;
+		remove(leaving);
+	}
+
+	player->start(overlay_station);
+	overlay_state.start(player, true);
+	overlay_start_us = clock->nowMicros();
+
+	Tracer::instant("queue", "overlay crossfade started", overlay_station->name.c_str());
+}
+
+/**
+ * A finished overlay is cleared, and its station dequeued if it is still queued, since
+ * its clip has played out. A fully faded in overlay fades out early once its station
+ * is no longer at the head of the queue, and with no overlay on screen the head of the
+ * queue is started as soon as its clip is ready.
+ *
+ * With the Crossfade transition, an overlay that begins its fade out at the end of its
+ * clip, or would begin one early, is crossfaded into the next station's clip instead
+ * if it is ready. A clip shorter than two fades goes from fading in to fading out in
+ * one tick, and is crossfaded out of all the same. The outgoing overlay is stopped
+ * once the fade in over it completes.
+ */
+const OverlaySnapshot& QueueCore::update()
+{
+	OverlayPhase previous_phase = overlay_state.snapshot().phase;
+	const OverlaySnapshot& snapshot = overlay_state.tick();
+
+	if ((outgoing_station != NULL) && !snapshot.crossfading)
+	{
+		player->stop(outgoing_station);
+		outgoing_station = NULL;
+	}
+
+	if ((overlay_station != NULL) && (transition == OverlayTransition::Crossfade))
+	{
+		bool leaving = (snapshot.phase == OverlayPhase::FadingOut) && (previous_phase != OverlayPhase::FadingOut);
+		bool displaced = (snapshot.phase == OverlayPhase::Playing) && (queue.empty() || (overlay_station != queue.head()));
+
+		if (leaving || displaced)
+		{
+			crossfadeToNext();
+		}
+	}
+
+	if (overlay_station != NULL)
+	{
+		if (snapshot.finished)
+		{
+			QueueStation* finished_station = overlay_station;
+			clearOverlay();
+
+			if (queue.contains(finished_station))
+			{
+				finished_station->state = false;
+				remove(finished_station);
+			}
+		}
+		else if (queue.empty() || (overlay_station != queue.head()))
+		{
+			overlay_state.requestFadeOut();
+		}
+	}
+
+	if ((overlay_station == NULL) && !queue.empty() && player->isReady(queue.head()))
+	{
+		overlay_station = queue.head();
+		player->start(overlay_station);
+		overlay_state.start(player);
+		overlay_start_us = clock->nowMicros();
+
+		Tracer::instant("queue", "overlay started", overlay_station->name.c_str());
+	}
+
+	if (Tracer::isEnabled() && (overlay_state.snapshot().phase != previous_phase))
+	{
+		Tracer::instant("overlay", overlayPhaseName(overlay_state.snapshot().phase), (overlay_station != NULL) ? overlay_station->name.c_str() : NULL);
+	}
+
+	sendLedChanges();
+
+	return overlay_state.snapshot();
+}
+
+void QueueCore::clear()
+{
+	for (auto station : led_changes)
+	{
+		station->led_changed = false;
+	}
+
+	led_changes.clear();
+	queue.clear();
+	clearOverlay();
+	overlay_state.clear();
+}
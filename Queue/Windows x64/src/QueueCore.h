@@ -0,0 +1,84 @@
+#pragma once
+
+#include "IntrusiveQueue.h"
+#include "OverlayStateMachine.h"
+#include "QueueInterfaces.h"
+
+#include <cstdint>
+#include <vector>
+
+//	How one overlay gives way to the next queued one. Fade goes through the background:
+//	the overlay fades out, and the next fades in once it has. Crossfade starts the next
+//	overlay as soon as the current one would begin its fade out, and fades it in over
+//	the current one, which stays opaque and is stopped once it is covered.
+enum class OverlayTransition
+{
+	Fade,
+	Crossfade
+};
+
+//	The queue logic on its own: which stations are queued, which one's clip is the
+//	overlay, when it fades, and which LED command each controller is sent. It only sees
+//	the outside world through QueueTransport, QueuePlayer and QueueClock, so it runs the
+//	same under openFrameworks as in the headless simulation benchmark.
+//
+//	LED commands: the station at the head of the queue shows 'N', a station queued
+//	behind it 'W', and a station that isn't queued 'F'. Each tick the stations the
+//	queue changed for are compared against what their controllers were last sent, and
+//	only a station whose LED should now be different is sent a command. However many
+//	times a station is queued and dequeued within a tick, its controller is sent at
+//	most one command, the final one.
+class QueueCore
+{
+public:
+	QueueCore();
+
+	void setup(QueuePlayer* _player, QueueClock* _clock);
+	void setFadeSeconds(float _fade_seconds) { overlay_state.setup(_fade_seconds); }
+	void setTransition(OverlayTransition _transition) { transition = _transition; }
+
+	//	Applies a controller's reported state, queueing or dequeueing the station.
+	void setStationState(QueueStation* _station, bool _state);
+
+	//	Called once per tick. Advances the overlay by the player's position, then
+	//	finishes, fades out or starts overlays as the queue requires, and sends the
+	//	tick's LED commands. Returns the tick's snapshot, which snapshot() keeps
+	//	returning until the next update().
+	const OverlaySnapshot& update();
+
+	const OverlaySnapshot& snapshot() const { return overlay_state.snapshot(); }
+	const IntrusiveQueue<QueueStation>& getQueue() const { return queue; }
+	QueueStation* getOverlayStation() const { return overlay_station; }
+
+	//	The overlay being crossfaded out of, drawn under the overlay while the snapshot
+	//	is crossfading, otherwise NULL.
+	QueueStation* getOutgoingStation() const { return outgoing_station; }
+	uint64_t getOverlayStartMicros() const { return overlay_start_us; }
+
+	//	Empties the queue and drops the overlay without sending any commands, e.g. on
+	//	shutdown.
+	void clear();
+
+private:
+	IntrusiveQueue<QueueStation> queue;
+	OverlayStateMachine overlay_state;
+	QueuePlayer* player;
+	QueueClock* clock;
+	QueueStation* overlay_station;
+	QueueStation* outgoing_station;
+	OverlayTransition transition;
+	uint64_t overlay_start_us;
+
+	//	Stations whose LED may have changed since the last update(). Its capacity is
+	//	kept, so after the first few ticks marking a station never allocates.
+	std::vector<QueueStation*> led_changes;
+
+	void add(QueueStation* _station);
+	void remove(QueueStation* _station);
+	void clearOverlay();
+	void crossfadeToNext();
+	void onHeadChanged(QueueStation* _previous_head, QueueStation* _new_head);
+	void markLedChanged(QueueStation* _station);
+	char ledFor(QueueStation* _station) const;
+	void sendLedChanges();
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "IntrusiveQueue.h"
+
+#include <cstdint>
+#include <string>
+
+//	The interfaces QueueCore talks to the outside world through. Nothing here depends on
+//	openFrameworks: the app plugs in serial ports, pooled ofVideoPlayers and the system
+//	clock, and the simulation benchmark plugs in virtual controllers, players and time.
+
+//	Where a station's LED commands ('N', 'W' and 'F') go.
+class QueueTransport
+{
+public:
+	virtual ~QueueTransport() {}
+	virtual void sendCommand(char _command) = 0;
+};
+
+class QueueClock
+{
+public:
+	virtual ~QueueClock() {}
+	virtual uint64_t nowMicros() = 0;
+};
+
+//	QueueClock on std::chrono::steady_clock.
+class SteadyQueueClock : public QueueClock
+{
+public:
+	uint64_t nowMicros() override;
+};
+
+//	One controller and its clip, as far as the queue is concerned. The app's
+//	InteractiveDevice is a QueueStation.
+class QueueStation
+{
+public:
+	QueueStation() : transport(NULL), state(false), state_changed_us(0), led_sent(0), led_changed(false) {}
+	virtual ~QueueStation() {}
+
+	QueueTransport* transport;
+
+	//	Identifies the station in traces, e.g. its controller's port.
+	std::string name;
+
+	//	The controller's last reported state, true while it is triggered.
+	bool state;
+
+	//	When state last changed, by the QueueCore's clock.
+	uint64_t state_changed_us;
+
+	//	Kept by QueueCore: the LED command the controller was last sent, 0 before the
+	//	first, and whether the queue changed this tick in a way that may change it.
+	char led_sent;
+	bool led_changed;
+
+	//	Links the station into the queue, see IntrusiveQueue.
+	QueueHook<QueueStation> queue_hook;
+};
+
+//	Plays the stations' clips. Only one clip is on screen at a time, the overlay, except
+//	during a crossfade, when the next overlay is started before the outgoing one is
+//	stopped. getPosition() and getDuration() refer to whichever was started last.
+class QueuePlayer
+{
+public:
+	virtual ~QueuePlayer() {}
+
+	//	The station joined or left the queue, so its clip should be opened or may be
+	//	closed.
+	virtual void onQueued(QueueStation*) {}
+	virtual void onDequeued(QueueStation*) {}
+
+	//	Whether the station's clip is open and can be started right now.
+	virtual bool isReady(QueueStation* _station) = 0;
+
+	//	Starts the station's clip from its first frame as the overlay.
+	virtual void start(QueueStation* _station) = 0;
+
+	//	The overlay has faded out or been crossfaded out of, or is being dropped.
+	virtual void stop(QueueStation* _station) = 0;
+
+	//	Position through the overlay from 0 to 1, and its length in seconds.
+	virtual float getPosition() = 0;
+	virtual float getDuration() = 0;
+};
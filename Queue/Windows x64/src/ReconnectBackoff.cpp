@@ -0,0 +1,33 @@
+
+#include "ReconnectBackoff.h"
+
+ReconnectBackoff::ReconnectBackoff(uint64_t _base_ms, uint64_t _max_ms)
+	: base_ms(_base_ms), max_ms(_max_ms), attempt_count(0), random(std::random_device()())
+{
+}
+
+void ReconnectBackoff::reset()
+{
+	attempt_count = 0;
+}
+
+uint64_t ReconnectBackoff::nextDelayMs()
+{
+	uint64_t delay = max_ms;
+
+	//	Past 2^16 the doubling would only ever be clamped to max_ms anyway, and stopping
+	//	there keeps the shift from overflowing.
+	if (attempt_count < 16)
+	{
+		delay = base_ms << attempt_count;
+		if (delay > max_ms)
+		{
+			delay = max_ms;
+		}
+	}
+
+	attempt_count++;
+
+	uint64_t half = delay / 2;
+	return half + (random() % (half + 1));
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+//	First and longest wait between attempts to reopen a dead serial port.
+#define RECONNECT_BASE_MS 500
+#define RECONNECT_MAX_MS 30000
+
+//	Exponential backoff with jitter for reopening dead ports. Each failed attempt doubles
+//	the delay up to RECONNECT_MAX_MS, and the actual wait is picked at random from the
+//	upper half of that delay so that several controllers that dropped together (e.g. the
+//	PC's Bluetooth radio was reset) don't all hammer the stack in lockstep.
+class ReconnectBackoff
+{
+public:
+	ReconnectBackoff(uint64_t _base_ms = RECONNECT_BASE_MS, uint64_t _max_ms = RECONNECT_MAX_MS);
+
+	//	Call once a connection succeeds, so the next outage starts from the base delay.
+	void reset();
+
+	//	Returns how long to wait before the next attempt and counts the attempt.
+	uint64_t nextDelayMs();
+
+	unsigned int attempts() const { return attempt_count; }
+
+private:
+	uint64_t base_ms;
+	uint64_t max_ms;
+	unsigned int attempt_count;
+	std::minstd_rand random;
+};
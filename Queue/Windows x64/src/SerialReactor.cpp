@@ -0,0 +1,673 @@
+
+#include "SerialReactor.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+#ifdef SERIAL_REACTOR_ENABLED
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baudToSpeed(int _baud)
+{
+	switch (_baud)
+	{
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	default: return B9600;
+	}
+}
+
+/**
+ * Opens the tty non-blocking in raw 8N1 mode, the same settings ofSerial uses.
+ * Returns -1 on failure.
+ */
+static int openTty(const std::string& _port, int _baud)
+{
+	int fd = open(_port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	struct termios options;
+	if (tcgetattr(fd, &options) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	cfmakeraw(&options);
+	cfsetispeed(&options, baudToSpeed(_baud));
+	cfsetospeed(&options, baudToSpeed(_baud));
+	options.c_cflag |= (CLOCAL | CREAD);
+	options.c_cflag &= ~(PARENB | CSTOPB | CSIZE);
+	options.c_cflag |= CS8;
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 0;
+
+	if (tcsetattr(fd, TCSANOW, &options) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	tcflush(fd, TCIOFLUSH);
+	return fd;
+}
+
+static uint64_t nowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SerialReactor::SerialReactor()
+	: epoll_fd(-1), wake_fd(-1), running(false), ready_overflow(false)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if ((epoll_fd < 0) || (wake_fd < 0))
+	{
+		throw std::runtime_error("\nFATAL ERROR! Could not create the epoll set for the serial ports.");
+	}
+
+	//	The wake eventfd is the only entry registered without a Port pointer.
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+}
+
+SerialReactor::~SerialReactor()
+{
+	stop();
+
+	//	Opens still running report back to the wake eventfd, so they finish first.
+	openers.stop();
+
+	for (auto& tty : opened)
+	{
+		if (tty.fd >= 0)
+		{
+			close(tty.fd);
+		}
+	}
+
+	for (auto& port : ports)
+	{
+		closePort(port.get());
+	}
+
+	close(wake_fd);
+	close(epoll_fd);
+}
+
+SerialReactor::Port* SerialReactor::createPort(InteractiveDevice* _device)
+{
+	std::unique_ptr<Port> port(new Port());
+	port->device = _device;
+	port->fd = -1;
+	port->out.resize(std::max((size_t)SERIAL_REACTOR_OUT_BUFFER, 2 * _device->getMessageLimit()));
+	port->out_length = 0;
+	port->waiting_for_writable = false;
+	port->opening = false;
+
+	Port* added = port.get();
+	port->reconnect_timer.callback = [this, added]() { reconnectPort(added); };
+	port->heartbeat_timer.callback = [this, added]() { heartbeatPort(added); };
+
+	_device->setCommandListener([this]() { wake(); });
+	ports.push_back(std::move(port));
+	return added;
+}
+
+void SerialReactor::addDevice(InteractiveDevice* _device)
+{
+	createPort(_device);
+}
+
+void SerialReactor::attachDevice(InteractiveDevice* _device)
+{
+	{
+		std::lock_guard<std::mutex> lock(changes_mutex);
+		attaching.push_back(_device);
+	}
+
+	wake();
+}
+
+void SerialReactor::detachDevice(InteractiveDevice* _device)
+{
+	{
+		std::lock_guard<std::mutex> lock(changes_mutex);
+		detaching.push_back(_device);
+	}
+
+	wake();
+}
+
+bool SerialReactor::takeDetachedDevice(InteractiveDevice*& _device)
+{
+	std::lock_guard<std::mutex> lock(changes_mutex);
+
+	if (detached.empty())
+	{
+		return false;
+	}
+
+	_device = detached.back();
+	detached.pop_back();
+	return true;
+}
+
+/**
+ * Runs on the reactor's thread once the epoll events it was woken with have all been
+ * handled, so that none of them can refer to a port that is removed here. A new port
+ * is opened by its reconnect timer, exactly as if it had been lost.
+ */
+void SerialReactor::applyDeviceChanges()
+{
+	std::vector<InteractiveDevice*> to_attach;
+	std::vector<InteractiveDevice*> to_detach;
+	std::vector<OpenedTty> to_finish;
+
+	{
+		std::lock_guard<std::mutex> lock(changes_mutex);
+		to_attach.swap(attaching);
+		to_detach.swap(detaching);
+		to_finish.swap(opened);
+	}
+
+	for (auto& tty : to_finish)
+	{
+		bool detached_port = false;
+
+		for (size_t i = 0; i < closing.size(); i++)
+		{
+			if (closing[i].get() == tty.port)
+			{
+				if (tty.fd >= 0)
+				{
+					close(tty.fd);
+				}
+
+				closing.erase(closing.begin() + i);
+				detached_port = true;
+				break;
+			}
+		}
+
+		if (!detached_port)
+		{
+			finishOpen(tty.port, tty.fd);
+		}
+	}
+
+	for (auto device : to_attach)
+	{
+		timers.schedule(createPort(device)->reconnect_timer, 0);
+	}
+
+	for (auto device : to_detach)
+	{
+		for (size_t i = 0; i < ports.size(); i++)
+		{
+			if (ports[i]->device == device)
+			{
+				flushPort(ports[i].get());
+				closePort(ports[i].get());
+
+				//	A port still being opened is set aside, without its device, until the
+				//	open has finished and its tty can be closed again.
+				if (ports[i]->opening)
+				{
+					ports[i]->device = NULL;
+					closing.push_back(std::move(ports[i]));
+				}
+
+				ports.erase(ports.begin() + i);
+				break;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(changes_mutex);
+		detached.push_back(device);
+	}
+}
+
+/**
+ * Opens the port's tty on the WorkerPool, which hands it back to finishOpen() on the
+ * reactor's thread. The job only has copies of the port's name and baud rate, as the
+ * device may be detached before it is done.
+ */
+void SerialReactor::beginOpen(Port* _port)
+{
+	if (_port->opening)
+	{
+		return;
+	}
+
+	_port->opening = true;
+
+	std::string path = _port->device->port;
+	int baud = _port->device->baud;
+
+	openers.submit([this, _port, path, baud]()
+	{
+		int fd = openTty(path, baud);
+
+		{
+			std::lock_guard<std::mutex> lock(changes_mutex);
+			opened.push_back({ _port, fd });
+		}
+
+		wake();
+	});
+}
+
+/**
+ * A port that failed to open waits out the next, longer, backoff, and the failure is
+ * counted so the app can report the station as degraded.
+ */
+void SerialReactor::finishOpen(Port* _port, int _fd)
+{
+	_port->opening = false;
+	bool first_open = !_port->device->link.opened.load(std::memory_order_relaxed);
+
+	if ((_fd >= 0) && registerPort(_port, _fd))
+	{
+		LOG_INFO("Serial port {} {}.", _port->device->port, first_open ? "opened" : "reconnected");
+		Tracer::instant("serial", first_open ? "opened" : "reconnected", _port->device->port.c_str());
+		flushPort(_port);
+		scheduleHeartbeat(_port);
+		return;
+	}
+
+	_port->device->countOpenFailure();
+
+	uint64_t delay = _port->backoff.nextDelayMs();
+	timers.schedule(_port->reconnect_timer, delay);
+	LOG_WARNING("{} {} failed (attempt {}), retrying in {} ms.", first_open ? "Opening" : "Reconnecting", _port->device->port, _port->backoff.attempts(), delay);
+}
+
+/**
+ * Adds the opened tty to the epoll set. On success the device is marked connected,
+ * which throws away commands queued while it was down, and its last LED state is
+ * queued for writing instead.
+ */
+bool SerialReactor::registerPort(Port* _port, int _fd)
+{
+	_port->fd = _fd;
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = _port;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, _port->fd, &event) != 0)
+	{
+		close(_port->fd);
+		_port->fd = -1;
+		return false;
+	}
+
+	_port->device->setConnected(true);
+	_port->backoff.reset();
+
+	_port->out_length = _port->device->encodeLedState(_port->out.data());
+	return true;
+}
+
+void SerialReactor::start()
+{
+	if (running)
+	{
+		return;
+	}
+
+	openers.start(SERIAL_REACTOR_OPEN_THREADS);
+	running = true;
+	reactor_thread = std::thread(&SerialReactor::reactorLoop, this);
+}
+
+void SerialReactor::stop()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	running = false;
+	wake();
+
+	if (reactor_thread.joinable())
+	{
+		reactor_thread.join();
+	}
+}
+
+bool SerialReactor::pollReadyDevice(InteractiveDevice*& _device)
+{
+	return ready.pop(_device);
+}
+
+bool SerialReactor::takeReadyOverflow()
+{
+	return ready_overflow.exchange(false);
+}
+
+void SerialReactor::wake()
+{
+	uint64_t one = 1;
+	ssize_t result = write(wake_fd, &one, sizeof(one));
+	(void)result;
+}
+
+/**
+ * A wakeup on the eventfd means stop() was called, a reconnect was requested, a device
+ * is being attached or detached, or at least one device has LED commands queued, so
+ * every port gets a chance to flush. That is a scan over the devices, but it only
+ * happens when the queue changes, never on an idle frame.
+ */
+void SerialReactor::reactorLoop()
+{
+	struct epoll_event events[SERIAL_REACTOR_MAX_EVENTS];
+	int timeout_ms = -1;
+
+	Tracer::setThreadName("serial reactor");
+	timers.reset(nowMillis());
+
+	//	Every port is opened at once, each one's heartbeat starting when it opens.
+	for (auto& port : ports)
+	{
+		timers.schedule(port->reconnect_timer, 0);
+	}
+
+	timeout_ms = millisUntilNextTimer();
+
+	while (running)
+	{
+		int count = epoll_wait(epoll_fd, events, SERIAL_REACTOR_MAX_EVENTS, timeout_ms);
+		bool woken = false;
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			LOG_ERROR("epoll_wait failed: {}, serial ports are no longer being read.", strerror(errno));
+			return;
+		}
+
+		for (int i = 0; i < count; i++)
+		{
+			Port* port = (Port*)events[i].data.ptr;
+
+			if (port == NULL)
+			{
+				uint64_t counter;
+				ssize_t result = read(wake_fd, &counter, sizeof(counter));
+				(void)result;
+				woken = true;
+
+				for (auto& p : ports)
+				{
+					if (p->device->takeReconnectRequest())
+					{
+						disconnectPort(p.get(), "reconnect requested", true);
+					}
+
+					flushPort(p.get());
+				}
+				continue;
+			}
+
+			//	The port may have been closed earlier in this batch, by a reconnect request
+			//	or by the read just before, and its events are stale.
+			if ((port->fd >= 0) && (events[i].events & EPOLLIN))
+			{
+				readPort(port);
+			}
+
+			if ((port->fd >= 0) && (events[i].events & EPOLLOUT))
+			{
+				flushPort(port);
+			}
+
+			if ((port->fd >= 0) && (events[i].events & (EPOLLHUP | EPOLLERR)))
+			{
+				disconnectPort(port, "hung up", false);
+			}
+		}
+
+		if (woken)
+		{
+			applyDeviceChanges();
+		}
+
+		timers.advance(nowMillis());
+		timeout_ms = millisUntilNextTimer();
+	}
+}
+
+/**
+ * Runs when a disconnected port's backoff has run out, or when the reactor starts.
+ */
+void SerialReactor::reconnectPort(Port* _port)
+{
+	beginOpen(_port);
+}
+
+void SerialReactor::scheduleHeartbeat(Port* _port)
+{
+	if ((_port->fd >= 0) && (_port->device->getHeartbeatMillis() > 0))
+	{
+		timers.schedule(_port->heartbeat_timer, _port->device->getHeartbeatMillis());
+	}
+}
+
+/**
+ * The ping goes into the out buffer behind any LED commands already waiting there, and
+ * is written along with whatever commands the device has queued. A port whose out
+ * buffer is that backed up skips the beat rather than adding to it.
+ */
+void SerialReactor::heartbeatPort(Port* _port)
+{
+	if (_port->fd < 0)
+	{
+		return;
+	}
+
+	if (_port->out_length + _port->device->getMessageLimit() > _port->out.size())
+	{
+		flushPort(_port);
+		scheduleHeartbeat(_port);
+		return;
+	}
+
+	size_t length = _port->device->nextHeartbeat(_port->out.data() + _port->out_length);
+	if (length == 0)
+	{
+		disconnectPort(_port, "missed heartbeats", true);
+		return;
+	}
+
+	_port->out_length += length;
+
+	flushPort(_port);
+	scheduleHeartbeat(_port);
+}
+
+/**
+ * How long epoll_wait() may sleep before the next timer is due, or -1 if none are.
+ */
+int SerialReactor::millisUntilNextTimer()
+{
+	uint64_t next_due = timers.nextDueMillis();
+
+	if (next_due == UINT64_MAX)
+	{
+		return -1;
+	}
+
+	uint64_t now = timers.nowMillis();
+	return (next_due > now) ? (int)(next_due - now) : 0;
+}
+
+void SerialReactor::disconnectPort(Port* _port, const char* _reason, bool _retry_now)
+{
+	if (_port->fd >= 0)
+	{
+		LOG_WARNING("Serial port {} disconnected: {}", _port->device->port, _reason);
+		Tracer::instant("serial", "disconnected", _port->device->port.c_str());
+	}
+
+	closePort(_port);
+
+	if (_retry_now)
+	{
+		_port->backoff.reset();
+		timers.schedule(_port->reconnect_timer, 0);
+	}
+	else
+	{
+		timers.schedule(_port->reconnect_timer, _port->backoff.nextDelayMs());
+	}
+}
+
+void SerialReactor::readPort(Port* _port)
+{
+	unsigned char buffer[INTERACTIVE_DEVICE_READ_CHUNK];
+
+	while (true)
+	{
+		ssize_t bytes_read = read(_port->fd, buffer, sizeof(buffer));
+
+		if (bytes_read > 0)
+		{
+			_port->device->receiveBytes(buffer, (size_t)bytes_read);
+			continue;
+		}
+
+		if ((bytes_read < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+
+		if ((bytes_read < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+		{
+			disconnectPort(_port, strerror(errno), false);
+		}
+
+		break;
+	}
+
+	flagReady(_port->device);
+}
+
+void SerialReactor::flagReady(InteractiveDevice* _device)
+{
+	for (auto station : _device->getStations())
+	{
+		flagReady(station);
+	}
+
+	if (_device->hasPendingEvents() && !ready.push(_device))
+	{
+		ready_overflow = true;
+	}
+}
+
+/**
+ * Moves the latest queued LED command, or one for each of a gateway's stations, into
+ * the port's out buffer and writes as much as the driver will take. Whatever is left
+ * waits for EPOLLOUT.
+ */
+void SerialReactor::flushPort(Port* _port)
+{
+	if (_port->fd < 0)
+	{
+		return;
+	}
+
+	unsigned char* out = _port->out.data();
+	_port->out_length += _port->device->encodeCommands(out + _port->out_length, _port->out.size() - _port->out_length);
+
+	while (_port->out_length > 0)
+	{
+		ssize_t written = write(_port->fd, out, _port->out_length);
+
+		if (written > 0)
+		{
+			_port->device->recordSent(out, (size_t)written);
+			memmove(out, out + written, _port->out_length - written);
+			_port->out_length -= written;
+		}
+		else if ((written < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		else if ((written < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+		{
+			disconnectPort(_port, strerror(errno), false);
+			return;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	setWaitingForWritable(_port, _port->out_length > 0);
+}
+
+void SerialReactor::setWaitingForWritable(Port* _port, bool _waiting)
+{
+	if (_port->waiting_for_writable == _waiting)
+	{
+		return;
+	}
+
+	struct epoll_event event;
+	event.events = EPOLLIN | (_waiting ? EPOLLOUT : 0);
+	event.data.ptr = _port;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, _port->fd, &event);
+	_port->waiting_for_writable = _waiting;
+}
+
+void SerialReactor::closePort(Port* _port)
+{
+	if (_port->fd < 0)
+	{
+		return;
+	}
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, _port->fd, NULL);
+	close(_port->fd);
+	_port->heartbeat_timer.cancel();
+	_port->fd = -1;
+	_port->out_length = 0;
+	_port->waiting_for_writable = false;
+	_port->device->resetParser();
+	_port->device->setConnected(false);
+}
+
+#endif
@@ -0,0 +1,160 @@
+#pragma once
+
+//	The reactor is only available on Linux, where every controller tty can be put in
+//	a single epoll set. On other platforms each InteractiveDevice keeps its own
+//	polling I/O thread.
+#ifdef __linux__
+#define SERIAL_REACTOR_ENABLED
+#endif
+
+#ifdef SERIAL_REACTOR_ENABLED
+
+#include "InteractiveDevice.h"
+#include "ReconnectBackoff.h"
+#include "SpscRing.h"
+#include "TimerWheel.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//	Number of devices that can be flagged as having new events between two frames
+//	before the render thread falls back to checking every device. Must be a power of two.
+#define SERIAL_REACTOR_READY_RING_SIZE 256
+
+//	Maximum number of epoll events handled per wakeup.
+#define SERIAL_REACTOR_MAX_EVENTS 32
+
+//	Threads opening ttys. Opening a Bluetooth port can block for seconds, so ports are
+//	opened this many at a time, off the reactor's thread.
+#define SERIAL_REACTOR_OPEN_THREADS 4
+
+//	Bytes of LED commands that can be waiting on a port whose driver buffer is full.
+//	Room for several v2 packets of PACKET_ENCODED_LIMIT bytes. A gateway's port gets room
+//	for two rounds of its stations' messages instead, if that is more.
+#define SERIAL_REACTOR_OUT_BUFFER 256
+
+//	One thread, one epoll set, every controller port. The thread sleeps in epoll_wait()
+//	until a tty has bytes or the render thread queues an LED command, so an idle
+//	installation costs no CPU no matter how many controllers are connected.
+//
+//	Received bytes go through the device's own frame parser and event ring exactly as
+//	they would on the device's I/O thread. Devices that produced events are also pushed
+//	onto a ready ring, so the render thread only visits devices that have something
+//	for it.
+//
+//	Ports that hang up, fail, or are asked to reconnect are closed and reopened with
+//	exponential backoff, each attempt a timer on the reactor's TimerWheel. The open
+//	itself runs on a WorkerPool and is handed back to the reactor's thread, which never
+//	waits on a port that is slow to open, at startup or after. epoll_wait()
+//	sleeps until the wheel's next timer is due, and the device's last LED state is
+//	written again once its port is back. Each port's heartbeat is a timer on the same
+//	wheel, and a port whose controller stops answering is reconnected on its own.
+//
+//	Devices can also be attached and detached while the reactor runs, when config.json
+//	is reloaded. Either way the port is opened or closed on the reactor's thread.
+//
+//	A gateway is added like any other device, and its stations are not added at all.
+//	Each of its stations that produced events is pushed onto the ready ring on its own.
+class SerialReactor
+{
+public:
+	SerialReactor();
+	~SerialReactor();
+
+	//	Adds a device whose port (recorded by InteractiveDevice::setup()) is opened once
+	//	start() is called, alongside every other port, and retried with backoff if that
+	//	fails. Must be called before start().
+	void addDevice(InteractiveDevice* _device);
+
+	void start();
+	void stop();
+
+	//	Render thread. Adds a device while the reactor is running. Its port is opened on
+	//	the reactor's thread, and retried with backoff like a lost port if it isn't there
+	//	yet, so the render thread never waits on it.
+	void attachDevice(InteractiveDevice* _device);
+
+	//	Render thread. Writes the LED command the device has queued, if any, closes its
+	//	port and lets go of the device, on the reactor's thread. takeDetachedDevice() then
+	//	returns the device once the reactor no longer refers to it, other than in the
+	//	ready ring, which the render thread should drain once more before deleting it.
+	void detachDevice(InteractiveDevice* _device);
+	bool takeDetachedDevice(InteractiveDevice*& _device);
+
+	//	Render thread only. Returns false once no more devices have been flagged.
+	bool pollReadyDevice(InteractiveDevice*& _device);
+
+	//	Render thread only. True if the ready ring overflowed since the last call, in
+	//	which case every device should be checked once.
+	bool takeReadyOverflow();
+
+private:
+	struct Port
+	{
+		InteractiveDevice* device;
+		int fd;
+		std::vector<unsigned char> out;
+		size_t out_length;
+		bool waiting_for_writable;
+		ReconnectBackoff backoff;
+		Timer reconnect_timer;
+		Timer heartbeat_timer;
+
+		//	Set while the port is being opened on the WorkerPool.
+		bool opening;
+	};
+
+	//	A tty opened on the WorkerPool, -1 if it couldn't be.
+	struct OpenedTty
+	{
+		Port* port;
+		int fd;
+	};
+
+	int epoll_fd;
+	int wake_fd;
+
+	//	Declared ahead of the ports, whose timers must be cancelled before it goes.
+	TimerWheel timers;
+	std::vector<std::unique_ptr<Port>> ports;
+	std::thread reactor_thread;
+	std::atomic<bool> running;
+	SpscRing<InteractiveDevice*, SERIAL_REACTOR_READY_RING_SIZE> ready;
+	std::atomic<bool> ready_overflow;
+
+	//	Devices being attached or detached while running, handed over under the mutex.
+	std::mutex changes_mutex;
+	std::vector<InteractiveDevice*> attaching;
+	std::vector<InteractiveDevice*> detaching;
+	std::vector<InteractiveDevice*> detached;
+	std::vector<OpenedTty> opened;
+
+	//	Ports detached while still being opened, kept until their open has finished.
+	std::vector<std::unique_ptr<Port>> closing;
+	WorkerPool openers;
+
+	Port* createPort(InteractiveDevice* _device);
+	void applyDeviceChanges();
+	void wake();
+	void reactorLoop();
+	void readPort(Port* _port);
+	void flagReady(InteractiveDevice* _device);
+	void flushPort(Port* _port);
+	void closePort(Port* _port);
+	void disconnectPort(Port* _port, const char* _reason, bool _retry_now);
+	void beginOpen(Port* _port);
+	void finishOpen(Port* _port, int _fd);
+	bool registerPort(Port* _port, int _fd);
+	void reconnectPort(Port* _port);
+	void heartbeatPort(Port* _port);
+	void scheduleHeartbeat(Port* _port);
+	int millisUntilNextTimer();
+	void setWaitingForWritable(Port* _port, bool _waiting);
+};
+
+#endif
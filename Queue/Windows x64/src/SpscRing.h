@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+//	Bounded single-producer/single-consumer ring buffer.
+//
+//	Exactly one thread may call push() and exactly one (other) thread may call pop().
+//	Neither side ever blocks or allocates: push() fails when the ring is full and pop()
+//	fails when it is empty. Capacity must be a power of two so that the indices can be
+//	wrapped with a mask instead of a modulo.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two.");
+
+public:
+	SpscRing() : head(0), tail(0), dropped(0) {}
+
+	//	Called by the producer thread only. Returns false (and counts the item as dropped)
+	//	if the consumer has fallen a full ring behind.
+	bool push(const T& _item)
+	{
+		size_t current_tail = tail.load(std::memory_order_relaxed);
+		size_t current_head = head.load(std::memory_order_acquire);
+
+		if (current_tail - current_head >= Capacity)
+		{
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		slots[current_tail & (Capacity - 1)] = _item;
+		tail.store(current_tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	//	Called by the consumer thread only.
+	bool pop(T& _item)
+	{
+		size_t current_head = head.load(std::memory_order_relaxed);
+		size_t current_tail = tail.load(std::memory_order_acquire);
+
+		if (current_head == current_tail)
+		{
+			return false;
+		}
+
+		_item = slots[current_head & (Capacity - 1)];
+		head.store(current_head + 1, std::memory_order_release);
+		return true;
+	}
+
+	//	Approximate when called while the other side is running.
+	size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	bool empty() const
+	{
+		return size() == 0;
+	}
+
+	size_t droppedCount() const
+	{
+		return dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	T slots[Capacity];
+
+	//	head and tail are padded onto separate cache lines so the producer and consumer
+	//	don't invalidate each other's line on every operation. Padding is used rather than
+	//	alignas so that rings can live inside heap allocated objects under C++14.
+	char head_padding[64];
+	std::atomic<size_t> head;
+	char tail_padding[64];
+	std::atomic<size_t> tail;
+	std::atomic<size_t> dropped;
+};
@@ -0,0 +1,127 @@
+
+#include "StationVideoPlayer.h"
+
+StationVideoPlayer::StationVideoPlayer()
+	: overlay(NULL), overlay_station(NULL), outgoing(NULL), outgoing_station(NULL), prerolled(false), first_frame_pending(false), first_frame_ready(false), start_us(0), presented_us(0)
+{
+}
+
+void StationVideoPlayer::onQueued(QueueStation* _station)
+{
+	pool.acquire(deviceOf(_station));
+}
+
+void StationVideoPlayer::onDequeued(QueueStation* _station)
+{
+	pool.release(deviceOf(_station));
+}
+
+bool StationVideoPlayer::isReady(QueueStation* _station)
+{
+	ofVideoPlayer* video = deviceOf(_station)->video;
+	return (video != NULL) && video->isLoaded();
+}
+
+/**
+ * The overlay holds its own reference on the pooled player, so it stays open through
+ * its fade out even if its station leaves the queue meanwhile. Starting another while
+ * there is an overlay is a crossfade, and the overlay carries on as the outgoing one.
+ */
+void StationVideoPlayer::start(QueueStation* _station)
+{
+	if (overlay != NULL)
+	{
+		outgoing = overlay;
+		outgoing_station = overlay_station;
+	}
+
+	overlay = pool.acquire(deviceOf(_station));
+	overlay_station = _station;
+	prerolled = preroller.take(overlay);
+
+	//	A prerolled clip is already paused on its decoded first frame, so starting it is
+	//	only a matter of unpausing it.
+	if (prerolled)
+	{
+		overlay->setPaused(false);
+	}
+	else
+	{
+		overlay->setLoopState(OF_LOOP_NONE);
+		overlay->firstFrame();
+		overlay->play();
+	}
+
+	start_us = clock.nowMicros();
+	presented_us = 0;
+	first_frame_pending = true;
+	first_frame_ready = prerolled;
+}
+
+void StationVideoPlayer::stop(QueueStation* _station)
+{
+	pool.release(deviceOf(_station));
+
+	if (_station == outgoing_station)
+	{
+		outgoing = NULL;
+		outgoing_station = NULL;
+		return;
+	}
+
+	overlay = NULL;
+	overlay_station = NULL;
+	first_frame_pending = false;
+}
+
+float StationVideoPlayer::getPosition()
+{
+	return (overlay != NULL) ? overlay->getPosition() : 0;
+}
+
+float StationVideoPlayer::getDuration()
+{
+	return (overlay != NULL) ? overlay->getDuration() : 0;
+}
+
+void StationVideoPlayer::update(const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current)
+{
+	preroller.update(_queue, _current, outgoing_station);
+
+	//	Trimming only after the preroller has let go of dequeued clips means it never
+	//	holds a player the pool has closed.
+	pool.trim();
+}
+
+void StationVideoPlayer::framePresented()
+{
+	if (first_frame_pending && first_frame_ready && (presented_us == 0))
+	{
+		presented_us = clock.nowMicros();
+	}
+}
+
+/**
+ * A prerolled clip's first frame is already in its texture, so it is ready the moment
+ * it starts, while a cold start is ready once its player has decoded a frame. Either
+ * way the time taken runs to the draw that put the frame on screen, so the two can be
+ * compared.
+ */
+bool StationVideoPlayer::takeFirstFrame(double& _latency_ms, bool& _prerolled)
+{
+	if (!first_frame_pending || (overlay == NULL))
+	{
+		return false;
+	}
+
+	if (presented_us == 0)
+	{
+		first_frame_ready = first_frame_ready || overlay->isFrameNew();
+		return false;
+	}
+
+	first_frame_pending = false;
+	_latency_ms = (presented_us - start_us) / 1000.0;
+	_prerolled = prerolled;
+	return true;
+}
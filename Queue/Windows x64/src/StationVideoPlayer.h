@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ofMain.h"
+#include "InteractiveDevice.h"
+#include "OverlayPreroller.h"
+#include "QueueInterfaces.h"
+#include "VideoPool.h"
+
+#include <cstdint>
+
+//	The app's QueuePlayer. Opens station clips in the VideoPool while they are queued,
+//	keeps the next few prerolled, and plays the one QueueCore starts as the overlay.
+//	During a crossfade the overlay before it keeps playing as the outgoing overlay.
+class StationVideoPlayer : public QueuePlayer
+{
+public:
+	StationVideoPlayer();
+
+	void setupPool(size_t _max_instances, size_t _max_memory_mb) { pool.setup(_max_instances, _max_memory_mb); }
+	void setUseTexture(bool _use_texture) { pool.setUseTexture(_use_texture); }
+
+	void onQueued(QueueStation* _station) override;
+	void onDequeued(QueueStation* _station) override;
+	bool isReady(QueueStation* _station) override;
+	void start(QueueStation* _station) override;
+	void stop(QueueStation* _station) override;
+	float getPosition() override;
+	float getDuration() override;
+
+	//	Called once per frame after QueueCore::update(). Prerolls the clips queued after
+	//	_current and closes cold ones.
+	void update(const IntrusiveQueue<QueueStation>& _queue, QueueStation* _current);
+
+	//	Closes the device's clip, see VideoPool::forget(). Only called once the device is
+	//	neither queued nor the overlay, after update(), so the preroller has let go of it.
+	bool closeClip(InteractiveDevice* _device) { return pool.forget(_device); }
+
+	//	The player on screen, or NULL.
+	ofVideoPlayer* getOverlay() const { return overlay; }
+
+	//	The player being crossfaded out of, under the overlay, or NULL.
+	ofVideoPlayer* getOutgoing() const { return outgoing; }
+
+	//	Called at the start of every draw(). The first draw after the overlay started last
+	//	has a frame ready is the one that puts it on screen.
+	void framePresented();
+
+	//	Returns true once, after the overlay started last has been put on screen, along
+	//	with how long that took and whether it had been prerolled.
+	bool takeFirstFrame(double& _latency_ms, bool& _prerolled);
+
+private:
+	VideoPool pool;
+	OverlayPreroller preroller;
+	ofVideoPlayer* overlay;
+	QueueStation* overlay_station;
+	ofVideoPlayer* outgoing;
+	QueueStation* outgoing_station;
+	bool prerolled;
+	bool first_frame_pending;
+	bool first_frame_ready;
+	uint64_t start_us;
+	uint64_t presented_us;
+	SteadyQueueClock clock;
+
+	static InteractiveDevice* deviceOf(QueueStation* _station) { return static_cast<InteractiveDevice*>(_station); }
+};
@@ -0,0 +1,293 @@
+
+#include "TimerWheel.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static int lowestBit(uint64_t _value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, _value);
+	return (int)index;
+#else
+	return __builtin_ctzll(_value);
+#endif
+}
+
+/**
+ * How many slots after _from (exclusive) the next occupied slot of a level is. The
+ * level's bits are rotated so that bit 0 is the slot after _from.
+ */
+static uint64_t slotsUntilOccupied(uint64_t _occupied, uint64_t _from)
+{
+	unsigned shift = (unsigned)((_from + 1) & TIMER_WHEEL_SLOT_MASK);
+	uint64_t rotated = (shift == 0) ? _occupied : ((_occupied >> shift) | (_occupied << (64 - shift)));
+	return (uint64_t)lowestBit(rotated) + 1;
+}
+
+static void initList(Timer& _list, Timer*& _prev, Timer*& _next)
+{
+	_prev = &_list;
+	_next = &_list;
+}
+
+void Timer::cancel()
+{
+	if (wheel != NULL)
+	{
+		wheel->unlink(*this);
+	}
+}
+
+TimerWheel::TimerWheel()
+	: now_ms(0), count(0)
+{
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		occupied[level] = 0;
+
+		for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+		{
+			initList(slots[level][slot], slots[level][slot].prev, slots[level][slot].next);
+		}
+	}
+
+	initList(expired, expired.prev, expired.next);
+}
+
+TimerWheel::~TimerWheel()
+{
+	for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++)
+		{
+			while (slots[level][slot].next != &slots[level][slot])
+			{
+				unlink(*slots[level][slot].next);
+			}
+		}
+	}
+
+	while (expired.next != &expired)
+	{
+		unlink(*expired.next);
+	}
+}
+
+void TimerWheel::reset(uint64_t _now_ms)
+{
+	now_ms = _now_ms;
+}
+
+void TimerWheel::scheduleAt(Timer& _timer, uint64_t _due_ms)
+{
+	_timer.cancel();
+	_timer.due_ms = _due_ms;
+	insert(_timer);
+}
+
+/**
+ * A timer goes in the lowest level whose turn covers the time until it is due, in the
+ * slot its due time falls in. One too far out for the top level goes in the top level's
+ * last slot and is placed again when that slot is moved down.
+ */
+void TimerWheel::insert(Timer& _timer)
+{
+	Timer* list = &expired;
+
+	if (_timer.due_ms > now_ms)
+	{
+		uint64_t due = _timer.due_ms;
+		uint64_t delta = due - now_ms;
+		int level = 0;
+
+		while ((level < TIMER_WHEEL_LEVELS - 1) && (delta >= ((uint64_t)1 << (TIMER_WHEEL_SLOT_BITS * (level + 1)))))
+		{
+			level++;
+		}
+
+		const uint64_t reach = (uint64_t)1 << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS);
+		if (delta >= reach)
+		{
+			due = now_ms + reach - 1;
+		}
+
+		int slot = (int)((due >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_SLOT_MASK);
+		list = &slots[level][slot];
+		occupied[level] |= (uint64_t)1 << slot;
+	}
+
+	_timer.wheel = this;
+	_timer.list = list;
+	_timer.prev = list->prev;
+	_timer.next = list;
+	list->prev->next = &_timer;
+	list->prev = &_timer;
+	count++;
+}
+
+void TimerWheel::unlink(Timer& _timer)
+{
+	Timer* list = _timer.list;
+
+	_timer.prev->next = _timer.next;
+	_timer.next->prev = _timer.prev;
+	_timer.wheel = NULL;
+	_timer.list = NULL;
+	_timer.prev = NULL;
+	_timer.next = NULL;
+	count--;
+
+	//	The slot's bit is cleared once it is empty. Timers being run sit on a list of
+	//	runList()'s own, which has no bit.
+	size_t index = (size_t)(list - &slots[0][0]);
+	if ((list->next == list) && (list >= &slots[0][0]) && (index < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS))
+	{
+		occupied[index / TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (index % TIMER_WHEEL_SLOTS));
+	}
+}
+
+/**
+ * Moves every timer in _list onto _into, which must be empty, and clears the slot's bit
+ * if _list is a slot.
+ */
+void TimerWheel::takeList(Timer& _list, Timer& _into)
+{
+	initList(_into, _into.prev, _into.next);
+
+	size_t index = (size_t)(&_list - &slots[0][0]);
+	if ((&_list >= &slots[0][0]) && (index < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS))
+	{
+		occupied[index / TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (index % TIMER_WHEEL_SLOTS));
+	}
+
+	if (_list.next == &_list)
+	{
+		return;
+	}
+
+	_into.next = _list.next;
+	_into.prev = _list.prev;
+	_into.next->prev = &_into;
+	_into.prev->next = &_into;
+	initList(_list, _list.prev, _list.next);
+
+	for (Timer* timer = _into.next; timer != &_into; timer = timer->next)
+	{
+		timer->list = &_into;
+	}
+}
+
+/**
+ * The timers are taken off _list first, so that a callback that schedules a timer for
+ * now has it run on the next advance() rather than in this loop.
+ */
+void TimerWheel::runList(Timer& _list)
+{
+	Timer running;
+	takeList(_list, running);
+
+	while (running.next != &running)
+	{
+		Timer* timer = running.next;
+		unlink(*timer);
+
+		if (timer->due_ms > now_ms)
+		{
+			insert(*timer);
+		}
+		else if (timer->callback)
+		{
+			timer->callback();
+		}
+	}
+}
+
+/**
+ * Called as the wheel reaches the start of a slot of _level, which happens with every
+ * level below it at slot 0. Moves the slot's timers down to wherever they now belong.
+ */
+void TimerWheel::cascade(int _level)
+{
+	int slot = (int)((now_ms >> (TIMER_WHEEL_SLOT_BITS * _level)) & TIMER_WHEEL_SLOT_MASK);
+
+	if ((slot == 0) && (_level + 1 < TIMER_WHEEL_LEVELS))
+	{
+		cascade(_level + 1);
+	}
+
+	Timer moving;
+	takeList(slots[_level][slot], moving);
+
+	while (moving.next != &moving)
+	{
+		Timer* timer = moving.next;
+		unlink(*timer);
+		insert(*timer);
+	}
+}
+
+void TimerWheel::advance(uint64_t _now_ms)
+{
+	runList(expired);
+
+	while (now_ms < _now_ms)
+	{
+		uint64_t next_ms = nextDueMillis();
+
+		if (next_ms > _now_ms)
+		{
+			now_ms = _now_ms;
+			break;
+		}
+
+		now_ms = (next_ms > now_ms) ? next_ms : now_ms + 1;
+
+		if ((now_ms & TIMER_WHEEL_SLOT_MASK) == 0)
+		{
+			cascade(1);
+		}
+
+		runList(slots[0][now_ms & TIMER_WHEEL_SLOT_MASK]);
+		runList(expired);
+	}
+}
+
+/**
+ * The next occupied slot of the lowest level, or the next time a higher level's
+ * occupied slot is due to be moved down, whichever comes first.
+ */
+uint64_t TimerWheel::nextDueMillis() const
+{
+	if (expired.next != &expired)
+	{
+		return now_ms;
+	}
+
+	uint64_t next_ms = UINT64_MAX;
+
+	if (occupied[0] != 0)
+	{
+		next_ms = now_ms + slotsUntilOccupied(occupied[0], now_ms);
+	}
+
+	for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		if (occupied[level] != 0)
+		{
+			uint64_t turn = now_ms >> (TIMER_WHEEL_SLOT_BITS * level);
+			uint64_t cascade_ms = (turn + slotsUntilOccupied(occupied[level], turn)) << (TIMER_WHEEL_SLOT_BITS * level);
+
+			if (cascade_ms < next_ms)
+			{
+				next_ms = cascade_ms;
+			}
+		}
+	}
+
+	return next_ms;
+}
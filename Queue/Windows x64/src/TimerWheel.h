@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+//	Each level of the wheel has 2^TIMER_WHEEL_SLOT_BITS slots, and each slot of a level
+//	spans a whole turn of the level below. With 1 ms ticks, four levels of 64 slots
+//	reach about four and a half hours; anything further out waits in the top level and
+//	is put back when its slot comes round.
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+class TimerWheel;
+
+//	Something to be done at a given time, owned by whoever schedules it. A Timer is
+//	linked into its wheel's slots directly, so scheduling and cancelling never search or
+//	allocate, and a Timer that is destroyed cancels itself.
+class Timer
+{
+public:
+	Timer() : wheel(NULL), list(NULL), prev(NULL), next(NULL), due_ms(0) {}
+	~Timer() { cancel(); }
+
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+
+	//	Called by TimerWheel::advance() on the wheel's thread once the timer is due. It
+	//	may schedule this or any other timer again.
+	std::function<void()> callback;
+
+	bool isScheduled() const { return wheel != NULL; }
+	uint64_t getDueMillis() const { return due_ms; }
+
+	void cancel();
+
+private:
+	friend class TimerWheel;
+
+	TimerWheel* wheel;
+	Timer* list;
+	Timer* prev;
+	Timer* next;
+	uint64_t due_ms;
+};
+
+//	Hierarchical timer wheel with 1 ms ticks. schedule(), cancel() and the expiry of each
+//	timer are O(1), and advance() skips straight over empty stretches of time, so a
+//	thread can sleep until nextDueMillis() instead of polling for its deadlines.
+//
+//	Not thread safe: a wheel and its timers belong to the one thread that advances it,
+//	such as a device's I/O thread or the SerialReactor.
+class TimerWheel
+{
+public:
+	TimerWheel();
+	~TimerWheel();
+
+	//	Sets the wheel's time without running anything. Call before the first schedule().
+	void reset(uint64_t _now_ms);
+
+	//	(Re)schedules _timer to be due at _due_ms. A time that has already passed makes
+	//	it due at the next advance().
+	void scheduleAt(Timer& _timer, uint64_t _due_ms);
+	void schedule(Timer& _timer, uint64_t _delay_ms) { scheduleAt(_timer, now_ms + _delay_ms); }
+
+	//	Moves the wheel on to _now_ms, running the callback of every timer that is due by
+	//	then, in order of the slots they expire in.
+	void advance(uint64_t _now_ms);
+
+	//	The earliest time the wheel needs advancing, which may be a little before the next
+	//	timer is actually due when timers are moved down from a higher level. UINT64_MAX
+	//	if nothing is scheduled.
+	uint64_t nextDueMillis() const;
+
+	uint64_t nowMillis() const { return now_ms; }
+	bool empty() const { return count == 0; }
+
+private:
+	friend class Timer;
+
+	//	Each slot is a circular list with a sentinel, and occupied has a bit set for
+	//	every non-empty slot, so the next one can be found with a bit scan.
+	Timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	uint64_t occupied[TIMER_WHEEL_LEVELS];
+	Timer expired;
+	uint64_t now_ms;
+	size_t count;
+
+	void insert(Timer& _timer);
+	void unlink(Timer& _timer);
+	void takeList(Timer& _list, Timer& _into);
+	void cascade(int _level);
+	void runList(Timer& _list);
+};
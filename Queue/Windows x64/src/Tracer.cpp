@@ -0,0 +1,257 @@
+
+#include "Tracer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//	A thread's buffer. Buffers are kept for the life of the process, so an event a
+//	thread records just as it exits is never written into freed memory.
+struct TraceThread
+{
+	SpscRing<TraceEvent, TRACE_BUFFER_EVENTS> events;
+	std::string name;
+	int id;
+};
+
+std::atomic<bool> Tracer::enabled(false);
+
+static std::mutex threads_mutex;
+static std::vector<TraceThread*> threads;
+static thread_local TraceThread* current_thread = NULL;
+
+static std::mutex writer_mutex;
+static std::condition_variable writer_wake;
+static std::thread writer;
+static bool writer_running = false;
+static std::ofstream file;
+static bool first_event = true;
+static uint64_t trace_start_us = 0;
+
+uint64_t Tracer::nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static TraceThread* currentThread()
+{
+	if (current_thread == NULL)
+	{
+		std::lock_guard<std::mutex> lock(threads_mutex);
+		current_thread = new TraceThread();
+		current_thread->id = (int)threads.size() + 1;
+		current_thread->name = "thread " + std::to_string(current_thread->id);
+		threads.push_back(current_thread);
+	}
+
+	return current_thread;
+}
+
+bool Tracer::start(const std::string& _path)
+{
+	if (isEnabled())
+	{
+		return true;
+	}
+
+	file.open(_path, std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	//	The JSON array format, which lets the trace still be opened if the app dies
+	//	before the closing bracket is written.
+	file << "[";
+	first_event = true;
+	trace_start_us = nowMicros();
+
+	writer_running = true;
+	writer = std::thread(&Tracer::writerLoop);
+	enabled = true;
+	return true;
+}
+
+void Tracer::stop()
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	enabled = false;
+
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		writer_running = false;
+	}
+
+	writer_wake.notify_one();
+	writer.join();
+	file.close();
+}
+
+void Tracer::setThreadName(const std::string& _name)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	TraceThread* thread = currentThread();
+
+	std::lock_guard<std::mutex> lock(threads_mutex);
+	thread->name = _name;
+}
+
+void Tracer::record(TraceEvent& _event, const char* _detail)
+{
+	_event.detail[0] = 0;
+
+	if (_detail != NULL)
+	{
+		strncpy(_event.detail, _detail, TRACE_DETAIL_LENGTH - 1);
+		_event.detail[TRACE_DETAIL_LENGTH - 1] = 0;
+	}
+
+	currentThread()->events.push(_event);
+}
+
+void Tracer::complete(const char* _category, const char* _name, uint64_t _start_us, uint64_t _duration_us, const char* _detail)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	TraceEvent event = { _name, _category, _start_us, _duration_us, 0, 'X', {} };
+	record(event, _detail);
+}
+
+void Tracer::instant(const char* _category, const char* _name, const char* _detail)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	TraceEvent event = { _name, _category, nowMicros(), 0, 0, 'i', {} };
+	record(event, _detail);
+}
+
+void Tracer::counter(const char* _name, int64_t _value)
+{
+	if (!isEnabled())
+	{
+		return;
+	}
+
+	TraceEvent event = { _name, "counter", nowMicros(), 0, _value, 'C', {} };
+	record(event, NULL);
+}
+
+static std::string escapeJson(const char* _text)
+{
+	std::string escaped;
+
+	for (const char* c = _text; *c != 0; c++)
+	{
+		if ((*c == '"') || (*c == '\\'))
+		{
+			escaped += '\\';
+		}
+
+		if ((unsigned char)*c >= 0x20)
+		{
+			escaped += *c;
+		}
+	}
+
+	return escaped;
+}
+
+static void writeEvent(const TraceEvent& _event, int _thread_id)
+{
+	file << (first_event ? "\n" : ",\n");
+	first_event = false;
+
+	uint64_t time_us = (_event.time_us > trace_start_us) ? (_event.time_us - trace_start_us) : 0;
+
+	file << "{\"name\":\"" << escapeJson(_event.name) << "\",\"cat\":\"" << _event.category << "\",\"ph\":\"" << _event.phase
+		<< "\",\"ts\":" << time_us << ",\"pid\":1,\"tid\":" << _thread_id;
+
+	switch (_event.phase)
+	{
+	case 'X':
+		file << ",\"dur\":" << _event.duration_us;
+		break;
+
+	case 'i':
+		file << ",\"s\":\"t\"";
+		break;
+
+	case 'C':
+		file << ",\"args\":{\"value\":" << _event.value << "}";
+		break;
+	}
+
+	if (_event.detail[0] != 0)
+	{
+		file << ",\"args\":{\"detail\":\"" << escapeJson(_event.detail) << "\"}";
+	}
+
+	file << "}";
+}
+
+static void drainThreads()
+{
+	std::lock_guard<std::mutex> lock(threads_mutex);
+
+	for (auto thread : threads)
+	{
+		TraceEvent event;
+		while (thread->events.pop(event))
+		{
+			writeEvent(event, thread->id);
+		}
+	}
+}
+
+/**
+ * Drains every thread's buffer each TRACE_FLUSH_MS. Once stopped, the last events are
+ * written along with each thread's name and how many of its events were dropped.
+ */
+void Tracer::writerLoop()
+{
+	bool keep_running = true;
+
+	while (keep_running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(writer_mutex);
+			writer_wake.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_MS), [] { return !writer_running; });
+			keep_running = writer_running;
+		}
+
+		drainThreads();
+		file.flush();
+	}
+
+	std::lock_guard<std::mutex> lock(threads_mutex);
+
+	for (auto thread : threads)
+	{
+		file << (first_event ? "\n" : ",\n");
+		first_event = false;
+
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+			<< ",\"args\":{\"name\":\"" << escapeJson(thread->name.c_str()) << "\",\"events_dropped\":" << thread->events.droppedCount() << "}}";
+	}
+
+	file << "\n]\n";
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "SpscRing.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+//	Events each thread can have waiting for the tracer's writer. A thread that gets
+//	further ahead than this has its newest events dropped, and the drops are counted in
+//	the trace. Must be a power of two.
+#define TRACE_BUFFER_EVENTS 4096
+
+//	How often the writer thread empties the threads' buffers into the file.
+#define TRACE_FLUSH_MS 50
+
+//	How much of an event's detail is kept. Details are copied, cut short at
+//	TRACE_DETAIL_LENGTH - 1 characters, as the device whose port they name may be
+//	deleted by a config reload before the writer gets to the event.
+#define TRACE_DETAIL_LENGTH 64
+
+//	One trace event. name and category are not copied, so they must be string literals.
+//	An empty detail is left out of the trace.
+struct TraceEvent
+{
+	const char* name;
+	const char* category;
+	uint64_t time_us;
+	uint64_t duration_us;
+	int64_t value;
+	char phase;
+	char detail[TRACE_DETAIL_LENGTH];
+};
+
+//	Opt-in tracing of the app's threads to a Chrome trace event JSON file, which opens
+//	in chrome://tracing or ui.perfetto.dev. Every thread that records an event gets its
+//	own lock-free buffer the first time it does, which only it writes to, and the
+//	writer thread drains all of them into the file. While no trace is running,
+//	recording an event costs one relaxed atomic load.
+//
+//	Process-wide, so the queue core and device I/O threads can trace without the app
+//	handing a tracer to each of them.
+class Tracer
+{
+public:
+	//	Creates the file and starts the writer thread. Returns false if the file can't
+	//	be created.
+	static bool start(const std::string& _path);
+
+	//	Writes out everything still buffered and closes the file.
+	static void stop();
+
+	static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	//	Names the calling thread in the trace. The name is copied.
+	static void setThreadName(const std::string& _name);
+
+	//	A span of _duration_us that began at _start_us (see nowMicros()).
+	static void complete(const char* _category, const char* _name, uint64_t _start_us, uint64_t _duration_us, const char* _detail = NULL);
+
+	//	Something that happened at one moment, on the calling thread.
+	static void instant(const char* _category, const char* _name, const char* _detail = NULL);
+
+	//	A value plotted over time, such as the queue depth.
+	static void counter(const char* _name, int64_t _value);
+
+	static uint64_t nowMicros();
+
+private:
+	static std::atomic<bool> enabled;
+
+	static void record(TraceEvent& _event, const char* _detail);
+	static void writerLoop();
+};
+
+//	Traces the time from its construction to the end of its scope as one span.
+class TraceScope
+{
+public:
+	TraceScope(const char* _category, const char* _name, const char* _detail = NULL)
+		: category(_category), name(_name), detail(_detail), start_us(Tracer::isEnabled() ? Tracer::nowMicros() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if ((start_us != 0) && Tracer::isEnabled())
+		{
+			Tracer::complete(category, name, start_us, Tracer::nowMicros() - start_us, detail);
+		}
+	}
+
+private:
+	const char* category;
+	const char* name;
+	const char* detail;
+	uint64_t start_us;
+};
@@ -0,0 +1,197 @@
+
+#include "TrafficLog.h"
+
+#include <chrono>
+#include <cstring>
+
+static uint64_t nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putLittleEndian(std::vector<unsigned char>& _out, uint64_t _value, int _bytes)
+{
+	for (int i = 0; i < _bytes; i++)
+	{
+		_out.push_back((unsigned char)(_value >> (8 * i)));
+	}
+}
+
+static uint64_t getLittleEndian(const unsigned char* _in, int _bytes)
+{
+	uint64_t value = 0;
+
+	for (int i = 0; i < _bytes; i++)
+	{
+		value |= (uint64_t)_in[i] << (8 * i);
+	}
+
+	return value;
+}
+
+TrafficRecorder::TrafficRecorder()
+	: running(false), start_us(0)
+{
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+	close();
+}
+
+bool TrafficRecorder::open(const std::string& _path, const std::vector<TrafficLogDevice>& _devices)
+{
+	close();
+
+	file.open(_path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	std::vector<unsigned char> header(TRAFFIC_LOG_MAGIC, TRAFFIC_LOG_MAGIC + 4);
+	header.push_back(TRAFFIC_LOG_VERSION);
+	header.push_back((unsigned char)_devices.size());
+
+	for (auto& device : _devices)
+	{
+		size_t port_length = (device.port.size() < 255) ? device.port.size() : 255;
+
+		header.push_back(device.id);
+		header.push_back((unsigned char)port_length);
+		header.insert(header.end(), device.port.begin(), device.port.begin() + port_length);
+	}
+
+	file.write((const char*)header.data(), header.size());
+
+	start_us = nowMicros();
+	running = true;
+	writer = std::thread(&TrafficRecorder::writerLoop, this);
+	return true;
+}
+
+void TrafficRecorder::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running)
+		{
+			return;
+		}
+		running = false;
+	}
+
+	wake.notify_one();
+	writer.join();
+	file.close();
+}
+
+void TrafficRecorder::record(uint8_t _device, TrafficDirection _direction, const unsigned char* _data, size_t _length)
+{
+	uint64_t time_us = nowMicros();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!running)
+	{
+		return;
+	}
+
+	//	Longer writes than a u16 length can describe are split over several records.
+	while (_length > 0)
+	{
+		size_t length = (_length < 0xFFFF) ? _length : 0xFFFF;
+
+		putLittleEndian(pending, time_us - start_us, 8);
+		pending.push_back(_device);
+		pending.push_back(_direction);
+		putLittleEndian(pending, length, 2);
+		pending.insert(pending.end(), _data, _data + length);
+
+		_data += length;
+		_length -= length;
+	}
+}
+
+void TrafficRecorder::writerLoop()
+{
+	std::vector<unsigned char> batch;
+	bool keep_running = true;
+
+	while (keep_running)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait_for(lock, std::chrono::milliseconds(TRAFFIC_LOG_FLUSH_MS), [this] { return !running; });
+			keep_running = running;
+			batch.swap(pending);
+		}
+
+		if (!batch.empty())
+		{
+			file.write((const char*)batch.data(), batch.size());
+			file.flush();
+			batch.clear();
+		}
+	}
+}
+
+bool TrafficLogReader::open(const std::string& _path)
+{
+	devices.clear();
+
+	file.open(_path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	unsigned char header[6];
+	if (!file.read((char*)header, sizeof(header)) || (memcmp(header, TRAFFIC_LOG_MAGIC, 4) != 0) || (header[4] != TRAFFIC_LOG_VERSION))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < header[5]; i++)
+	{
+		unsigned char entry[2];
+		if (!file.read((char*)entry, sizeof(entry)))
+		{
+			return false;
+		}
+
+		TrafficLogDevice device;
+		device.id = entry[0];
+		device.port.resize(entry[1]);
+
+		if ((entry[1] > 0) && !file.read(&device.port[0], entry[1]))
+		{
+			return false;
+		}
+
+		devices.push_back(device);
+	}
+
+	return true;
+}
+
+bool TrafficLogReader::next(TrafficRecord& _record)
+{
+	unsigned char header[12];
+	if (!file.read((char*)header, sizeof(header)))
+	{
+		return false;
+	}
+
+	_record.time_us = getLittleEndian(header, 8);
+	_record.device = header[8];
+	_record.direction = (TrafficDirection)header[9];
+	_record.data.resize((size_t)getLittleEndian(header + 10, 2));
+
+	if (!_record.data.empty() && !file.read((char*)_record.data.data(), _record.data.size()))
+	{
+		return false;
+	}
+
+	return true;
+}
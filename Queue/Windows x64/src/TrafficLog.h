@@ -0,0 +1,92 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//	Binary log of the raw serial traffic with every controller, so a session from site
+//	can be replayed through the queue logic later. Everything is little-endian:
+//
+//	header:	"PQTL" | u8 version | u8 device count | per device: u8 id, u8 port length, port
+//	record:	u64 microseconds since recording began | u8 device index | u8 direction
+//			| u16 length | bytes
+//
+//	A record holds whatever one read returned or one write sent, so frames can be split
+//	across records exactly as they were on the wire.
+#define TRAFFIC_LOG_MAGIC "PQTL"
+#define TRAFFIC_LOG_VERSION 1
+
+//	How often the recorder's thread writes what has been recorded out to the file.
+#define TRAFFIC_LOG_FLUSH_MS 100
+
+enum TrafficDirection : uint8_t
+{
+	TRAFFIC_INBOUND = 0,
+	TRAFFIC_OUTBOUND = 1
+};
+
+struct TrafficLogDevice
+{
+	unsigned char id;
+	std::string port;
+};
+
+struct TrafficRecord
+{
+	uint64_t time_us;
+	uint8_t device;
+	TrafficDirection direction;
+	std::vector<unsigned char> data;
+};
+
+//	record() may be called from any number of I/O threads. It only appends to a buffer
+//	in memory; the recorder's own thread does the file writes, so a slow disk never
+//	holds up a port.
+class TrafficRecorder
+{
+public:
+	TrafficRecorder();
+	~TrafficRecorder();
+
+	//	Creates the file (replacing any existing one), writes the header and starts the
+	//	writer thread. Returns false if the file can't be created.
+	bool open(const std::string& _path, const std::vector<TrafficLogDevice>& _devices);
+
+	//	Writes out anything still buffered and closes the file.
+	void close();
+
+	bool isOpen() const { return running; }
+
+	void record(uint8_t _device, TrafficDirection _direction, const unsigned char* _data, size_t _length);
+
+private:
+	std::ofstream file;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<unsigned char> pending;
+	std::thread writer;
+	bool running;
+	uint64_t start_us;
+
+	void writerLoop();
+};
+
+class TrafficLogReader
+{
+public:
+	//	Opens the log and reads its header. Returns false if it isn't a traffic log.
+	bool open(const std::string& _path);
+
+	const std::vector<TrafficLogDevice>& getDevices() const { return devices; }
+
+	//	Returns false at the end of the log, or at a truncated last record.
+	bool next(TrafficRecord& _record);
+
+private:
+	std::ifstream file;
+	std::vector<TrafficLogDevice> devices;
+};
@@ -0,0 +1,165 @@
+
+#include "TrafficReplayer.h"
+#include "Logger.h"
+#include "Tracer.h"
+
+#include <chrono>
+
+TrafficReplayer::TrafficReplayer()
+	: speed(1.0), running(false), finished(false)
+{
+}
+
+TrafficReplayer::~TrafficReplayer()
+{
+	stop();
+}
+
+bool TrafficReplayer::setup(const std::string& _path, const std::vector<InteractiveDevice*>& _devices, double _speed)
+{
+	if (!reader.open(_path))
+	{
+		return false;
+	}
+
+	speed = _speed;
+	all_devices = _devices;
+	devices_by_index.clear();
+
+	const std::vector<TrafficLogDevice>& logged = reader.getDevices();
+
+	for (size_t i = 0; i < logged.size(); i++)
+	{
+		InteractiveDevice* match = NULL;
+
+		//	Stations sharing a port are told apart by their ID.
+		for (auto device : _devices)
+		{
+			if ((device->port == logged[i].port) && ((match == NULL) || (device->id == logged[i].id)))
+			{
+				match = device;
+			}
+		}
+
+		if ((match == NULL) && (i < _devices.size()))
+		{
+			match = _devices[i];
+		}
+
+		if (match == NULL)
+		{
+			LOG_WARNING("Recorded port {} has no matching sensor in config.json, its traffic is skipped.", logged[i].port);
+		}
+
+		devices_by_index.push_back(match);
+	}
+
+	return true;
+}
+
+void TrafficReplayer::start()
+{
+	if (running)
+	{
+		return;
+	}
+
+	running = true;
+	thread = std::thread(&TrafficReplayer::replayLoop, this);
+}
+
+void TrafficReplayer::stop()
+{
+	running = false;
+
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+/**
+ * Nothing writes to a real port during replay, so the commands the queue sends are
+ * taken here instead, or the command rings would fill up.
+ */
+unsigned long TrafficReplayer::drainCommands()
+{
+	unsigned long count = 0;
+	char command;
+
+	for (auto device : all_devices)
+	{
+		while (device->takeCommand(command))
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void TrafficReplayer::replayLoop()
+{
+	Tracer::setThreadName("replay");
+
+	auto start = std::chrono::steady_clock::now();
+	unsigned long inbound_records = 0;
+	unsigned long recorded_commands = 0;
+	unsigned long sent_commands = 0;
+
+	//	One per device, as a v2 packet may have been written in two pieces.
+	std::vector<LedCommandScanner> scanners(devices_by_index.size());
+
+	TrafficRecord record;
+
+	while (running && reader.next(record))
+	{
+		if (record.device >= devices_by_index.size() || (devices_by_index[record.device] == NULL))
+		{
+			continue;
+		}
+
+		if (record.direction == TRAFFIC_OUTBOUND)
+		{
+			scanners[record.device].feed(record.data.data(), record.data.size(), [&](char) {
+				recorded_commands++;
+			});
+			continue;
+		}
+
+		InteractiveDevice* device = devices_by_index[record.device];
+
+		if (speed > 0)
+		{
+			auto due = start + std::chrono::microseconds((uint64_t)(record.time_us / speed));
+
+			while (running && (std::chrono::steady_clock::now() < due))
+			{
+				sent_commands += drainCommands();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		else
+		{
+			while (running && device->hasPendingEvents())
+			{
+				sent_commands += drainCommands();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		device->receiveBytes(record.data.data(), record.data.size());
+		inbound_records++;
+		sent_commands += drainCommands();
+	}
+
+	//	Give the render thread a moment to act on the last events before counting.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	sent_commands += drainCommands();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	LOG_INFO("Replay finished in {} s: {} inbound records, {} LED commands sent against {} recorded.", seconds, inbound_records, sent_commands, recorded_commands);
+
+	finished = true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "InteractiveDevice.h"
+#include "TrafficLog.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+//	Plays a TrafficRecorder log back into the app in place of the serial ports. The
+//	recorded inbound bytes go through each device's real frame parser and on to the
+//	queue logic, and the LED commands the queue sends back are counted against the ones
+//	that were recorded, so a field session can be watched again on screen.
+//
+//	Runs on its own thread, which acts as the I/O side of every device. At speed 1 the
+//	recording plays in real time (2 plays twice as fast, and so on). At speed 0 it plays
+//	as fast as the render thread takes the events: each device's next bytes are fed as
+//	soon as its previous events have been drained.
+class TrafficReplayer
+{
+public:
+	TrafficReplayer();
+	~TrafficReplayer();
+
+	//	Matches the log's devices to _devices by port name, falling back to the order
+	//	they were recorded in. Returns false if the log can't be read.
+	bool setup(const std::string& _path, const std::vector<InteractiveDevice*>& _devices, double _speed);
+
+	void start();
+	void stop();
+
+	bool isFinished() const { return finished.load(std::memory_order_relaxed); }
+
+private:
+	TrafficLogReader reader;
+	std::vector<InteractiveDevice*> devices_by_index;
+	std::vector<InteractiveDevice*> all_devices;
+	double speed;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<bool> finished;
+
+	void replayLoop();
+	unsigned long drainCommands();
+};
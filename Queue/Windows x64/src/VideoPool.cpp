@@ -0,0 +1,150 @@
+
+#include "VideoPool.h"
+#include "InteractiveDevice.h"
+#include "Logger.h"
+
+VideoPool::VideoPool()
+	: max_instances(VIDEO_POOL_DEFAULT_MAX_INSTANCES),
+	max_memory_bytes((size_t)VIDEO_POOL_DEFAULT_MAX_MEMORY_MB * 1024 * 1024),
+	use_counter(0),
+	reported_over_budget(false),
+	use_texture(true)
+{
+}
+
+void VideoPool::setup(size_t _max_instances, size_t _max_memory_mb)
+{
+	max_instances = _max_instances;
+	max_memory_bytes = _max_memory_mb * 1024 * 1024;
+}
+
+VideoPool::Entry* VideoPool::find(InteractiveDevice* _device)
+{
+	for (auto& entry : entries)
+	{
+		if (entry.device == _device)
+		{
+			return &entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Cold clips are opened with loadAsync(), so on backends that support it the open
+ * happens off the render thread and the player reports isLoaded() once it's ready.
+ * Backends without async loading fall back to a synchronous load.
+ */
+ofVideoPlayer* VideoPool::acquire(InteractiveDevice* _device)
+{
+	Entry* entry = find(_device);
+
+	if (entry == NULL)
+	{
+		Entry new_entry;
+		new_entry.device = _device;
+		new_entry.player.reset(new ofVideoPlayer());
+		new_entry.player->setUseTexture(use_texture);
+		new_entry.player->loadAsync(_device->video_path);
+		new_entry.references = 0;
+		entries.push_back(std::move(new_entry));
+
+		entry = &entries.back();
+		_device->video = entry->player.get();
+	}
+
+	entry->references++;
+	entry->last_used = ++use_counter;
+	return entry->player.get();
+}
+
+void VideoPool::release(InteractiveDevice* _device)
+{
+	Entry* entry = find(_device);
+
+	if ((entry != NULL) && (entry->references > 0))
+	{
+		entry->references--;
+		entry->last_used = ++use_counter;
+	}
+}
+
+bool VideoPool::forget(InteractiveDevice* _device)
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].device == _device)
+		{
+			if (entries[i].references > 0)
+			{
+				return false;
+			}
+
+			entries[i].player->close();
+			_device->video = NULL;
+			entries.erase(entries.begin() + i);
+			break;
+		}
+	}
+
+	return true;
+}
+
+size_t VideoPool::estimateBytes(const Entry& _entry)
+{
+	if (!_entry.player->isLoaded())
+	{
+		return 0;
+	}
+
+	return (size_t)_entry.player->getWidth() * (size_t)_entry.player->getHeight() * 4 * VIDEO_POOL_FRAMES_PER_PLAYER;
+}
+
+size_t VideoPool::memoryBytes() const
+{
+	size_t total = 0;
+
+	for (auto& entry : entries)
+	{
+		total += estimateBytes(entry);
+	}
+
+	return total;
+}
+
+void VideoPool::trim()
+{
+	size_t memory = memoryBytes();
+
+	while ((entries.size() > max_instances) || (memory > max_memory_bytes))
+	{
+		//	Least recently used entry that nothing references.
+		int victim = -1;
+
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			if ((entries[i].references == 0) && ((victim < 0) || (entries[i].last_used < entries[victim].last_used)))
+			{
+				victim = (int)i;
+			}
+		}
+
+		if (victim < 0)
+		{
+			if (!reported_over_budget)
+			{
+				LOG_WARNING("Video pool is over budget with {} clips (~{} MB) that are all queued or playing.", entries.size(), memory / (1024 * 1024));
+				reported_over_budget = true;
+			}
+			return;
+		}
+
+		memory -= estimateBytes(entries[victim]);
+		entries[victim].player->close();
+		entries[victim].device->video = NULL;
+		entries.erase(entries.begin() + victim);
+	}
+
+	reported_over_budget = false;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class InteractiveDevice;
+
+//	Defaults for the "decoder_pool" section of config.json.
+#define VIDEO_POOL_DEFAULT_MAX_INSTANCES 8
+#define VIDEO_POOL_DEFAULT_MAX_MEMORY_MB 1024
+
+//	A decoder typically holds a few full frames at once (decoder output, ofPixels copy,
+//	GL texture), so a clip's footprint is estimated as this many RGBA frames.
+#define VIDEO_POOL_FRAMES_PER_PLAYER 3
+
+//	Owns the ofVideoPlayer for every station's clip. Clips are opened when their device
+//	is queued and closed again when they are cold, instead of every station keeping a
+//	decoder open for the life of the process.
+//
+//	A device's player is pinned while anything holds a reference to it (being in the
+//	queue, or being the overlay on screen). Unpinned players stay open as a warm cache
+//	until the pool is over its instance or memory budget, at which point the least
+//	recently used ones are closed. Pinned players are never closed, so if the pinned set
+//	alone exceeds the budget the pool goes over it and says so.
+//
+//	The pool writes the player into InteractiveDevice::video when it is opened and sets
+//	it back to NULL when it is closed.
+class VideoPool
+{
+public:
+	VideoPool();
+
+	void setup(size_t _max_instances, size_t _max_memory_mb);
+
+	//	Whether players opened from now on upload their frames to GL textures. The CPU
+	//	compositor only needs their pixels.
+	void setUseTexture(bool _use_texture) { use_texture = _use_texture; }
+
+	//	Takes a reference to the device's player, opening it if it is cold.
+	ofVideoPlayer* acquire(InteractiveDevice* _device);
+
+	//	Drops a reference taken by acquire().
+	void release(InteractiveDevice* _device);
+
+	//	Closes the device's player, if it is open, and forgets the device, so that its
+	//	clip is opened from its video_path again next time or the device can be deleted.
+	//	Returns false, and does nothing, while anything still references the player.
+	bool forget(InteractiveDevice* _device);
+
+	//	Closes least recently used unpinned players until the pool is within budget.
+	//	Called once per frame.
+	void trim();
+
+	size_t instanceCount() const { return entries.size(); }
+	size_t memoryBytes() const;
+
+private:
+	struct Entry
+	{
+		InteractiveDevice* device;
+		std::unique_ptr<ofVideoPlayer> player;
+		int references;
+		uint64_t last_used;
+	};
+
+	std::vector<Entry> entries;
+	size_t max_instances;
+	size_t max_memory_bytes;
+	uint64_t use_counter;
+	bool reported_over_budget;
+	bool use_texture;
+
+	Entry* find(InteractiveDevice* _device);
+	static size_t estimateBytes(const Entry& _entry);
+};
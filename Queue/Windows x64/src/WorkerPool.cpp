@@ -0,0 +1,80 @@
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool()
+	: running(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::start(size_t _threads)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (running)
+	{
+		return;
+	}
+
+	running = true;
+
+	for (size_t i = 0; i < _threads; i++)
+	{
+		threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+	}
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		jobs.clear();
+	}
+
+	wake.notify_all();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	threads.clear();
+}
+
+void WorkerPool::submit(std::function<void()> _job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(_job));
+	}
+
+	wake.notify_one();
+}
+
+void WorkerPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return !running || !jobs.empty(); });
+
+			if (!running)
+			{
+				return;
+			}
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//	A fixed set of threads that run jobs in the order they were submitted, for work that
+//	blocks for a while, such as opening a Bluetooth COM port, and mustn't hold up the
+//	thread that asked for it. Jobs report back however suits the caller; the pool itself
+//	returns nothing.
+class WorkerPool
+{
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	void start(size_t _threads);
+
+	//	Drops the jobs that haven't started yet and waits for the ones that have.
+	void stop();
+
+	void submit(std::function<void()> _job);
+
+private:
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool running;
+
+	void workerLoop();
+};
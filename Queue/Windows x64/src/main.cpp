@@ -1,13 +1,60 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "ofAppNoWindow.h"
 
 //========================================================================
-int main( ){
+int main(int argc, char* argv[]){
+	//	--headless				Run without a window or GPU, compositing frames on the CPU
+	//							only. Useful for CI, and for sizing a player machine from
+	//							the compositor's reports.
+	//	--record <file>			Record all serial traffic to <file>.
+	//	--replay <file>			Play a recording back instead of opening the serial ports.
+	//	--replay-speed <n|max>	Replay at n times real time (default 1), or as fast as
+	//							the queue takes the events.
+	//	--trace <file>			Write a Chrome trace of each frame's phases and every
+	//							device event to <file>.
+	LaunchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = (i + 1 < argc);
+
+		if (arg == "--headless")
+		{
+			options.headless = true;
+		}
+		else if ((arg == "--record") && has_value)
+		{
+			options.record_path = argv[++i];
+		}
+		else if ((arg == "--replay") && has_value)
+		{
+			options.replay_path = argv[++i];
+		}
+		else if ((arg == "--replay-speed") && has_value)
+		{
+			std::string speed = argv[++i];
+			options.replay_speed = (speed == "max") ? 0 : atof(speed.c_str());
+		}
+		else if ((arg == "--trace") && has_value)
+		{
+			options.trace_path = argv[++i];
+		}
+	}
+
+	if (options.headless)
+	{
+		ofAppNoWindow window;
+		ofSetupOpenGL(&window, 1920, 1152, OF_WINDOW);
+		ofRunApp(new ofApp(options));
+		return 0;
+	}
+
 	ofSetupOpenGL(1920,1152,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(new ofApp(options));
 
 }
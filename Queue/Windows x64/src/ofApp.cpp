@@ -1,20 +1,130 @@
 
 #include "ofApp.h"
+#include "ConfigWatcher.h"
+#include "CpuCompositor.h"
+#include "Logger.h"
+#include "MetricsServer.h"
+#include "NetworkTransport.h"
+#include "QueueCore.h"
+#include "SerialReactor.h"
+#include "StationVideoPlayer.h"
+#include "TrafficLog.h"
+#include "Tracer.h"
+#include "TrafficReplayer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cassert>
+#include <mutex>
 #include <ofJson.h>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
-ofVideoPlayer background;
-ofVideoPlayer* overlay;
+//	Two players, so that a background changed in config.json can be opened while the
+//	old one is still on screen. background is the one on screen.
+ofVideoPlayer background_players[2];
+ofVideoPlayer* background = &background_players[0];
+ofVideoPlayer* next_background = NULL;
+bool background_started = false;
 
+//	True while the overlay hides the background and it isn't due back yet. The
+//	background is then paused and neither updated nor drawn, see updateBackground().
+bool background_suspended = false;
+
+//	Only changed by the render thread, and then under the mutex, which the metrics
+//	server's thread holds while it reads the devices.
 std::vector<InteractiveDevice*> device_list;
-std::vector<ofVideoPlayer*> video_queue;
+std::mutex device_list_mutex;
+
+//	The gateways of ports that several stations share. Their stations are in device_list,
+//	and the gateways own them; a gateway is never a station itself.
+std::vector<InteractiveDevice*> gateway_list;
+
+//	One entry of "sensors" in config.json.
+struct StationConfig
+{
+	std::string key;
+	std::string port;
+	std::string video_path;
+
+	bool operator==(const StationConfig& _other) const
+	{
+		return (key == _other.key) && (port == _other.port) && (video_path == _other.video_path);
+	}
+};
+
+//	Every setting in config.json. Optional ones that aren't given keep these defaults.
+struct AppConfig
+{
+	int framerate = 0;
+	int window_width = 0;
+	int window_height = 0;
+	int window_posx = 0;
+	int window_posy = 0;
+	float fade_duration = 0;
+	OverlayTransition transition = OverlayTransition::Fade;
+	std::string background;
+	bool has_decoder_pool = false;
+	size_t pool_max_instances = VIDEO_POOL_DEFAULT_MAX_INSTANCES;
+	size_t pool_max_memory_mb = VIDEO_POOL_DEFAULT_MAX_MEMORY_MB;
+	int metrics_port = 0;
+	int heartbeat_ms = HEARTBEAT_DEFAULT_INTERVAL_MS;
+	int heartbeat_misses = HEARTBEAT_DEFAULT_MISSES;
+	std::string renderer;
+	bool dirty_rendering = false;
+	std::vector<StationConfig> stations;
+};
+
+//	A station whose clip was changed in config.json, waiting until it isn't queued.
+struct ClipChange
+{
+	InteractiveDevice* device;
+	std::string video_path;
+};
+
+//	config.json is watched for changes while the show runs, and each change applied
+//	a step at a time on the render thread (see updateConfig()). Removed stations are
+//	retiring until their queue entry has played out, and then detaching while the
+//	reactor lets go of them. Added stations are pending while another device still
+//	holds their port.
+ConfigWatcher config_watcher;
+AppConfig running_config;
+std::vector<InteractiveDevice*> retiring_devices;
+std::vector<InteractiveDevice*> detaching_devices;
+std::vector<StationConfig> pending_stations;
+std::vector<ClipChange> clip_changes;
+float pending_fade_duration = -1;
+
+//	Stations whose port hasn't opened yet, reported as they come online, or as degraded
+//	if their port fails to open.
+struct StartingStation
+{
+	InteractiveDevice* device;
+	uint64_t added_us;
+	bool reported_degraded;
+};
+
+std::vector<StartingStation> starting_stations;
+uint64_t startup_began_us = 0;
 
-int overlay_fade_out_begin;
-int overlay_fade_out_end;
-int fade_duration;
+//	The queue logic lives in QueueCore. The app supplies the devices as its stations,
+//	the pooled video players, and the system clock.
+QueueCore queue_core;
+StationVideoPlayer station_player;
+SteadyQueueClock queue_clock;
+
+#ifdef SERIAL_REACTOR_ENABLED
+SerialReactor* serial_reactor = NULL;
+#endif
+
+LaunchOptions launch_options;
+TrafficRecorder traffic_recorder;
+TrafficReplayer traffic_replayer;
+
+float fade_duration;
 int window_width;
 int window_height;
 int window_posx;
@@ -23,413 +133,1763 @@ int framerate;
 
 bool fatal_error = false;
 
-void queueAdd(InteractiveDevice* _device)
-{
-	video_queue.push_back(&(_device->video));
-	InteractiveDevice* _corresponding_device = NULL;
+//	With the CPU renderer the crossfade is done by the compositor instead of by GL alpha
+//	blending, and only its finished frame is uploaded and drawn.
+bool cpu_renderer = false;
+CpuCompositor compositor;
+ofTexture composited_texture;
+ofPixels overlay_scaled;
+ofPixels outgoing_scaled;
+
+//	With "render_mode": "dirty" the frame is only drawn again when a clip on screen has
+//	a new frame, the overlay's opacity changes or the window is resized, into frame_fbo,
+//	or the compositor's texture with the CPU renderer. Every other frame just draws that
+//	again. The app's frame rate follows the clips on screen, up to "framerate", and is
+//	presented on vertical sync.
+bool dirty_rendering = false;
+bool frame_dirty = true;
+ofFbo frame_fbo;
+int paced_framerate = 0;
+
+//	What the last drawn frame showed, to tell whether the next one would be different.
+ofVideoPlayer* drawn_overlay = NULL;
+float drawn_opacity = -1;
+bool drawn_crossfading = false;
+bool drawn_background = false;
+bool reported_overlay_mismatch = false;
+uint64_t compose_total_us = 0;
+int composed_frames = 0;
+
+//	Served by the MetricsServer's thread. The render thread only stores the queue depth
+//	and dropped frame count into atomics and records into the devices' histograms.
+MetricsServer metrics_server;
+int metrics_port = 0;
+int heartbeat_ms = HEARTBEAT_DEFAULT_INTERVAL_MS;
+int heartbeat_misses = HEARTBEAT_DEFAULT_MISSES;
+std::atomic<size_t> metrics_queue_depth(0);
+std::atomic<unsigned long> dropped_render_frames(0);
+std::atomic<unsigned long> redrawn_render_frames(0);
+std::atomic<unsigned long> reused_render_frames(0);
+uint64_t last_update_us = 0;
+uint64_t timed_overlay_start_us = 0;
+
+uint64_t nowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool isNumber(std::string _string)
+{
+	for (auto i : _string)
+	{
+		if ((i != '.') && (std::isdigit(i) == false))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void startRecording()
+{
+	std::vector<TrafficLogDevice> logged_devices;
+
+	for (auto device : device_list)
+	{
+		TrafficLogDevice logged;
+		logged.id = device->id;
+		logged.port = device->port;
+		logged_devices.push_back(logged);
+	}
+
+	if (!traffic_recorder.open(launch_options.record_path, logged_devices))
+	{
+		throw std::runtime_error("Could not create traffic recording " + launch_options.record_path + ".");
+	}
+
+	for (size_t i = 0; i < device_list.size(); i++)
+	{
+		device_list[i]->setRecorder(&traffic_recorder, (uint8_t)i);
+	}
+
+	//	A gateway's traffic is recorded as its first station's, and replayed through the
+	//	gateway again from there.
+	for (auto gateway : gateway_list)
+	{
+		size_t index = std::find(device_list.begin(), device_list.end(), gateway->getStations()[0]) - device_list.begin();
+		gateway->setRecorder(&traffic_recorder, (uint8_t)index);
+	}
+
+	LOG_INFO("Recording serial traffic to {}.", launch_options.record_path);
+}
+
+ofJson latencyJson(const LatencyHistogram& _histogram)
+{
+	LatencySummary summary = _histogram.summarize();
+
+	ofJson json;
+	json["count"] = summary.count;
+	json["mean_ms"] = summary.mean_ms;
+	json["p50_ms"] = summary.p50_ms;
+	json["p90_ms"] = summary.p90_ms;
+	json["p99_ms"] = summary.p99_ms;
+	json["p999_ms"] = summary.p999_ms;
+	json["max_ms"] = summary.max_ms;
+	return json;
+}
+
+/**
+ * "degraded" is a station without a clip, or whose port has never opened and has failed
+ * to at least once. Both keep being retried, and the rest of the show runs without them.
+ */
+const char* stationStatus(InteractiveDevice* _device)
+{
+	if (_device->clip_missing)
+	{
+		return "degraded";
+	}
+
+	if (_device->isConnected())
+	{
+		return "online";
+	}
+
+	if (!_device->link.opened.load(std::memory_order_relaxed))
+	{
+		return (_device->link.open_failures.load(std::memory_order_relaxed) > 0) ? "degraded" : "starting";
+	}
+
+	return "reconnecting";
+}
+
+/**
+ * Runs on the MetricsServer's thread. device_list only changes when config.json is
+ * reloaded, under the mutex, and everything read from the devices here is atomic or
+ * fixed after setup.
+ */
+std::string metricsReport()
+{
+	ofJson report;
+	report["queue_depth"] = metrics_queue_depth.load(std::memory_order_relaxed);
+	report["render_frames_dropped"] = dropped_render_frames.load(std::memory_order_relaxed);
+	report["render_frames_redrawn"] = redrawn_render_frames.load(std::memory_order_relaxed);
+	report["render_frames_reused"] = reused_render_frames.load(std::memory_order_relaxed);
+	report["log_records_dropped"] = Logger::droppedCount();
+	report["log_records_suppressed"] = Logger::suppressedCount();
+	report["devices"] = ofJson::array();
+
+	std::lock_guard<std::mutex> lock(device_list_mutex);
+
+	for (auto device : device_list)
+	{
+		const FrameParser& parser = device->getParser();
+		const PacketParser& packet_parser = device->getPacketParser();
+
+		ofJson entry;
+		entry["port"] = device->port;
+		entry["shared_port"] = (device->getGateway() != NULL);
+
+		if (device->id != 0)
+		{
+			entry["id"] = std::string(1, (char)device->id);
+		}
+
+		entry["status"] = stationStatus(device);
+		entry["connected"] = device->isConnected();
+		entry["frames"] = parser.frameCount();
+		entry["frames_dropped"] = device->getDroppedEventCount();
+		entry["frames_oversize"] = parser.oversizeCount();
+		entry["frames_cut_short"] = parser.resyncCount();
+		entry["frames_foreign"] = device->getForeignFrameCount();
+		entry["commands_dropped"] = device->getDroppedCommandCount();
+
+		//	Packets that failed the CRC or length check, or never arrived at all. These only
+		//	mean something once the protocol is 2. On a shared port, packets and corrupt packets are
+		//	counted for the whole port, as a corrupt packet's ID can't be trusted, and lost
+		//	packets for the station's own controller.
+		entry["protocol"] = device->getProtocolVersion();
+		entry["packets"] = packet_parser.packetCount();
+		entry["packets_corrupt"] = packet_parser.corruptCount() + packet_parser.oversizeCount();
+		entry["packets_lost"] = (device->getGateway() != NULL) ? packet_parser.lostCount(device->id) : packet_parser.lostCount();
+
+		//	Every stage is timed from when the triggering frame was read from the port.
+		entry["latency"]["enqueue"] = latencyJson(device->latency.enqueue);
+		entry["latency"]["overlay_start"] = latencyJson(device->latency.overlay_start);
+		entry["latency"]["fade_in_complete"] = latencyJson(device->latency.opaque);
+		entry["latency"]["led_command_written"] = latencyJson(device->latency.led);
+
+		//	Loss counts every ping that went unanswered, including those of a controller
+		//	whose firmware doesn't answer at all.
+		unsigned long pings_sent = device->link.pings_sent.load(std::memory_order_relaxed);
+		unsigned long pings_missed = device->link.pings_missed.load(std::memory_order_relaxed);
+		unsigned long consecutive_misses = device->link.consecutive_misses.load(std::memory_order_relaxed);
+
+		entry["link"]["answering_heartbeats"] = device->link.answering.load(std::memory_order_relaxed);
+		entry["link"]["alive"] = device->isConnected() && (consecutive_misses < (unsigned long)heartbeat_misses);
+		entry["link"]["pings_sent"] = pings_sent;
+		entry["link"]["pongs_received"] = device->link.pongs_received.load(std::memory_order_relaxed);
+		entry["link"]["pings_missed"] = pings_missed;
+		entry["link"]["consecutive_misses"] = consecutive_misses;
+		entry["link"]["loss"] = (pings_sent > 0) ? ((double)pings_missed / pings_sent) : 0.0;
+		entry["link"]["times_declared_dead"] = device->link.links_dropped.load(std::memory_order_relaxed);
+		entry["link"]["open_failures"] = device->link.open_failures.load(std::memory_order_relaxed);
+		entry["link"]["rtt"] = latencyJson(device->link.rtt);
+
+		report["devices"].push_back(entry);
+	}
+
+	return report.dump(4);
+}
+
+void startMetricsServer()
+{
+	if (metrics_server.start(metrics_port, metricsReport))
+	{
+		LOG_INFO("Serving metrics on http://127.0.0.1:{}/.", metrics_port);
+	}
+	else
+	{
+		LOG_WARNING("Could not serve metrics on port {}, it may already be in use.", metrics_port);
+	}
+}
+
+void setPacedFrameRate(int _framerate)
+{
+	if (_framerate != paced_framerate)
+	{
+		paced_framerate = _framerate;
+		ofSetFrameRate(paced_framerate);
+	}
+}
+
+/**
+ * Switching to dirty rendering turns vertical sync on, and leaving it goes back to
+ * the configured frame rate. Either way the next frame is drawn in full.
+ */
+void setDirtyRendering(bool _dirty_rendering)
+{
+	dirty_rendering = _dirty_rendering;
+	frame_dirty = true;
+
+	if (dirty_rendering)
+	{
+		ofSetVerticalSync(true);
+	}
+	else
+	{
+		setPacedFrameRate(framerate);
+	}
+}
+
+size_t countStationsOnPort(const std::vector<StationConfig>& _stations, const std::string& _port)
+{
+	size_t count = 0;
+
+	for (auto& station : _stations)
+	{
+		if (station.port == _port)
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
+unsigned char stationId(const StationConfig& _station)
+{
+	return (_station.key.size() == 1) ? _station.key[0] : 0;
+}
+
+/**
+ * Reads and checks every setting, without applying any of them, so that a reloaded
+ * config.json with a mistake in it can be turned down as a whole. Throws if anything
+ * is missing or malformed.
+ */
+void parseConfig(const ofJson& _file, AppConfig& _config)
+{
+	std::string framerate_s = _file.at("framerate");
+	if (!isNumber(framerate_s) || (atoi(framerate_s.c_str()) < 1)) { throw std::runtime_error("In config.json, \"framerate\" must be an integer of at least 1."); }
+	_config.framerate = (int)atoi(framerate_s.c_str());
+
+	std::string width_s = _file.at("width");
+	if (!isNumber(width_s)) { throw std::runtime_error("In config.json, \"Width\" must be an integer."); }
+	_config.window_width = (int)atoi(width_s.c_str());
+
+	std::string height_s = _file.at("height");
+	if (!isNumber(height_s)) { throw std::runtime_error("In config.json, \"height\" must be an integer."); }
+	_config.window_height = (int)atoi(height_s.c_str());
+
+	std::string posx_s = _file.at("posx");
+	if (!isNumber(posx_s)) { throw std::runtime_error("In config.json, \"posx\" must be an integer."); }
+	_config.window_posx = (int)atoi(posx_s.c_str());
+
+	std::string posy_s = _file.at("posy");
+	if (!isNumber(posy_s)) { throw std::runtime_error("In config.json, \"posy\" must be an integer."); }
+	_config.window_posy = (int)atoi(posy_s.c_str());
+
+	std::string fade_duration_s = _file.at("fade_duration");
+	if (!isNumber(fade_duration_s)) { throw std::runtime_error("In config.json, \"fade_duration\" must be a float."); }
+	_config.fade_duration = (float)atof(fade_duration_s.c_str());
+
+	//	The decoder pool section is optional, the defaults suit the original five stations.
+	if (_file.count("decoder_pool") > 0)
+	{
+		std::string max_instances_s = _file.at("decoder_pool").at("max_instances");
+		if (!isNumber(max_instances_s)) { throw std::runtime_error("In config.json, \"max_instances\" must be an integer."); }
+
+		std::string max_memory_s = _file.at("decoder_pool").at("max_memory_mb");
+		if (!isNumber(max_memory_s)) { throw std::runtime_error("In config.json, \"max_memory_mb\" must be an integer."); }
+
+		_config.has_decoder_pool = true;
+		_config.pool_max_instances = (size_t)atoi(max_instances_s.c_str());
+		_config.pool_max_memory_mb = (size_t)atoi(max_memory_s.c_str());
+	}
+
+	//	The metrics endpoint is optional, and off unless a port is given.
+	if (_file.count("metrics_port") > 0)
+	{
+		std::string metrics_port_s = _file.at("metrics_port");
+		if (!isNumber(metrics_port_s)) { throw std::runtime_error("In config.json, \"metrics_port\" must be an integer."); }
+		_config.metrics_port = (int)atoi(metrics_port_s.c_str());
+	}
+
+	//	The heartbeat settings are optional, and "heartbeat_ms": "0" turns it off.
+	if (_file.count("heartbeat_ms") > 0)
+	{
+		std::string heartbeat_ms_s = _file.at("heartbeat_ms");
+		if (!isNumber(heartbeat_ms_s)) { throw std::runtime_error("In config.json, \"heartbeat_ms\" must be an integer."); }
+		_config.heartbeat_ms = (int)atoi(heartbeat_ms_s.c_str());
+	}
+
+	if (_file.count("heartbeat_misses") > 0)
+	{
+		std::string heartbeat_misses_s = _file.at("heartbeat_misses");
+		if (!isNumber(heartbeat_misses_s) || (atoi(heartbeat_misses_s.c_str()) < 1)) { throw std::runtime_error("In config.json, \"heartbeat_misses\" must be an integer of at least 1."); }
+		_config.heartbeat_misses = (int)atoi(heartbeat_misses_s.c_str());
+	}
+
+	//	The transition is optional, and "fade" unless "crossfade" is asked for.
+	if (_file.count("transition") > 0)
+	{
+		std::string transition_s = _file.at("transition");
+		if ((transition_s != "fade") && (transition_s != "crossfade")) { throw std::runtime_error("In config.json, \"transition\" must be \"fade\" or \"crossfade\"."); }
+		_config.transition = (transition_s == "crossfade") ? OverlayTransition::Crossfade : OverlayTransition::Fade;
+	}
+
+	//	The renderer is optional, and is always "cpu" when running headless.
+	if (_file.count("renderer") > 0)
+	{
+		std::string renderer_s = _file.at("renderer");
+		if ((renderer_s != "gpu") && (renderer_s != "cpu")) { throw std::runtime_error("In config.json, \"renderer\" must be \"gpu\" or \"cpu\"."); }
+		_config.renderer = renderer_s;
+	}
+
+	//	The render mode is optional, and "continuous" unless "dirty" is asked for.
+	if (_file.count("render_mode") > 0)
+	{
+		std::string render_mode_s = _file.at("render_mode");
+		if ((render_mode_s != "continuous") && (render_mode_s != "dirty")) { throw std::runtime_error("In config.json, \"render_mode\" must be \"continuous\" or \"dirty\"."); }
+		_config.dirty_rendering = (render_mode_s == "dirty");
+	}
+
+	std::string background_s = _file.at("background");
+	_config.background = background_s;
+
+	for (auto& sensor : _file.at("sensors").items())
+	{
+		const ofJson& i = sensor.value();
+
+		StationConfig station;
+		station.key = sensor.key();
+
+		//	A controller on the network is given a "transport" address in place of a port.
+		if (i.count("transport") > 0)
+		{
+			std::string transport_s = i.at("transport");
+			bool tcp;
+			std::string host;
+			int port;
+			if (!NetworkTransport::parseAddress(transport_s, tcp, host, port)) { throw std::runtime_error("In config.json, \"transport\" must be udp://host:port or tcp://host:port, host being an IPv4 address."); }
+			station.port = transport_s;
+		}
+		else
+		{
+			std::string port_s = i.at("port");
+			station.port = port_s;
+		}
+
+		std::string video_s = i.at("video");
+		station.video_path = VIDEO_FOLDER + video_s;
+
+		_config.stations.push_back(station);
+	}
+
+	//	Stations that share a port are told apart by the ID in their controller's frames.
+	for (auto& station : _config.stations)
+	{
+		if ((countStationsOnPort(_config.stations, station.port) > 1) && (station.key.size() != 1))
+		{
+			throw std::runtime_error("In config.json, sensors sharing the port " + station.port + " must each be named by their controller's one-character SENSOR_ID.");
+		}
+	}
+}
+
+/**
+ * A new device for the station, not yet set up. Sensor keys that are a single character
+ * are taken to be the controller's SENSOR_ID, and frames carrying any other ID are
+ * ignored for its port.
+ */
+InteractiveDevice* createDevice(const StationConfig& _station)
+{
+	InteractiveDevice* device = new InteractiveDevice();
+	device->setHeartbeat(heartbeat_ms, heartbeat_misses);
+	device->id = stationId(_station);
+
+	return device;
+}
+
+/**
+ * A new gateway for a port several stations share, with the port set up but not yet
+ * opened. Its stations are added to it before it is started.
+ */
+InteractiveDevice* createGateway(const std::string& _port)
+{
+	InteractiveDevice* gateway = new InteractiveDevice();
+	gateway->setHeartbeat(heartbeat_ms, heartbeat_misses);
+	gateway->setup(_port.c_str(), 9600, "", false);
+
+	gateway_list.push_back(gateway);
+	return gateway;
+}
+
+InteractiveDevice* findGateway(const std::string& _port)
+{
+	for (auto gateway : gateway_list)
+	{
+		if (gateway->port == _port)
+		{
+			return gateway;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Every device that owns a port: the stations with a port of their own, and the
+ * gateways.
+ */
+std::vector<InteractiveDevice*> portOwners()
+{
+	std::vector<InteractiveDevice*> owners = gateway_list;
+
+	for (auto device : device_list)
+	{
+		if (device->getGateway() == NULL)
+		{
+			owners.push_back(device);
+		}
+	}
+
+	return owners;
+}
+
+/**
+ * Whether the reactor services _device's port. Network addresses never are, as the
+ * reactor only takes ttys, so their owners run I/O threads of their own alongside it.
+ */
+bool isOnReactor(InteractiveDevice* _device)
+{
+#ifdef SERIAL_REACTOR_ENABLED
+	return !_device->isNetworked();
+#else
+	return false;
+#endif
+}
+
+void reportMissingClip(InteractiveDevice* _device)
+{
+	if (_device->clip_missing)
+	{
+		LOG_WARNING("Station {} is degraded: its clip {} isn't in the data folder, so it won't be queued until config.json names one that is.", _device->port, _device->video_path);
+	}
+}
+
+void loadConfigFile()
+{
+	ofJson file;
+	try {
+		file = ofLoadJson("config.json");
+	}
+	catch (std::exception)
+	{
+		LOG_ERROR("FATAL ERROR! Config file not found in data folder, startup aborted.");
+		fatal_error = true;
+		exit(-1);
+	}
+
+	try {
+		AppConfig config;
+		parseConfig(file, config);
+
+		framerate = config.framerate;
+		window_width = config.window_width;
+		window_height = config.window_height;
+		window_posx = config.window_posx;
+		window_posy = config.window_posy;
+
+		fade_duration = config.fade_duration;
+		queue_core.setFadeSeconds(fade_duration);
+		queue_core.setTransition(config.transition);
+
+		dirty_rendering = config.dirty_rendering;
+
+		metrics_port = config.metrics_port;
+		heartbeat_ms = config.heartbeat_ms;
+		heartbeat_misses = config.heartbeat_misses;
+
+		bool replaying = !launch_options.replay_path.empty();
+
+#ifdef SERIAL_REACTOR_ENABLED
+		if (!replaying)
+		{
+			serial_reactor = new SerialReactor();
+		}
+#endif
+
+		if (config.has_decoder_pool)
+		{
+			station_player.setupPool(config.pool_max_instances, config.pool_max_memory_mb);
+		}
+
+		cpu_renderer = cpu_renderer || (config.renderer == "cpu");
+
+		if (cpu_renderer)
+		{
+			background->setUseTexture(false);
+			station_player.setUseTexture(false);
+			LOG_INFO("Compositing on the CPU using the {} kernel.", compositorKernelName(compositor.getKernel()));
+		}
+
+		//	Nothing here waits on a file or a port. The background is opened with
+		//	loadAsync() and starts playing once it has loaded, and every port is opened at
+		//	once, off the render thread, once the devices are started below. Each station
+		//	comes online as its own port opens (see updateStartup()).
+		startup_began_us = nowMicros();
+
+		if (ofFile::doesFileExist(VIDEO_FOLDER + config.background))
+		{
+			background->loadAsync(VIDEO_FOLDER + config.background);
+		}
+		else
+		{
+			LOG_WARNING("Background video \"{}\" isn't in the './data/{}' folder, the show runs without one until config.json names one that is.", config.background, VIDEO_FOLDER);
+		}
+
+		for (auto& station : config.stations)
+		{
+			InteractiveDevice* temp_device = createDevice(station);
+			temp_device->setup(station.port.c_str(), 9600, station.video_path.c_str(), false);
+
+			//	Stations that share a port are routed through the port's gateway.
+			if (countStationsOnPort(config.stations, station.port) > 1)
+			{
+				InteractiveDevice* gateway = findGateway(temp_device->port);
+				if (gateway == NULL)
+				{
+					gateway = createGateway(station.port);
+				}
+
+				gateway->addStation(temp_device);
+			}
+
+			reportMissingClip(temp_device);
+			device_list.push_back(temp_device);
+
+			if (!replaying)
+			{
+				starting_stations.push_back({ temp_device, startup_began_us, false });
+			}
+		}
+
+#ifdef SERIAL_REACTOR_ENABLED
+		if (serial_reactor != NULL)
+		{
+			for (auto device : portOwners())
+			{
+				if (isOnReactor(device))
+				{
+					serial_reactor->addDevice(device);
+				}
+			}
+		}
+#endif
+
+		running_config = config;
+
+		//	The recorder has to be in place before anything starts servicing the ports.
+		if (!launch_options.record_path.empty())
+		{
+			startRecording();
+		}
+
+		if (replaying)
+		{
+			if (!traffic_replayer.setup(launch_options.replay_path, device_list, launch_options.replay_speed))
+			{
+				throw std::runtime_error("Could not read traffic recording " + launch_options.replay_path + ".");
+			}
+
+			traffic_replayer.start();
+		}
+		else
+		{
+#ifdef SERIAL_REACTOR_ENABLED
+			serial_reactor->start();
+#endif
+
+			for (auto device : portOwners())
+			{
+				if (!isOnReactor(device))
+				{
+					device->startIoThread();
+				}
+			}
+		}
+
+		if (metrics_port > 0)
+		{
+			startMetricsServer();
+		}
+	}
+	catch (const std::exception& e) // this catches all other errors, so if syntax of json is correct, look for another issue in the code.
+	{
+		LOG_ERROR("{}", e.what());
+		LOG_ERROR("FATAL ERROR! Config file contains a syntax error. Please refer to documentation for syntax info.");
+		fatal_error = true;
+		exit(-1);
+	}
+}
+
+void startConfigWatcher()
+{
+	if (config_watcher.start(ofToDataPath("config.json", true)))
+	{
+		LOG_INFO("Watching config.json for changes.");
+	}
+	else
+	{
+		LOG_WARNING("Could not watch config.json, changes to it need a restart.");
+	}
+}
+
+//--------------------------------------------------------------
+void ofApp::setup() {
+	launch_options = options;
+
+	//	From here on messages are written by the logger's thread, to the console and to
+	//	prezenzq.log in the data folder, so a slow console never holds up a frame.
+	ofSetDataPathRoot("../data");
+
+	std::string log_path = ofToDataPath("prezenzq.log", true);
+	if (!Logger::start(log_path))
+	{
+		LOG_WARNING("Could not open the log file {}, logging to the console only.", log_path);
+	}
+
+	if (!options.headless)
+	{
+		ofSetFullscreen(1);
+	}
+
+	cpu_renderer = options.headless;
+
+	//	Tracing starts before the devices do, so their threads are traced from the start.
+	if (!options.trace_path.empty())
+	{
+		if (Tracer::start(options.trace_path))
+		{
+			Tracer::setThreadName("render");
+			LOG_INFO("Tracing to {}.", options.trace_path);
+		}
+		else
+		{
+			LOG_WARNING("Could not create trace file {}, tracing is off.", options.trace_path);
+		}
+	}
+
+	queue_core.setup(&station_player, &queue_clock);
+
+	loadConfigFile();
+	startConfigWatcher();
+
+	LOG_INFO("Window is {}x{}.", ofGetWidth(), ofGetHeight());
+
+	//ofSetWindowPosition(window_posx, 25);
+	setPacedFrameRate(framerate);
+	setDirtyRendering(dirty_rendering);
+}
+
+/**
+ * Serial reads happen on each device's own I/O thread, or on the SerialReactor's
+ * thread on Linux. Here the render thread only drains the state changes decoded since
+ * the last frame, so a stalled port costs nothing and no transition between two
+ * frames is lost.
+ */
+void drainDeviceEvents(InteractiveDevice* _device)
+{
+	DeviceEvent event;
+
+	//	A station removed from config.json isn't listened to any more, and one without a
+	//	clip can't be queued.
+	if (_device->retired || _device->clip_missing)
+	{
+		while (_device->pollEvent(event))
+		{
+		}
+		return;
+	}
+
+	while (_device->pollEvent(event))
+	{
+		StationLatency& latency = _device->latency;
+		bool changed = (event.device_state != _device->state);
+
+		//	Every change of state sends the controller an LED command, which is timed
+		//	from this frame once it has been written.
+		if (changed)
+		{
+			latency.led_pending_us.store(event.received_us, std::memory_order_relaxed);
+		}
+
+		Tracer::instant("device", event.device_state ? "triggered" : "released", _device->port.c_str());
+		queue_core.setStationState(_device, event.device_state);
+
+		if (changed && event.device_state)
+		{
+			latency.enqueue.record(nowMicros() - event.received_us);
+			latency.trigger_us = event.received_us;
+		}
+		else if (changed)
+		{
+			latency.trigger_us = 0;
+		}
+	}
+}
+
+void updateDevices()
+{
+#ifdef SERIAL_REACTOR_ENABLED
+	//	The reactor flags the devices that produced events, so an idle frame does no
+	//	per-device work at all. Only if more devices were flagged than the ready ring
+	//	holds does every device get checked. There is no reactor while replaying.
+	if (serial_reactor != NULL)
+	{
+		InteractiveDevice* device;
+		while (serial_reactor->pollReadyDevice(device))
+		{
+			drainDeviceEvents(device);
+		}
+
+		if (serial_reactor->takeReadyOverflow())
+		{
+			for (auto i : device_list)
+			{
+				drainDeviceEvents(i);
+			}
+		}
+		return;
+	}
+#endif
+
+	for (auto device : device_list)
+	{
+		drainDeviceEvents(device);
+	}
+}
+
+InteractiveDevice* findDevice(const std::string& _port, unsigned char _id)
+{
+	for (auto device : device_list)
+	{
+		if ((device->port == _port) && (device->id == _id))
+		{
+			return device;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Whether any device, including one still being let go of, holds the port. A station
+ * whose port is held waits until it isn't, so no port is ever open twice.
+ */
+bool isPortHeld(const std::string& _port)
+{
+	for (auto device : device_list)
+	{
+		if (device->port == _port)
+		{
+			return true;
+		}
+	}
+
+	for (auto device : detaching_devices)
+	{
+		if (device->port == _port)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Adds the stations on one port: a station of its own, or several behind a new gateway.
+ * The port is opened off the render thread, by the reactor or the owner's own I/O
+ * thread, and retried with backoff if it isn't there yet. Each clip is only opened once
+ * its station is first queued, as at startup.
+ */
+void addStations(const std::vector<StationConfig>& _stations)
+{
+	InteractiveDevice* gateway = (_stations.size() > 1) ? createGateway(_stations[0].port) : NULL;
+	std::vector<InteractiveDevice*> added;
+
+	for (auto& station : _stations)
+	{
+		InteractiveDevice* device = createDevice(station);
+		device->setup(station.port.c_str(), 9600, station.video_path.c_str(), false);
+
+		if (gateway != NULL)
+		{
+			gateway->addStation(device);
+		}
+
+		added.push_back(device);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(device_list_mutex);
+		device_list.insert(device_list.end(), added.begin(), added.end());
+	}
+
+	InteractiveDevice* owner = (gateway != NULL) ? gateway : added[0];
+
+#ifdef SERIAL_REACTOR_ENABLED
+	if (isOnReactor(owner))
+	{
+		serial_reactor->attachDevice(owner);
+	}
+#endif
+
+	if (!isOnReactor(owner))
+	{
+		owner->startIoThread();
+	}
+
+	for (auto device : added)
+	{
+		LOG_INFO("Station {} added.", device->port);
+		reportMissingClip(device);
+		starting_stations.push_back({ device, nowMicros(), false });
+	}
+}
+
+/**
+ * A removed station stops being listened to straight away, but stays in the queue
+ * until its entry has played out, see updateRetiringStations().
+ */
+void retireStation(InteractiveDevice* _device)
+{
+	if (_device->retired)
+	{
+		return;
+	}
+
+	_device->retired = true;
+	retiring_devices.push_back(_device);
+	LOG_INFO("Station {} was removed from config.json, it is let go of once its queue entry has finished.", _device->port);
+}
+
+/**
+ * Whether _device's port is shared by the same stations in _stations as it is now: the
+ * device alone, or its gateway's stations.
+ */
+bool isSharedBySame(InteractiveDevice* _device, const std::vector<StationConfig>& _stations)
+{
+	InteractiveDevice* gateway = _device->getGateway();
+	size_t sharing = (gateway != NULL) ? gateway->getStations().size() : 1;
+	size_t listed = 0;
+	size_t kept = 0;
+
+	for (auto& station : _stations)
+	{
+		if (controllerPortName(station.port) != _device->port)
+		{
+			continue;
+		}
+
+		InteractiveDevice* device = findDevice(_device->port, stationId(station));
+		listed++;
+		kept += ((device != NULL) && (device->getGateway() == gateway)) ? 1 : 0;
+	}
+
+	return (listed == sharing) && (kept == sharing);
+}
+
+/**
+ * A station keeps its port, and so its device, unless its port or its key changed. A
+ * key that changed means the controller's ID changed, which is replaced as a station
+ * of its own once the old one has let go of the port. A gateway routes to the stations
+ * it was started with, so unless the same stations share its port, all of them are
+ * replaced together behind a new gateway.
+ */
+void applyStationChanges(const std::vector<StationConfig>& _stations)
+{
+	std::vector<InteractiveDevice*> kept;
+	pending_stations.clear();
+
+	for (auto& station : _stations)
+	{
+		InteractiveDevice* device = findDevice(controllerPortName(station.port), stationId(station));
+
+		if ((device == NULL) || device->retired || !isSharedBySame(device, _stations))
+		{
+			pending_stations.push_back(station);
+			continue;
+		}
+
+		kept.push_back(device);
+
+		//	The latest clip wins, whether or not an earlier change has been applied yet.
+		bool pending = false;
+		for (auto& change : clip_changes)
+		{
+			if (change.device == device)
+			{
+				change.video_path = station.video_path;
+				pending = true;
+			}
+		}
+
+		if (!pending && (station.video_path != device->video_path))
+		{
+			clip_changes.push_back({ device, station.video_path });
+		}
+	}
+
+	for (auto device : device_list)
+	{
+		if (std::find(kept.begin(), kept.end(), device) == kept.end())
+		{
+			retireStation(device);
+		}
+	}
+}
+
+/**
+ * Applies a changed config.json to the running show. Nothing is applied unless the
+ * whole file is valid. Settings the show can't change while running are reported
+ * and left until the next start.
+ */
+void reloadConfig(const std::string& _contents)
+{
+	AppConfig config;
+
+	try {
+		parseConfig(ofJson::parse(_contents), config);
+	}
+	catch (const std::exception& e)
+	{
+		LOG_WARNING("{}", e.what());
+		LOG_WARNING("Config file change ignored, the show carries on with its current settings.");
+		return;
+	}
+
+	LOG_INFO("Config file changed, applying it.");
+
+	if (config.framerate != framerate)
+	{
+		framerate = config.framerate;
+		setPacedFrameRate(framerate);
+	}
+
+	window_width = config.window_width;
+	window_height = config.window_height;
+	window_posx = config.window_posx;
+	window_posy = config.window_posy;
+	frame_dirty = true;
+
+	if (config.dirty_rendering != dirty_rendering)
+	{
+		setDirtyRendering(config.dirty_rendering);
+	}
+
+	if (config.fade_duration != running_config.fade_duration)
+	{
+		pending_fade_duration = config.fade_duration;
+	}
+
+	//	Takes effect from the next overlay to leave the screen.
+	queue_core.setTransition(config.transition);
+
+	if (config.has_decoder_pool && ((config.pool_max_instances != running_config.pool_max_instances) || (config.pool_max_memory_mb != running_config.pool_max_memory_mb)))
+	{
+		station_player.setupPool(config.pool_max_instances, config.pool_max_memory_mb);
+	}
+
+	//	The new background is opened alongside the one on screen and swapped in once it
+	//	has loaded, see updateConfig().
+	if ((config.background != running_config.background) && !ofFile::doesFileExist(VIDEO_FOLDER + config.background))
+	{
+		LOG_WARNING("Background video \"{}\" isn't in the './data/{}' folder, the background is left as it is.", config.background, VIDEO_FOLDER);
+		config.background = running_config.background;
+	}
+	else if (config.background != running_config.background)
+	{
+		next_background = (background == &background_players[0]) ? &background_players[1] : &background_players[0];
+		next_background->setUseTexture(!cpu_renderer);
+		next_background->loadAsync(VIDEO_FOLDER + config.background);
+	}
+
+	if ((config.metrics_port != running_config.metrics_port) || (config.renderer != running_config.renderer)
+		|| (config.heartbeat_ms != running_config.heartbeat_ms) || (config.heartbeat_misses != running_config.heartbeat_misses))
+	{
+		LOG_WARNING("Changes to \"metrics_port\", \"renderer\" and the heartbeat settings take effect the next time the app is started.");
+	}
+
+	//	A recording or replay names its devices up front, so the stations stay as they
+	//	are until the next start.
+	if (launch_options.record_path.empty() && launch_options.replay_path.empty())
+	{
+		applyStationChanges(config.stations);
+	}
+	else if (!(config.stations == running_config.stations))
+	{
+		LOG_WARNING("Stations can't be added or removed while recording or replaying, restart the app to apply them.");
+		config.stations = running_config.stations;
+	}
+
+	//	Settings that only apply from the next start are kept as they were, so they are
+	//	reported again if they are changed again.
+	config.metrics_port = running_config.metrics_port;
+	config.renderer = running_config.renderer;
+	config.heartbeat_ms = running_config.heartbeat_ms;
+	config.heartbeat_misses = running_config.heartbeat_misses;
+	running_config = config;
+}
+
+/**
+ * The device that owns the port of a station that has just left device_list, now that
+ * nothing else needs it: the station itself, or its gateway once the last station on
+ * the port has left. NULL while other stations still share the port, in which case the
+ * station is kept by its gateway until then.
+ */
+InteractiveDevice* releasePort(InteractiveDevice* _device)
+{
+	InteractiveDevice* gateway = _device->getGateway();
+
+	if (gateway == NULL)
+	{
+		return _device;
+	}
+
+	for (auto device : device_list)
+	{
+		if (device->getGateway() == gateway)
+		{
+			return NULL;
+		}
+	}
+
+	gateway_list.erase(std::find(gateway_list.begin(), gateway_list.end(), gateway));
+	return gateway;
+}
+
+/**
+ * Lets go of each retired station once it is neither queued nor on screen. With the
+ * reactor its port is closed on the reactor's thread, and the device is only deleted
+ * once the reactor has let go of it too.
+ */
+void updateRetiringStations()
+{
+	for (size_t i = 0; i < retiring_devices.size();)
+	{
+		InteractiveDevice* device = retiring_devices[i];
+
+		if (queue_core.getQueue().contains(device) || (queue_core.getOverlayStation() == device) || (queue_core.getOutgoingStation() == device) || !station_player.closeClip(device))
+		{
+			i++;
+			continue;
+		}
+
+		retiring_devices.erase(retiring_devices.begin() + i);
+
+		starting_stations.erase(std::remove_if(starting_stations.begin(), starting_stations.end(),
+			[device](const StartingStation& _station) { return _station.device == device; }), starting_stations.end());
+
+		clip_changes.erase(std::remove_if(clip_changes.begin(), clip_changes.end(),
+			[device](const ClipChange& _change) { return _change.device == device; }), clip_changes.end());
+
+		{
+			std::lock_guard<std::mutex> lock(device_list_mutex);
+			device_list.erase(std::find(device_list.begin(), device_list.end(), device));
+		}
+
+		InteractiveDevice* released = releasePort(device);
+		if (released == NULL)
+		{
+			continue;
+		}
+
+#ifdef SERIAL_REACTOR_ENABLED
+		if (isOnReactor(released))
+		{
+			serial_reactor->detachDevice(released);
+			detaching_devices.push_back(released);
+			continue;
+		}
+#endif
+
+		LOG_INFO("Station {} let go of.", released->port);
+		delete released;
+	}
+
+#ifdef SERIAL_REACTOR_ENABLED
+	if (detaching_devices.empty())
+	{
+		return;
+	}
+
+	std::vector<InteractiveDevice*> detached;
+	InteractiveDevice* device;
+
+	while (serial_reactor->takeDetachedDevice(device))
+	{
+		detached.push_back(device);
+	}
+
+	if (detached.empty())
+	{
+		return;
+	}
+
+	//	The reactor may have flagged a device just before letting go of it, so the ready
+	//	ring is drained once more before any of them are deleted.
+	updateDevices();
+
+	for (auto i : detached)
+	{
+		detaching_devices.erase(std::find(detaching_devices.begin(), detaching_devices.end(), i));
+		LOG_INFO("Station {} let go of.", i->port);
+		delete i;
+	}
+#endif
+}
+
+/**
+ * Applies each changed clip once its station is neither queued nor on screen. The old
+ * clip is closed, and the new one opened by the VideoPool the next time the station
+ * is queued, as always.
+ */
+void updateClipChanges()
+{
+	for (size_t i = 0; i < clip_changes.size();)
+	{
+		InteractiveDevice* device = clip_changes[i].device;
+
+		if (queue_core.getQueue().contains(device) || (queue_core.getOverlayStation() == device) || (queue_core.getOutgoingStation() == device) || !station_player.closeClip(device))
+		{
+			i++;
+			continue;
+		}
 
-	if (video_queue.size() > 1)
-	{
-		_device->serial.writeBytes("W", 1);
-	}
-	else
-	{
-		_device->serial.writeBytes("N", 1);
+		device->video_path = clip_changes[i].video_path;
+		device->clip_missing = !ofFile::doesFileExist(device->video_path);
+		LOG_INFO("Station {} now plays {}.", device->port, device->video_path);
+		reportMissingClip(device);
+		clip_changes.erase(clip_changes.begin() + i);
 	}
 }
 
-void queueRemove(InteractiveDevice* _device)
+/**
+ * Runs every frame after the queue has been updated, and only does any work while a
+ * reload is being applied. Opening ports, opening clips and reading the file all
+ * happen on other threads, so a reload never holds up a frame.
+ */
+void updateConfig()
 {
-	ofVideoPlayer* prev_queue_head = video_queue[0];
+	std::string contents;
+	if (config_watcher.takeChange(contents))
+	{
+		reloadConfig(contents);
+	}
+
+	updateRetiringStations();
+	updateClipChanges();
 
-	for (int i = 0; i < video_queue.size(); i++)
+	for (size_t i = 0; i < pending_stations.size();)
 	{
-		if (video_queue[i] == &(_device->video))
+		if (isPortHeld(controllerPortName(pending_stations[i].port)))
+		{
+			i++;
+			continue;
+		}
+
+		//	The stations sharing the port are added together, behind one gateway.
+		std::string port = pending_stations[i].port;
+		std::vector<StationConfig> sharing;
+
+		for (auto& station : pending_stations)
 		{
-			_device->serial.writeBytes("F", 1);
-			video_queue.erase(video_queue.begin() + i);
+			if (station.port == port)
+			{
+				sharing.push_back(station);
+			}
 		}
+
+		pending_stations.erase(std::remove_if(pending_stations.begin(), pending_stations.end(),
+			[&port](const StationConfig& _station) { return _station.port == port; }), pending_stations.end());
+		addStations(sharing);
 	}
 
-	if (prev_queue_head != video_queue[0])
+	//	A fade in progress keeps the length it started with.
+	OverlayPhase phase = queue_core.snapshot().phase;
+	if ((pending_fade_duration >= 0) && (phase != OverlayPhase::FadingIn) && (phase != OverlayPhase::FadingOut))
 	{
-		for (auto i : device_list)
+		fade_duration = pending_fade_duration;
+		queue_core.setFadeSeconds(fade_duration);
+		pending_fade_duration = -1;
+	}
+
+	if (next_background != NULL)
+	{
+		next_background->update();
+
+		if (next_background->isLoaded())
 		{
-			if (&(i->video) == video_queue[0])
+			next_background->play();
+			background->close();
+			background = next_background;
+			next_background = NULL;
+			background_started = true;
+
+			if (background_suspended)
 			{
-				i->serial.writeBytes("N", 1);
+				background->setPaused(true);
 			}
+			reported_overlay_mismatch = false;
 		}
 	}
 }
 
-void handleVideoState(InteractiveDevice * _device)
+/**
+ * Runs the queue logic for this tick, which takes the overlay snapshot that the
+ * background and draw() then work from, and then lets the player preroll and trim.
+ */
+void updateVideoQueue()
+{
+	queue_core.update();
+	station_player.update(queue_core.getQueue(), queue_core.getOverlayStation());
+	metrics_queue_depth.store(queue_core.getQueue().size(), std::memory_order_relaxed);
+}
+
+/**
+ * Times the overlay stages of the trigger that queued the overlay's station: the clip
+ * being started, and the first tick it is fully opaque, which is the frame draw()
+ * shows next. A station released before then isn't timed any further.
+ */
+void recordOverlayLatency()
 {
-	bool video_in_list = false;
-	for (auto i : video_queue)
+	InteractiveDevice* overlay = static_cast<InteractiveDevice*>(queue_core.getOverlayStation());
+
+	if ((overlay == NULL) || (overlay->latency.trigger_us == 0))
 	{
-		if (i == &(_device->video))
-		{
-			video_in_list = true;
-		}
+		return;
+	}
+
+	//	An overlay still fading out from the station's previous trigger isn't this one's.
+	if (queue_core.getOverlayStartMicros() < overlay->latency.trigger_us)
+	{
+		return;
 	}
 
-	if (!video_in_list && _device->device_state == true)
+	StationLatency& latency = overlay->latency;
+	uint64_t now_us = nowMicros();
+
+	if (queue_core.getOverlayStartMicros() != timed_overlay_start_us)
 	{
-		queueAdd(_device);
+		timed_overlay_start_us = queue_core.getOverlayStartMicros();
+		latency.overlay_start.record(now_us - latency.trigger_us);
 	}
-	else if (video_in_list && _device->device_state == false)
+
+	if (queue_core.snapshot().phase == OverlayPhase::Playing)
 	{
-		queueRemove(_device);
+		latency.opaque.record(now_us - latency.trigger_us);
+		latency.trigger_us = 0;
 	}
 }
 
-bool isNumber(std::string _string)
+/**
+ * Counts the display frames missed since the last update(), taking anything over one
+ * and a half frame periods as late.
+ */
+void countDroppedFrames()
 {
-	for (auto i : _string)
+	uint64_t now_us = nowMicros();
+	uint64_t frame_us = 1000000 / paced_framerate;
+
+	if ((last_update_us != 0) && (now_us - last_update_us > frame_us + frame_us / 2))
 	{
-		if ((i != '.') && (std::isdigit(i) == false))
-		{
-			return false;
-		}
+		dropped_render_frames.fetch_add((unsigned long)((now_us - last_update_us + frame_us / 2) / frame_us - 1), std::memory_order_relaxed);
 	}
-	return true;
+
+	last_update_us = now_us;
 }
 
-void loadConfigFile()
+/**
+ * Reports how long the overlay that was just started took to be drawn, and warns when
+ * that is longer than one display frame at the configured rate. It is reported the
+ * frame after, once the draw that showed it is done.
+ */
+void reportOverlayFirstFrame()
 {
-	ofJson file;
-	try {
-		file = ofLoadJson("config.json");
-	}
-	catch (std::exception)
+	double latency_ms;
+	bool prerolled;
+
+	if (!station_player.takeFirstFrame(latency_ms, prerolled))
 	{
-		std::cout << "\nFATAL ERROR! Config file not found in data folder, startup aborted." << std::endl;
-		fatal_error = true;
-		exit(-1);
+		return;
 	}
 
-	try {
-		int count = 0;
+	double frame_ms = 1000.0 / framerate;
 
-		std::string framerate_s = file["framerate"];
-		if (!isNumber(framerate_s)) { throw std::exception("In config.json, \"framerate\" must be an integer."); }
-		framerate = (int)atoi(framerate_s.c_str());
+	LOG_INFO("Overlay first frame drawn after {} ms ({}).", latency_ms, prerolled ? "prerolled" : "cold start");
+
+	if (latency_ms > frame_ms)
+	{
+		LOG_WARNING("Overlay first frame took longer than one display frame ({} ms).", frame_ms);
+	}
+}
 
-		std::string width_s = file["width"];
-		if (!isNumber(width_s)) { throw std::exception("In config.json, \"Width\" must be an integer."); }
-		window_width = (int)atoi(width_s.c_str());
+/**
+ * Updates the overlay's player, ahead of QueueCore reading its position for this tick,
+ * and the outgoing overlay's during a crossfade.
+ */
+void updateOverlay()
+{
+	ofVideoPlayer* overlay = station_player.getOverlay();
+	ofVideoPlayer* outgoing = station_player.getOutgoing();
 
-		std::string height_s = file["height"];
-		if (!isNumber(height_s)) { throw std::exception("In config.json, \"height\" must be an integer."); }
-		window_height = (int)atoi(height_s.c_str());
+	if (overlay != NULL)
+	{
+		overlay->update();
+		reportOverlayFirstFrame();
+	}
 
-		std::string posx_s = file["posx"];
-		if (!isNumber(posx_s)) { throw std::exception("In config.json, \"posx\" must be an integer."); }
-		window_posx = (int)atoi(posx_s.c_str());
+	if (outgoing != NULL)
+	{
+		outgoing->update();
+	}
+}
 
-		std::string posy_s = file["posy"];
-		if (!isNumber(posy_s)) { throw std::exception("In config.json, \"posy\" must be an integer."); }
-		window_posy = (int)atoi(posy_s.c_str());
+/**
+ * Starts the background as soon as it has loaded, and reports each station as its port
+ * opens, or as degraded the first time its port fails to. Stops doing anything once
+ * everything has started.
+ */
+void updateStartup()
+{
+	if (!background_started && background->isLoaded())
+	{
+		background->play();
+		background_started = true;
+		LOG_INFO("Background ready after {} ms.", (nowMicros() - startup_began_us) / 1000);
+	}
 
-		std::string fade_duration_s = file["fade_duration"];
-		if (!isNumber(fade_duration_s)) { throw std::exception("In config.json, \"fade_duration\" must be a float."); }
-		fade_duration = (float)atof(fade_duration_s.c_str()) * 60;
+	for (size_t i = 0; i < starting_stations.size();)
+	{
+		StartingStation& station = starting_stations[i];
 
-		std::string background_video = file["background"];
-		try {
-			background.load(VIDEO_FOLDER + background_video);
-		}
-		catch (std::exception e)
+		if (station.device->link.opened.load(std::memory_order_relaxed))
 		{
-			std::cout << "\nFATAL ERROR! Error occured loading background video, ensure video file is in './data/" << VIDEO_FOLDER << "' folder and that entry in config file is correct." << std::endl;
-			throw -1;
+			LOG_INFO("Station {} online after {} ms.", station.device->port, (nowMicros() - station.added_us) / 1000);
+			starting_stations.erase(starting_stations.begin() + i);
+			continue;
 		}
 
-		for (ofJson i : file["sensors"])
+		if (!station.reported_degraded && (station.device->link.open_failures.load(std::memory_order_relaxed) > 0))
 		{
-			InteractiveDevice* temp_device = new InteractiveDevice();
+			LOG_WARNING("Station {} is degraded: its port couldn't be opened, it keeps being retried while the show runs.", station.device->port);
+			station.reported_degraded = true;
+		}
 
-			std::string temp_port = i["port"];
-			std::string temp_port_file =  temp_port;
+		i++;
+	}
+}
 
-			std::string temp_video_file = VIDEO_FOLDER;
-			std::string temp_video = i["video"];
-			temp_video_file.append(temp_video);
-		
-			try {
-				temp_device->setup(temp_port_file.c_str(), 9600, temp_video_file.c_str());
-			}
-			catch (std::exception e)
-			{
-				std::cout << e.what() << std::endl;
-				throw -1;
-			}
-			 
-			device_list.push_back(temp_device);
-		}
+/**
+ * The background is hidden while the overlay is fully opaque, or crossfading over one
+ * that is. It is suspended then: paused, and neither updated, so nothing is decoded or
+ * uploaded, nor drawn. It resumes from where it was paused one fade duration before the
+ * overlay's fade out is due, so it is decoding again by the time it shows, and plays
+ * on through fades to and from it.
+ */
+void updateBackground()
+{
+	if (!background_started)
+	{
+		return;
 	}
-	catch (int e)
+
+	const OverlaySnapshot& snapshot = queue_core.snapshot();
+	bool suspend = snapshot.covers_background() && !snapshot.background_due;
+
+	if (suspend && !background_suspended)
 	{
-		fatal_error = true;
-		exit(-1);
+		background->setPaused(true);
 	}
-	catch (std::exception e) // this catches all other errors, so if syntax of json is correct, look for another issue in the code.
+	else if (!suspend && background_suspended)
 	{
-		std::cout << e.what() << std::endl;
-		std::cout << "\nFATAL ERROR! Config file contains a syntax error. Please refer to documentation for syntax info." << std::endl;
-		fatal_error = true;
-		exit(-1);
+		background->setPaused(false);
 	}
+
+	background_suspended = suspend;
 }
 
-//--------------------------------------------------------------
-void ofApp::setup() {
-	ofSetFullscreen(1);
+/**
+ * A clip's own frame rate, or 0 while it isn't known.
+ */
+float clipFrameRate(ofVideoPlayer* _player)
+{
+	float duration = _player->getDuration();
+	int frames = _player->getTotalNumFrames();
 
-	ofSetDataPathRoot("../data");
+	return ((duration > 0) && (frames > 0)) ? frames / duration : 0;
+}
 
-	loadConfigFile();
+/**
+ * Dirty rendering: marks the frame to be drawn again if anything on screen changed
+ * this tick, and paces the app to the fastest clip on screen. Without a clip whose rate
+ * is known, or above it, the configured frame rate is used.
+ */
+void updateRedraw()
+{
+	if (!dirty_rendering)
+	{
+		return;
+	}
 
-	std::cout << ofGetHeight() << std::endl;
-	std::cout << ofGetWidth() << std::endl;
+	const OverlaySnapshot& snapshot = queue_core.snapshot();
+	ofVideoPlayer* overlay = (snapshot.phase != OverlayPhase::Idle) ? station_player.getOverlay() : NULL;
+	ofVideoPlayer* outgoing = snapshot.crossfading ? station_player.getOutgoing() : NULL;
+	bool background_shown = background_started && !snapshot.covers_background();
+	float content_rate = 0;
 
-	//ofSetWindowPosition(window_posx, 25);
-	ofSetFrameRate(framerate);
+	if (background_shown)
+	{
+		frame_dirty = frame_dirty || background->isFrameNew();
+		content_rate = std::max(content_rate, clipFrameRate(background));
+	}
 
-	background.play();
-}
+	if (overlay != NULL)
+	{
+		frame_dirty = frame_dirty || overlay->isFrameNew();
+		content_rate = std::max(content_rate, clipFrameRate(overlay));
+	}
 
-bool isCurrentFrameOutsideFadePeriod()
-{
-	int current_frame = overlay->getCurrentFrame();
-	bool frame_in_begin_fade = (current_frame >= 0) && (current_frame <= fade_duration);
-	bool frame_in_end_fade = (current_frame >= overlay_fade_out_begin) && (current_frame <= overlay_fade_out_end);
-	return (!frame_in_begin_fade && !frame_in_end_fade);
-}
+	if (outgoing != NULL)
+	{
+		frame_dirty = frame_dirty || outgoing->isFrameNew();
+		content_rate = std::max(content_rate, clipFrameRate(outgoing));
+	}
 
-bool isCurrentFrameLastFrameOfFade()
-{
-	int current_frame = overlay->getCurrentFrame();
-	return (current_frame == overlay_fade_out_end);
-}
+	if ((overlay != drawn_overlay) || (snapshot.opacity != drawn_opacity) || (snapshot.crossfading != drawn_crossfading) || (background_shown != drawn_background))
+	{
+		frame_dirty = true;
+		drawn_overlay = overlay;
+		drawn_opacity = snapshot.opacity;
+		drawn_crossfading = snapshot.crossfading;
+		drawn_background = background_shown;
+	}
 
-void updateFadeOut()
-{
-	overlay_fade_out_begin = overlay->getCurrentFrame() + 1;
-	overlay_fade_out_end = overlay_fade_out_begin + fade_duration;
+	int content_framerate = (int)(content_rate + 0.5f);
+	setPacedFrameRate(((content_framerate > 0) && (content_framerate < framerate)) ? content_framerate : framerate);
 }
 
-void updateDevices()
-{
-	for (auto device : device_list)
+//--------------------------------------------------------------
+//	Is called every frame before ofApp::draw is called.
+
+void ofApp::update(){
+
+	TraceScope frame_scope("frame", "update");
+
+	countDroppedFrames();
+
 	{
-		device->getStateFromSerial();
-		handleVideoState(device);
+		TraceScope scope("frame", "updateStartup");
+		updateStartup();
 	}
-}
 
-void updateVideoQueue()
-{
-	if (video_queue.empty())
+	if (!background_suspended)
 	{
-		if (overlay != NULL) {
-			bool current_frame_outside_fade_period = isCurrentFrameOutsideFadePeriod();
-			bool current_frame_is_last_frame_of_fade = isCurrentFrameLastFrameOfFade();
-
-			if (current_frame_outside_fade_period)
-			{
-				updateFadeOut();
-			}
-			else if (current_frame_is_last_frame_of_fade)
-			{
-				overlay = NULL;
-			}
-		}
+		TraceScope scope("frame", "background.update");
+		background->update();
 	}
-	else
 	{
-		if (overlay != NULL)
-		{
-			bool current_frame_outside_fade_period = isCurrentFrameOutsideFadePeriod();
-			bool current_frame_is_last_frame_of_fade = isCurrentFrameLastFrameOfFade();
+		TraceScope scope("frame", "updateDevices");
+		updateDevices();
+	}
+	{
+		TraceScope scope("frame", "updateOverlay");
+		updateOverlay();
+	}
+	{
+		TraceScope scope("frame", "updateVideoQueue");
+		updateVideoQueue();
+		recordOverlayLatency();
+	}
+	{
+		TraceScope scope("frame", "updateBackground");
+		updateBackground();
+	}
+	{
+		TraceScope scope("frame", "updateConfig");
+		updateConfig();
+	}
+	{
+		TraceScope scope("frame", "updateRedraw");
+		updateRedraw();
+	}
 
-			if (current_frame_outside_fade_period)
-			{
-				bool head_changed_since_playing_overlay = (overlay != video_queue[0]);
+	//	A headless replay has nothing left to show once the recording has played out.
+	if (options.headless && traffic_replayer.isFinished())
+	{
+		ofExit();
+	}
+}
 
-				if (head_changed_since_playing_overlay)
-				{
-					updateFadeOut();
-				}
-			}
-			else if (current_frame_is_last_frame_of_fade)
-			{
-				for (auto i : device_list)
-				{
-					if (overlay == &i->video)
-					{
-						i->device_state = false;
-						handleVideoState(i);
-					}
-				}
 
-				overlay = NULL;
-			}
-		}
-		else
+/**
+ * A clip's current frame in the form the compositor takes, scaled into _scaled if it
+ * isn't the size of the background, which is slow and so is reported once. Returns
+ * NULL if the clip has no frame yet, or has a pixel format the compositor can't blend.
+ */
+const uint8_t* compositorFrame(ofVideoPlayer* _player, ofPixels& _scaled)
+{
+	ofPixels& pixels = _player->getPixels();
+
+	if (!pixels.isAllocated())
+	{
+		return NULL;
+	}
+
+	size_t width = compositor.getWidth();
+	size_t height = compositor.getHeight();
+
+	if (pixels.getNumChannels() != compositor.getChannels())
+	{
+		if (!reported_overlay_mismatch)
 		{
-			overlay = video_queue[0];
-			overlay->setLoopState(OF_LOOP_NONE);
-			overlay->firstFrame();
-			overlay_fade_out_end = overlay->getTotalNumFrames();
-			overlay_fade_out_begin = overlay_fade_out_end - fade_duration;
-			overlay->play();
+			LOG_WARNING("Overlay clip has a different pixel format to the background and can't be composited on the CPU.");
+			reported_overlay_mismatch = true;
 		}
+		return NULL;
+	}
+
+	if ((pixels.getWidth() == width) && (pixels.getHeight() == height))
+	{
+		return pixels.getData();
+	}
+
+	if (!reported_overlay_mismatch)
+	{
+		LOG_WARNING("Overlay clip is {}x{} but the background is {}x{}, it is being scaled every frame.", pixels.getWidth(), pixels.getHeight(), width, height);
+		reported_overlay_mismatch = true;
 	}
+
+	_scaled.allocate(width, height, pixels.getPixelFormat());
+	pixels.resizeTo(_scaled);
+	return _scaled.getData();
 }
 
-/** 
- * If the overlay is set, then it needs to be updated, and the background video needs
- * to be paused depending on if the current frame of the overlay is within either of the
- * two fade periods/sections.
- */	
-void updateBackground()
+/**
+ * CPU renderer: blends the overlay over the background at this tick's snapshot opacity
+ * into the compositor's frame, or over the outgoing overlay during a crossfade. Returns
+ * false until the background has a frame.
+ *
+ * The compositor works on frames the size of the background, see compositorFrame().
+ */
+bool composeFrame()
 {
-	if (overlay != NULL)
+	TraceScope scope("frame", "composeFrame");
+
+	ofPixels& background_pixels = background->getPixels();
+	if (!background_pixels.isAllocated())
 	{
-		overlay->update();
+		return false;
+	}
 
-		bool current_frame_outside_fade_period = isCurrentFrameOutsideFadePeriod();
-		bool current_frame_is_last_frame_of_fade = isCurrentFrameLastFrameOfFade();
+	size_t width = background_pixels.getWidth();
+	size_t height = background_pixels.getHeight();
+	size_t channels = background_pixels.getNumChannels();
 
-		if (current_frame_outside_fade_period)
-		{
-			background.setPaused(true);
-		}
-		else
+	if ((compositor.getWidth() != width) || (compositor.getHeight() != height) || (compositor.getChannels() != channels))
+	{
+		compositor.setup(width, height, channels);
+	}
+
+	OverlaySnapshot snapshot = queue_core.snapshot();
+	ofVideoPlayer* overlay = station_player.getOverlay();
+	ofVideoPlayer* outgoing = station_player.getOutgoing();
+	const uint8_t* overlay_data = NULL;
+	const uint8_t* base_data = background_pixels.getData();
+
+	if ((overlay != NULL) && (snapshot.phase != OverlayPhase::Idle))
+	{
+		overlay_data = compositorFrame(overlay, overlay_scaled);
+	}
+
+	if (snapshot.crossfading && (outgoing != NULL))
+	{
+		const uint8_t* outgoing_data = compositorFrame(outgoing, outgoing_scaled);
+
+		if (outgoing_data != NULL)
 		{
-			background.play();
+			base_data = outgoing_data;
 		}
 	}
-}
 
-//--------------------------------------------------------------
-//	Is called every frame before ofApp::draw is called.
+	uint64_t start_us = nowMicros();
+	compositor.compose(base_data, overlay_data, snapshot.opacity);
+	compose_total_us += nowMicros() - start_us;
+	composed_frames++;
 
-void ofApp::update(){
+	//	Report the average cost roughly every ten seconds, which is what sizing a player
+	//	machine needs.
+	if (composed_frames >= framerate * 10)
+	{
+		LOG_INFO("CPU compositor ({}): {} ms per {}x{} frame.", compositorKernelName(compositor.getKernel()), (compose_total_us / 1000.0) / composed_frames, width, height);
+		compose_total_us = 0;
+		composed_frames = 0;
+	}
 
-	background.update();
+	return true;
+}
 
-	updateDevices();
-	updateVideoQueue();
-	updateBackground();
-}
-
-
-//
-//	Sets the frame opacity based on which frame is currently being played in the video.
-// 
-//	There are two designated fading sections for the overlay. The illustration below shows what these
-//	fade sections would look like if placed on a frame-by-frame timeline:
-//	
-//	|-- fade section 1  --|================= video ===============|-- fade section 2 --|========...
-//
-//	fade section 1 - Begins at the first frame of the video and lasts for the pre-defined fade duration.
-//	fade section 2 - This is initially set to be at the end of the video, that is, the fade section's last
-//		frame is the last frame of the video. This fade section is depicted by two variables:
-//			overlay_fade_out_begin, 
-//			overlay_fade_out_end
-//		and if an action takes place that requires the video to end before it has completed playing, then
-//		these fade section variables should be edited to reflect the new fade section required to 
-//		fade out the video according to the new situation.
-// 
-//	E.g. If the overlay video is 500 frames, and the fade_duration is 25 frames, then overlay_fade_out_begin
-//		would be set to 475 and overlay_fade_out_end would be set to 500. Say that the player is on frame 250
-//		and we need to turn off the video, then overlay_fade_out_begin should be set to 251, and 
-//		overlay_fade_out_end should be set to 276 (251 + 25).
-//
-void setOverlayFrameOpacity()
-{
-	//	Get the current frame index of the overlay video.
-	int frame_number = overlay->getCurrentFrame();
-
-	//	Current frame is in fade section 1
-	if ((frame_number > -1) && (frame_number <= fade_duration))
-	{
-		//	Lerp across the fade duration using the frame number. Multiplying by 255 gives
-		//	the proper transparency value. transitions from transparent (0) to opaque (255).
-		int opacity = (int)(((double) frame_number / fade_duration) * 255);
-		ofSetColor(255, 255, 255, opacity);
-	}
-	//	Current frame is in fade section 2
-	else if ((frame_number <= overlay_fade_out_end) && (frame_number >= overlay_fade_out_begin))
-	{
-		//	Lerp accross overlay_fade_out_begin and overlay_fade_out_begin using the
-		//	current frame number. 
-		int numerator = frame_number - overlay_fade_out_begin;
-		int denominator = overlay_fade_out_end - overlay_fade_out_begin;
-		double lerp_value = (double) numerator / denominator;
-		
-		//	Because this is a fade out, subtract the lerp value from 1 before multipying by 255
-		//	so that the transition is from opaque to transparent.
-		int opacity = (1.0 - lerp_value) * 255;
-		ofSetColor(255, 255, 255, opacity);
+/**
+ * GPU renderer: the background, then during a crossfade the outgoing overlay, then the
+ * overlay alpha blended at this tick's snapshot opacity.
+ */
+void drawScene()
+{
+	//	Draws from the same snapshot update() worked from, so what is on screen always
+	//	matches the state the queue logic saw this tick.
+	OverlaySnapshot snapshot = queue_core.snapshot();
+
+	if (background_started && !snapshot.covers_background())
+	{
+		background->draw(window_posx, window_posy, window_width, window_height);
 	}
-}
 
-//--------------------------------------------------------------
-void ofApp::draw(){
+	ofVideoPlayer* overlay = station_player.getOverlay();
+	ofVideoPlayer* outgoing = station_player.getOutgoing();
 
-	background.draw(window_posx, window_posy, window_width, window_height);
+	//	During a crossfade the outgoing overlay stays fully opaque under the one fading in.
+	if (snapshot.crossfading && (outgoing != NULL))
+	{
+		outgoing->draw(window_posx, window_posy, window_width, window_height);
+	}
 
-	//	Only draw the overlay to the screen if the overlay is set.
-	if (overlay != NULL)
+	if ((overlay != NULL) && (snapshot.phase != OverlayPhase::Idle))
 	{
 		//	ofEnableAlphaBlending() called here will allow us to set the opacity of the 
 		//	overlay video frame.
 		ofEnableAlphaBlending();
-		
-		//	Update the overlay opacity and draw to screen
-		setOverlayFrameOpacity();
+
+		ofSetColor(255, 255, 255, (int)(snapshot.opacity * 255));
 		overlay->draw(window_posx, window_posy, window_width, window_height);
+		ofSetColor(255);
 		ofDisableAlphaBlending();
 	}
 }
 
-void serial_restart()
-{
-	std::cout << "restarting serial devices:" << std::endl;
+//--------------------------------------------------------------
+void ofApp::draw(){
 
-	std::vector<std::thread> extra_special_threadlist;
+	TraceScope scope("frame", "draw");
+
+	station_player.framePresented();
+
+	bool redraw = !dirty_rendering || frame_dirty;
+
+	if (dirty_rendering && redraw)
+	{
+		redrawn_render_frames.fetch_add(1, std::memory_order_relaxed);
+	}
+	else if (dirty_rendering)
+	{
+		reused_render_frames.fetch_add(1, std::memory_order_relaxed);
+	}
 
-	for (auto i : device_list)
+	if (cpu_renderer)
 	{
-		std::cout << "restarting " << i->port << "..." << std::endl;
+		//	With dirty rendering an unchanged frame is neither composed nor uploaded
+		//	again, the texture already holds it.
+		if (redraw && composeFrame())
+		{
+			frame_dirty = false;
 
-		if (!i->is_restarting) {
+			if (!options.headless)
+			{
+				int width = (int)compositor.getWidth();
+				int height = (int)compositor.getHeight();
+				int gl_format = (compositor.getChannels() == 4) ? GL_RGBA : GL_RGB;
 
-			i->is_restarting = true;
+				if (!composited_texture.isAllocated() || (composited_texture.getWidth() != width) || (composited_texture.getHeight() != height))
+				{
+					composited_texture.allocate(width, height, gl_format);
+				}
 
-			std::thread new_thread(InteractiveDevice::restartSerial, i->serial, i->port, i->baud);
-			extra_special_threadlist.push_back(new_thread);
+				composited_texture.loadData(compositor.getFrame(), width, height, gl_format);
+			}
+		}
 
-			std::cout << "begin restart..." << std::endl;
+		if (!options.headless && composited_texture.isAllocated())
+		{
+			composited_texture.draw(window_posx, window_posy, window_width, window_height);
 		}
+		return;
 	}
 
-	std::cout << "Moving on!" << std::endl;
+	if (!dirty_rendering)
+	{
+		drawScene();
+		return;
+	}
 
-	for (std::thread & f : extra_special_threadlist)
+	//	The whole window is kept in the FBO, so a frame that hasn't changed costs a
+	//	single textured quad.
+	if (!frame_fbo.isAllocated() || (frame_fbo.getWidth() != ofGetWidth()) || (frame_fbo.getHeight() != ofGetHeight()))
 	{
-		if (f.joinable()) 
-		{
-			std::cout << "waiting for thread..." << std::endl;
-			f.join();
-		}
+		frame_fbo.allocate(ofGetWidth(), ofGetHeight(), GL_RGB);
+		redraw = true;
+	}
+
+	if (redraw)
+	{
+		frame_fbo.begin();
+		ofClear(0, 0, 0, 255);
+		drawScene();
+		frame_fbo.end();
+		frame_dirty = false;
 	}
 
-	std::cout << "next..." << std::endl;
+	frame_fbo.draw(0, 0);
 }
 
 //--------------------------------------------------------------
@@ -440,12 +1900,16 @@ void ofApp::keyPressed(int key){
 		exit();
 	}
 
+	//	'r' asks every port to close and reopen. This only raises a flag for the thread
+	//	servicing each port, so the show keeps rendering while they reconnect.
 	else if (key == 114)
 	{	
-		std::cout << "R pressed" << std::endl;
+		LOG_INFO("R pressed, reconnecting serial devices...");
 
-		std::thread first(serial_restart);
-		first.join();
+		for (auto i : device_list)
+		{
+			i->requestReconnect();
+		}
 	}
 }
 
@@ -487,6 +1951,7 @@ void ofApp::mouseExited(int x, int y){
 //--------------------------------------------------------------
 void ofApp::windowResized(int w, int h){
 
+	frame_dirty = true;
 }
 
 //--------------------------------------------------------------
@@ -501,30 +1966,56 @@ void ofApp::dragEvent(ofDragInfo dragInfo){
 
 void ofApp::exit()
 {
+	metrics_server.stop();
+	config_watcher.stop();
+
+#ifdef SERIAL_REACTOR_ENABLED
+	delete serial_reactor;
+	serial_reactor = NULL;
+#endif
+
+	traffic_replayer.stop();
+	queue_core.clear();
+
+	Tracer::stop();
+
+	//	Stations on a shared port are deleted by their gateway.
 	for (InteractiveDevice* i : device_list)
 	{
-		free(i);
+		if (i->getGateway() == NULL)
+		{
+			delete i;
+		}
+	}
+	device_list.clear();
+
+	for (InteractiveDevice* i : gateway_list)
+	{
+		delete i;
+	}
+	gateway_list.clear();
+
+	//	Stations that were retired have already left device_list, but the reactor may not
+	//	have let go of them yet.
+	for (InteractiveDevice* i : detaching_devices)
+	{
+		delete i;
 	}
+	detaching_devices.clear();
+	retiring_devices.clear();
+
+	//	Only closed once every port has stopped being serviced, so nothing is lost.
+	traffic_recorder.close();
+
+	Logger::stop();
 
 	if (fatal_error == true)
 	{	
 		std::cout << std::endl;
 		std::cout << "This window will close in 10 seconds..." << std::endl;
 
-		wait(10);
+		//	Sleeps rather than spinning, there is nothing left to do but keep the message
+		//	on screen.
+		std::this_thread::sleep_for(std::chrono::seconds(10));
 	}
 }
-
-void ofApp::wait(int i)
-{
-	bool timeout_reached = false;
-
-	float start = ofGetElapsedTimef();
-	do {
-		float now = ofGetElapsedTimef();
-
-		if (now > start + i) {
-			timeout_reached = true;
-		}
-	} while (!timeout_reached);
-}